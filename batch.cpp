@@ -0,0 +1,515 @@
+#include "batch.h"
+#include "file_shredder.h"
+#include "folder_shredder.h"
+#include "free_space_wiper.h"
+#include "io_tuning.h"
+#include "logger.h"
+#include "numa_affinity.h"
+#include "progress.h"
+#include "sim_device.h"
+#include "utils.h"
+#include "volume_utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace batch {
+    namespace {
+        bool exists(const Job& job) {
+            std::error_code error;
+            switch (job.kind) {
+            case Kind::File: return fs::is_regular_file(job.target, error);
+            case Kind::Folder:
+            case Kind::FreeSpace: return fs::is_directory(job.target, error);
+            default: {
+                sim_device::Spec spec;
+                std::string reason;
+                return sim_device::isSimulated(job.target) ? sim_device::parse(job.target, spec, reason) && sim_device::usable(spec, reason)
+                    : fs::exists(job.target, error);
+            }
+            }
+        }
+
+        // The stricter of two limits, where 0 means unlimited
+        double stricter(double a, double b) {
+            return a == 0 ? b : b == 0 ? a : std::min(a, b);
+        }
+
+        Result execute(const Job& job, const std::string& device, double startedAt, std::shared_ptr<io_qos::Throttle> deviceThrottle) {
+            Result result;
+            result.job = job;
+            result.device = device;
+            result.node = numa_affinity::currentNode();
+            result.startedAt = startedAt;
+            logger::info(std::string("Batch job started (") + kindName(job.kind) + ")", { job.target, job.passes });
+            auto start = std::chrono::steady_clock::now();
+            try {
+                io_qos::Scope qos(io_qos::makeContext(job.qos, std::move(deviceThrottle)));
+                file_shredder::ShredOptions options;
+                options.verify = job.verify;
+                options.checkpoint = job.checkpoint;
+                options.calibrate = job.calibrate;
+                options.engine = job.engine;
+                options.scheme = job.scheme;
+                options.mmapWindow = job.mmapWindow;
+                switch (job.kind) {
+                case Kind::File: {
+                    options.quiet = true;   // jobs on other disks are writing to the same console
+                    result.bytes = fs::file_size(job.target);
+                    if (!file_shredder::securelyDelete(job.target, job.passes, job.pattern, options)) {
+                        result.exitCode = kExitFailed;
+                        result.error = "shred failed (see shredder.log)";
+                    }
+                    break;
+                }
+                case Kind::Folder: {
+                    folder_shredder::Config config;
+                    config.scheme = job.scheme;
+                    folder_shredder::Summary summary = folder_shredder::shred(job.target, job.passes, job.pattern, config);
+                    result.bytes = summary.bytesShredded;
+                    if (summary.filesFailed > 0 || summary.directoriesFailed > 0) {
+                        result.exitCode = kExitFailed;
+                        result.error = std::to_string(summary.filesFailed) + " files and " + std::to_string(summary.directoriesFailed) +
+                            " directories failed" + (summary.failures.empty() ? "" : ", first: " + summary.failures.front());
+                    }
+                    break;
+                }
+                case Kind::Partition: {
+                    options.discard = job.discard;
+                    result.bytes = volume_utils::sizeOf(job.target);
+                    if (!file_shredder::shredPartition(job.target, job.passes, job.pattern, options)) {
+                        result.exitCode = kExitFailed;
+                        result.error = "shred failed (see shredder.log)";
+                    }
+                    break;
+                }
+                case Kind::FreeSpace: {
+                    free_space_wiper::Config config = job.freeSpace;
+                    config.scheme = job.scheme;
+                    free_space_wiper::Summary summary = free_space_wiper::wipe(job.target, job.passes, job.pattern, config);
+                    result.bytes = summary.bytesWiped;
+                    if (!summary.failures.empty() || !summary.fillersRemoved) {
+                        result.exitCode = kExitFailed;
+                        result.error = summary.failures.empty() ? "filler files left behind" : summary.failures.front();
+                    }
+                    break;
+                }
+                }
+            }
+            catch (const std::exception& e) {
+                result.exitCode = kExitFailed;
+                result.error = e.what();
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (result.exitCode == kExitOk) {
+                logger::info("Batch job completed", { job.target, {}, result.bytes, result.seconds });
+            }
+            else {
+                logger::error("Batch job failed: " + result.error, { job.target, {}, result.bytes, result.seconds });
+            }
+            return result;
+        }
+    }
+
+    bool parseKind(const std::string& text, Kind& kind) {
+        static const std::map<std::string, Kind> kinds = {
+            { "file", Kind::File }, { "folder", Kind::Folder }, { "partition", Kind::Partition }, { "free-space", Kind::FreeSpace },
+        };
+        auto found = kinds.find(text);
+        if (found == kinds.end()) {
+            return false;
+        }
+        kind = found->second;
+        return true;
+    }
+
+    const char* kindName(Kind kind) {
+        switch (kind) {
+        case Kind::File: return "file";
+        case Kind::Folder: return "folder";
+        case Kind::Partition: return "partition";
+        default: return "free-space";
+        }
+    }
+
+    // Digits only: std::stoul alone would skip leading blanks and wrap a leading '-' around
+    bool parseNumber(const std::string& text, unsigned long& value) {
+        if (text.empty() || text[0] < '0' || text[0] > '9') {
+            return false;
+        }
+        size_t end = 0;
+        try {
+            value = std::stoul(text, &end);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        return end == text.size();
+    }
+
+    Job parseJob(const std::vector<std::string>& words, size_t line) {
+        if (words.size() < 2) {
+            throw std::runtime_error("expected <kind> <path> [options]");
+        }
+        Job job;
+        job.line = line;
+        if (!parseKind(words[0], job.kind)) {
+            throw std::runtime_error("unknown kind '" + words[0] + "' (file, folder, partition or free-space)");
+        }
+        job.target = words[1];
+        bool reserveGiven = false;
+        for (size_t i = 2; i < words.size(); ++i) {
+            const std::string& word = words[i];
+            size_t equals = word.find('=');
+            std::string key = word.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : word.substr(equals + 1);
+            if (key == "passes") {
+                unsigned long passes = 0;
+                if (!parseNumber(value, passes) || passes < 1) {
+                    throw std::runtime_error("passes must be a number of at least 1");
+                }
+                job.passes = passes;
+            }
+            else if (key == "scheme") {
+                schemes::Id scheme;
+                if (!schemes::parse(value, scheme)) {
+                    throw std::runtime_error("scheme must be classic, random, dod, gutmann or nist-clear");
+                }
+                job.scheme = scheme;
+            }
+            else if (key == "engine") {
+                if (!file_shredder::parseEngine(value, job.engine)) {
+                    throw std::runtime_error("engine must be stream, mmap or direct");
+                }
+            }
+            else if (key == "window") {
+                unsigned long megabytes = 0;
+                if (!parseNumber(value, megabytes) || megabytes < 1) {
+                    throw std::runtime_error("window must be a number of megabytes, at least 1");
+                }
+                job.mmapWindow = static_cast<size_t>(megabytes) * 1024 * 1024;
+            }
+            else if (key == "rate" || key == "device-rate" || key == "iops" || key == "device-iops") {
+                unsigned long number = 0;
+                if (!parseNumber(value, number) || number < 1) {
+                    throw std::runtime_error(key + " must be a number of at least 1");
+                }
+                io_qos::Limits& limits = key.compare(0, 7, "device-") == 0 ? job.deviceLimits : job.qos.limits;
+                if (key == "rate" || key == "device-rate") {
+                    limits.bytesPerSecond = static_cast<double>(number) * 1024 * 1024;
+                }
+                else {
+                    limits.iops = static_cast<double>(number);
+                }
+            }
+            else if (key == "ioprio") {
+                if (!io_qos::parsePriority(value, job.qos.priority)) {
+                    throw std::runtime_error("ioprio must be normal, best-effort or idle");
+                }
+            }
+            else if (key == "latency") {
+                unsigned long milliseconds = 0;
+                if (!parseNumber(value, milliseconds) || milliseconds < 1) {
+                    throw std::runtime_error("latency must be a number of milliseconds, at least 1");
+                }
+                job.qos.latencyTargetMs = static_cast<double>(milliseconds);
+            }
+            else if (key == "pattern") {
+                job.pattern.assign(value.begin(), value.end());
+            }
+            else if (key == "verify") {
+                if (value == "off") job.verify.mode = verifier::Mode::Off;
+                else if (value == "sampled") job.verify.mode = verifier::Mode::Sampled;
+                else if (value == "full") job.verify.mode = verifier::Mode::Full;
+                else if (value == "every-pass") {
+                    job.verify.mode = verifier::Mode::Full;
+                    job.verify.everyPass = true;
+                }
+                else {
+                    throw std::runtime_error("verify must be off, sampled, full or every-pass");
+                }
+            }
+            else if (key == "reserve") {
+                if (!free_space_wiper::parseReserve(value, job.freeSpace)) {
+                    throw std::runtime_error("reserve must be a size such as 512M or 2G, or a percentage below 100 such as 5%");
+                }
+                reserveGiven = true;
+            }
+            else if (key == "discard" && value.empty()) {
+                job.discard = true;
+            }
+            else if (key == "calibrate" && value.empty()) {
+                job.calibrate = true;
+            }
+            else if ((key == "checkpoint" || key == "resume") && value.empty()) {
+                job.checkpoint.enabled = true;
+                job.checkpoint.resume = job.checkpoint.resume || key == "resume";
+            }
+            else {
+                throw std::runtime_error("unknown option '" + word + "'");
+            }
+        }
+        if (reserveGiven && job.kind != Kind::FreeSpace) {
+            throw std::runtime_error("reserve only applies to free-space jobs");
+        }
+        if (job.discard && job.kind != Kind::Partition) {
+            throw std::runtime_error("discard only applies to partitions");
+        }
+        if ((job.checkpoint.enabled || job.calibrate) && job.kind != Kind::File && job.kind != Kind::Partition) {
+            throw std::runtime_error("checkpoint, resume and calibrate only apply to files and partitions");
+        }
+        if (!job.pattern.empty() && job.scheme && schemes::info(*job.scheme).passes != nullptr) {
+            throw std::runtime_error("a pattern only applies to the classic and random schemes");
+        }
+        if ((job.engine != file_shredder::WriteEngine::Stream || job.mmapWindow != 0) && job.kind != Kind::File) {
+            throw std::runtime_error("engine and window only apply to files");
+        }
+        return job;
+    }
+
+    // Splits a manifest line on whitespace; double quotes group words and are dropped
+    std::vector<std::string> splitWords(const std::string& line) {
+        std::vector<std::string> words;
+        std::string word;
+        bool quoted = false, inWord = false;
+        for (char c : line) {
+            if (c == '"') {
+                quoted = !quoted;
+                inWord = true;
+            }
+            else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+                if (inWord) {
+                    words.push_back(word);
+                    word.clear();
+                    inWord = false;
+                }
+            }
+            else {
+                word += c;
+                inWord = true;
+            }
+        }
+        if (quoted) {
+            throw std::runtime_error("unterminated quote");
+        }
+        if (inWord) {
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    std::vector<Job> parseManifest(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open manifest " + path);
+        }
+        std::vector<Job> jobs;
+        std::string text;
+        for (size_t line = 1; std::getline(file, text); ++line) {
+            size_t first = text.find_first_not_of(" \t\r");
+            if (first == std::string::npos || text[first] == '#') {
+                continue;
+            }
+            try {
+                jobs.push_back(parseJob(splitWords(text), line));
+            }
+            catch (const std::exception& e) {
+                throw std::runtime_error(path + ":" + std::to_string(line) + ": " + e.what());
+            }
+        }
+        return jobs;
+    }
+
+    std::string deviceOf(const std::string& target) {
+        // Every description is a disk of its own; a short tag keeps the tables readable
+        if (sim_device::isSimulated(target)) {
+            std::ostringstream tag;
+            tag << "sim" << std::hex << std::hash<std::string>()(target) % 0x10000;
+            return tag.str();
+        }
+        unsigned long long deviceId = io_tuning::targetDeviceId(target);
+        io_tuning::DeviceInfo info = io_tuning::probeDevice(deviceId);
+        return info.known && !info.key.empty() ? info.key : std::to_string(deviceId);
+    }
+
+    std::vector<Result> run(const std::vector<Job>& jobs, const Config& config) {
+        std::vector<Result> results(jobs.size());
+
+        // Groups keep manifest order, both between disks and within one
+        std::vector<std::vector<size_t>> groups;
+        std::map<std::string, size_t> groupOf;
+        std::vector<std::string> devices(jobs.size());
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (!exists(jobs[i])) {
+                results[i].job = jobs[i];
+                results[i].exitCode = kExitInvalid;
+                results[i].error = std::string("no such ") + (jobs[i].kind == Kind::File ? "file" : jobs[i].kind == Kind::Partition ? "device" : "directory");
+                sim_device::Spec spec;
+                if (sim_device::isSimulated(jobs[i].target) &&
+                    (!sim_device::parse(jobs[i].target, spec, results[i].error) || !sim_device::usable(spec, results[i].error))) {
+                    results[i].error = "invalid simulated device: " + results[i].error;
+                }
+                logger::error("Batch job skipped: " + results[i].error, { jobs[i].target });
+                continue;
+            }
+            devices[i] = deviceOf(jobs[i].target);
+            auto inserted = groupOf.emplace(devices[i], groups.size());
+            if (inserted.second) {
+                groups.emplace_back();
+            }
+            groups[inserted.first->second].push_back(i);
+        }
+
+        // One throttle per disk, shared by its jobs one after another and by the threads each of them starts
+        std::vector<std::shared_ptr<io_qos::Throttle>> deviceThrottles(groups.size());
+        for (size_t group = 0; group < groups.size(); ++group) {
+            io_qos::Limits limits;
+            for (size_t i : groups[group]) {
+                limits.bytesPerSecond = stricter(limits.bytesPerSecond, jobs[i].deviceLimits.bytesPerSecond);
+                limits.iops = stricter(limits.iops, jobs[i].deviceLimits.iops);
+            }
+            if (limits.limited()) {
+                deviceThrottles[group] = std::make_shared<io_qos::Throttle>(limits);
+            }
+        }
+
+        size_t workers = config.maxDevices == 0 ? groups.size() : std::min(config.maxDevices, groups.size());
+        logger::info("Batch started: " + std::to_string(jobs.size()) + " jobs on " + std::to_string(groups.size()) + " devices, " +
+            std::to_string(workers) + " at a time");
+
+        progress::Session session;
+        std::atomic<size_t> nextGroup{ 0 };
+        auto start = std::chrono::steady_clock::now();
+        auto worker = [&]() {
+            for (size_t group; (group = nextGroup.fetch_add(1)) < groups.size();) {
+                // Bound before the first lease, so the disk's buffers are faulted in on its node
+                const size_t first = groups[group].front();
+                numa_affinity::bindCurrentThread(io_tuning::probeDevice(io_tuning::targetDeviceId(jobs[first].target)).numaNode);
+                for (size_t i : groups[group]) {
+                    results[i] = execute(jobs[i], devices[i], std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                        deviceThrottles[group]);
+                }
+                numa_affinity::unbindCurrentThread();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < workers; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return results;
+    }
+
+    void printPlan(const std::vector<Job>& jobs) {
+        std::map<std::string, size_t> perDevice;
+        std::cout << "=========================\n";
+        std::cout << " Batch plan\n";
+        std::cout << "=========================\n";
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            bool found = exists(jobs[i]);
+            std::string device = found ? deviceOf(jobs[i].target) : "missing";
+            int node = found ? io_tuning::probeDevice(io_tuning::targetDeviceId(jobs[i].target)).numaNode : -1;
+            if (found) {
+                ++perDevice[device];
+            }
+            // Fixed schemes run their own passes; classic and random run the requested number
+            size_t passes = jobs[i].scheme && schemes::info(*jobs[i].scheme).passes ? schemes::info(*jobs[i].scheme).count : jobs[i].passes;
+            std::cout << std::setw(3) << i + 1 << "  " << std::left << std::setw(11) << kindName(jobs[i].kind) << std::setw(9) << device
+                << "node " << std::setw(3) << numa_affinity::describeNode(node) << std::right << std::setw(2) << passes << " passes  verify " << std::left << std::setw(8)
+                << verifier::modeName(jobs[i].verify.mode) << std::right << jobs[i].target;
+            std::string qos = io_qos::describe(jobs[i].qos);
+            if (jobs[i].deviceLimits.limited()) {
+                io_qos::Policy device;
+                device.limits = jobs[i].deviceLimits;
+                qos += (qos.empty() ? "disk " : "; disk ") + io_qos::describe(device);
+            }
+            if (!qos.empty()) {
+                std::cout << "  [" << qos << "]";
+            }
+            std::cout << "\n";
+        }
+        std::cout << jobs.size() << " jobs on " << perDevice.size() << " devices\n";
+    }
+
+    void printResults(const std::vector<Result>& results) {
+        size_t failed = 0;
+        std::cout << "=========================\n";
+        std::cout << " Batch results\n";
+        std::cout << "=========================\n";
+        std::cout << "  #  kind       device   exit  elapsed      bytes  target\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+            failed += result.exitCode != kExitOk;
+            std::cout << std::setw(3) << i + 1 << "  " << std::left << std::setw(11) << kindName(result.job.kind)
+                << std::setw(9) << (result.device.empty() ? "-" : result.device) << std::right << std::setw(4) << result.exitCode
+                << std::setw(8) << std::fixed << std::setprecision(1) << result.seconds << "s"
+                << std::setw(11) << (result.bytes > 0 ? utils::formatSize(result.bytes) : "-") << "  " << result.job.target << "\n";
+            if (!result.error.empty()) {
+                std::cout << "     " << result.error << "\n";
+            }
+        }
+        std::cout << (results.size() - failed) << " of " << results.size() << " jobs succeeded\n";
+
+        // A device's busy time is the sum of its jobs, which ran back to back; the batch took as long
+        // as its slowest device, so the speedup over one device at a time is busy time over wall time.
+        struct DeviceTotals {
+            int node = -1;
+            size_t jobs = 0;
+            unsigned long long bytes = 0;
+            double seconds = 0.0;
+        };
+        std::map<std::string, DeviceTotals> devices;
+        unsigned long long totalBytes = 0;
+        double busy = 0.0, wall = 0.0;
+        for (const Result& result : results) {
+            if (result.device.empty()) {
+                continue;
+            }
+            DeviceTotals& totals = devices[result.device];
+            totals.node = result.node;
+            ++totals.jobs;
+            totals.bytes += result.bytes;
+            totals.seconds += result.seconds;
+            totalBytes += result.bytes;
+            busy += result.seconds;
+            wall = std::max(wall, result.startedAt + result.seconds);
+        }
+        if (devices.empty()) {
+            return;
+        }
+        auto rate = [](unsigned long long bytes, double seconds) {
+            return utils::formatSize(seconds > 0 ? static_cast<unsigned long long>(bytes / seconds) : 0) + "/s";
+        };
+        std::cout << "\n  device   node  jobs  elapsed      bytes  throughput\n";
+        for (const auto& [device, totals] : devices) {
+            std::cout << "  " << std::left << std::setw(9) << device << std::setw(4) << numa_affinity::describeNode(totals.node) << std::right
+                << std::setw(6) << totals.jobs << std::setw(8) << std::fixed << std::setprecision(1) << totals.seconds << "s"
+                << std::setw(11) << utils::formatSize(totals.bytes) << "  " << rate(totals.bytes, totals.seconds) << "\n";
+        }
+        std::cout << "Total: " << utils::formatSize(totalBytes) << " on " << devices.size() << " devices in " << std::fixed
+            << std::setprecision(1) << wall << "s (" << rate(totalBytes, wall) << ", " << std::setprecision(2)
+            << (wall > 0 ? busy / wall : 1.0) << "x faster than one device at a time)\n";
+    }
+
+    int exitCode(const std::vector<Result>& results) {
+        int code = kExitOk;
+        for (const Result& result : results) {
+            code = std::max(code, result.exitCode);
+        }
+        return code;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "checkpoint.h"
+#include "file_shredder.h"
+#include "free_space_wiper.h"
+#include "io_qos.h"
+#include "schemes.h"
+#include "verifier.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// batch.h
+// Non-interactive jobs. A manifest lists one target per line; the scheduler groups the jobs by
+// physical disk, runs the disks in parallel and the jobs on one disk one after another, so a
+// machine with N disks shreds about N times as fast without making any single disk seek between
+// two targets. Each disk's worker is bound to the NUMA node of the disk's controller, so its
+// scratch buffers and random-data generators sit next to the device; constant-pattern blocks are
+// shared by all of them.
+//
+// Manifest lines (blank lines and lines starting with # are ignored):
+//   <file|folder|partition|free-space> <path> [passes=N] [pattern=TEXT] [verify=off|sampled|full|every-pass]
+//                                             [discard] [checkpoint] [resume] [calibrate] [engine=stream|mmap|direct]
+//                                             [window=MB] [scheme=classic|random|dod|gutmann|nist-clear]
+//                                             [rate=MB/s] [iops=N] [ioprio=normal|best-effort|idle] [latency=MS]
+//                                             [device-rate=MB/s] [device-iops=N] [reserve=SIZE|N%]
+// rate and iops cap the job itself; device-rate and device-iops cap every job on the target's disk
+// together (the lowest value given by any of them). latency makes the job back off while writes
+// take longer than that. reserve (free-space only) is the free space left for everything else on the
+// filesystem, in bytes with an optional K, M, G or T suffix or as a percentage of capacity.
+// Paths and patterns containing spaces can be double-quoted.
+namespace batch {
+    enum class Kind { File, Folder, Partition, FreeSpace };
+
+    struct Job {
+        Kind kind = Kind::File;
+        std::string target;
+        size_t passes = 3;
+        std::vector<unsigned char> pattern;     // empty = random data; classic and random schemes only
+        std::optional<schemes::Id> scheme;      // unset = the target's default
+        verifier::Options verify;
+        bool discard = false;                   // partitions only
+        checkpoint::Options checkpoint;         // files and partitions only
+        bool calibrate = false;                 // files and partitions only
+        file_shredder::WriteEngine engine = file_shredder::WriteEngine::Stream; // files only
+        size_t mmapWindow = 0;                  // mmap engine window in bytes; 0 = default
+        io_qos::Policy qos;
+        io_qos::Limits deviceLimits;            // shared with the other jobs on the same disk
+        free_space_wiper::Config freeSpace;     // free-space only: the reserve
+        size_t line = 0;                        // manifest line, 0 for jobs from the command line
+    };
+
+    // Exit codes, per job and for the whole run (the highest of its jobs)
+    const int kExitOk = 0;
+    const int kExitFailed = 1;      // the job ran and did not complete cleanly
+    const int kExitInvalid = 2;     // the job could not start: missing target, bad manifest or arguments
+
+    struct Result {
+        Job job;
+        std::string device;         // scheduling group
+        int node = -1;              // NUMA node the job ran on, -1 when unbound
+        int exitCode = kExitOk;
+        std::string error;
+        unsigned long long bytes = 0;   // size of the target (data shredded for folders and free space)
+        double startedAt = 0.0;         // seconds after the batch started
+        double seconds = 0.0;
+    };
+
+    struct Config {
+        size_t maxDevices = 0;      // disks worked on at once; 0 = all of them
+    };
+
+    // Throws std::runtime_error naming the line of the first malformed entry.
+    std::vector<Job> parseManifest(const std::string& path);
+    // Splits a manifest line into fields at blanks; double quotes keep blanks inside a field.
+    // Throws std::runtime_error on an unterminated quote.
+    std::vector<std::string> splitWords(const std::string& line);
+    // A non-negative decimal number and nothing else; false on signs, blanks or overflow
+    bool parseNumber(const std::string& text, unsigned long& value);
+    // Parses one manifest entry; `words` is the line already split into fields.
+    Job parseJob(const std::vector<std::string>& words, size_t line);
+    bool parseKind(const std::string& text, Kind& kind);
+    const char* kindName(Kind kind);
+
+    // The whole disk a target lives on ("major:minor"), or its device number when that is unknown
+    std::string deviceOf(const std::string& target);
+
+    std::vector<Result> run(const std::vector<Job>& jobs, const Config& config = {});
+    void printPlan(const std::vector<Job>& jobs);
+    // The per-job table, then throughput per device and for the whole batch
+    void printResults(const std::vector<Result>& results);
+    int exitCode(const std::vector<Result>& results);
+}
@@ -0,0 +1,481 @@
+// benchmark.cpp
+// Benchmarks for the shredding hot paths: random generation, pattern fill, the overwriteFile write
+// engines (stream, mmap and direct), folder shredding over synthetic trees and the partition path on an image file. I/O cases
+// run once per target directory (tmpfs and disk by default); the partition path also runs on a simulated device with
+// fixed latency and bandwidth, so queue depth is measured the same way on every machine. Results are JSON with one result per
+// line, so a later run can be checked against a saved one with --compare.
+#include "buffer_pool.h"
+#include "file_shredder.h"
+#include "folder_shredder.h"
+#include "logger.h"
+#include "mmap_writer.h"
+#include "random_engine.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    const unsigned long long MB = 1024 * 1024;
+
+    struct Target {
+        std::string label;      // "tmpfs", "disk"
+        std::string directory;  // scratch directory created under the one given on the command line
+    };
+
+    struct Options {
+        std::vector<Target> targets;
+        std::string filter;
+        bool quick = false;
+        size_t repeat = 3;
+        std::string out;
+        std::string compare;
+        double tolerance = 0.10;
+    };
+
+    struct Result {
+        std::string name;
+        std::string target;
+        std::string params;
+        unsigned long long bytes = 0;   // processed per run
+        unsigned long long items = 0;   // files per run, for cases where that is the better measure
+        std::vector<double> samples;
+
+        double best() const { return *std::min_element(samples.begin(), samples.end()); }
+        double median() const {
+            std::vector<double> sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+            return sorted[sorted.size() / 2];
+        }
+    };
+
+    class Suite {
+    public:
+        explicit Suite(const Options& options) : options_(options) {}
+
+        // Runs setup untimed and body timed, `repeat` times, unless the filter excludes the case.
+        void measure(const std::string& name, const std::string& target, const std::string& params,
+            unsigned long long bytes, unsigned long long items,
+            const std::function<void()>& setup, const std::function<void()>& body) {
+            if (!options_.filter.empty() && (name + "@" + target).find(options_.filter) == std::string::npos) {
+                return;
+            }
+            Result result{ name, target, params, bytes, items, {} };
+            for (size_t i = 0; i < std::max<size_t>(options_.repeat, 1); ++i) {
+                if (setup) {
+                    setup();
+                }
+                auto start = Clock::now();
+                body();
+                result.samples.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+            }
+            std::cerr << "  " << name << " @ " << target << " (" << params << "): " << rate(result) << "\n";
+            results_.push_back(result);
+        }
+
+        const std::vector<Result>& results() const { return results_; }
+
+        static std::string rate(const Result& result) {
+            std::ostringstream out;
+            out.precision(1);
+            out << std::fixed;
+            if (result.bytes > 0) {
+                out << result.bytes / result.best() / MB << " MB/s";
+            }
+            if (result.items > 0) {
+                out << (result.bytes > 0 ? ", " : "") << result.items / result.best() << " items/s";
+            }
+            return out.str();
+        }
+
+    private:
+        const Options& options_;
+        std::vector<Result> results_;
+    };
+
+    // Silences the console output of the shredder entry points while they are being timed
+    class QuietCout {
+    public:
+        QuietCout() : saved_(std::cout.rdbuf(nullptr)) {}
+        ~QuietCout() { std::cout.rdbuf(saved_); }
+
+    private:
+        std::streambuf* saved_;
+    };
+
+    void writeRandomFile(const std::string& path, unsigned long long size) {
+        static const std::vector<unsigned char> block = utils::generateRandomBuffer(static_cast<size_t>(4 * MB));
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        for (unsigned long long written = 0; written < size; written += block.size()) {
+            file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(std::min<unsigned long long>(block.size(), size - written)));
+        }
+    }
+
+    std::string sizeParam(unsigned long long bytes) {
+        return bytes >= MB ? std::to_string(bytes / MB) + "MB" : std::to_string(bytes / 1024) + "KB";
+    }
+
+    void benchRandom(Suite& suite, const Options& options) {
+        const size_t size = static_cast<size_t>((options.quick ? 16 : 64) * MB);
+        const std::string params = "size=" + sizeParam(size);
+        std::vector<unsigned char> buffer(size);
+        random_engine::Keystream stream = random_engine::newKeystream();
+
+        suite.measure("random/generateRandomBuffer", "memory", params, size, 0, {}, [&]() {
+            std::vector<unsigned char> generated = utils::generateRandomBuffer(size);
+            buffer[0] ^= generated[size - 1];
+        });
+        for (random_engine::Kernel kernel : { random_engine::Kernel::Scalar, random_engine::Kernel::SSE2, random_engine::Kernel::AVX2 }) {
+            if (random_engine::kernelSupported(kernel)) {
+                suite.measure(std::string("random/chacha20-") + random_engine::kernelName(kernel), "memory", params, size, 0, {}, [&]() {
+                    random_engine::fillWithKernel(kernel, stream, buffer.data(), size);
+                });
+            }
+        }
+        suite.measure("random/chacha20-parallel", "memory", params + ",threads=" + std::to_string(std::thread::hardware_concurrency()),
+            size, 0, {}, [&]() { random_engine::fill(stream, buffer.data(), size); });
+        suite.measure("random/mt19937_64", "memory", params, size, 0, {}, [&]() {
+            std::mt19937_64 rng(42);
+            for (size_t i = 0; i + 8 <= size; i += 8) {
+                unsigned long long value = rng();
+                std::memcpy(buffer.data() + i, &value, 8);
+            }
+        });
+    }
+
+    void benchPattern(Suite& suite, const Options& options) {
+        const size_t size = static_cast<size_t>((options.quick ? 16 : 64) * MB);
+        const std::string params = "size=" + sizeParam(size) + ",pattern=7B";
+        size_t round = 0;
+        // A different pattern each round, so the pool's cache of built blocks is never hit
+        suite.measure("pattern/patternBlock", "memory", params, size, 0, {}, [&]() {
+            std::string text = "SHRED" + std::to_string(round++ % 90 + 10);
+            std::shared_ptr<const unsigned char> block = buffer_pool::patternBlock(std::vector<unsigned char>(text.begin(), text.end()), size);
+        });
+        std::vector<unsigned char> buffer(size);
+        suite.measure("pattern/memset", "memory", "size=" + sizeParam(size), size, 0, {}, [&]() {
+            std::memset(buffer.data(), 0xFF, size);
+        });
+        // Cached against streaming stores of the same block, as the mmap engine copies it
+        std::shared_ptr<const unsigned char> ones = buffer_pool::onesBlock(size);
+        suite.measure("pattern/copy", "memory", "size=" + sizeParam(size), size, 0, {}, [&]() {
+            std::memcpy(buffer.data(), ones.get(), size);
+        });
+        suite.measure("pattern/stream-copy", "memory", "size=" + sizeParam(size) + ",kernel=" + mmap_writer::kernelName(), size, 0, {}, [&]() {
+            mmap_writer::streamCopy(buffer.data(), ones.get(), size);
+        });
+    }
+
+    void benchOverwrite(Suite& suite, const Options& options, const Target& target) {
+        const unsigned long long size = (options.quick ? 64 : 256) * MB;
+        const size_t passes = 1;
+        const std::string path = (fs::path(target.directory) / "overwrite.bin").string();
+        for (size_t chunk : { 1 * MB, 4 * MB, 16 * MB, 64 * MB }) {
+            file_shredder::ShredOptions shredOptions;
+            shredOptions.quiet = true;
+            shredOptions.chunkSize = chunk;
+            suite.measure("overwrite/file", target.label, "size=" + sizeParam(size) + ",chunk=" + sizeParam(chunk) + ",passes=1",
+                size * (passes + 1), 0,
+                [&]() { writeRandomFile(path, size); },
+                [&]() { file_shredder::overwriteFile(path, passes, {}, shredOptions); });
+        }
+        for (size_t window : { 4 * MB, 16 * MB, 64 * MB }) {
+            file_shredder::ShredOptions shredOptions;
+            shredOptions.quiet = true;
+            shredOptions.engine = file_shredder::WriteEngine::Mmap;
+            shredOptions.mmapWindow = window;
+            suite.measure("overwrite/mmap", target.label, "size=" + sizeParam(size) + ",window=" + sizeParam(window) + ",passes=1",
+                size * (passes + 1), 0,
+                [&]() { writeRandomFile(path, size); },
+                [&]() { file_shredder::overwriteFile(path, passes, {}, shredOptions); });
+        }
+        {
+            file_shredder::ShredOptions shredOptions;
+            shredOptions.quiet = true;
+            shredOptions.engine = file_shredder::WriteEngine::Direct;
+            suite.measure("overwrite/direct", target.label, "size=" + sizeParam(size) + ",passes=1",
+                size * (passes + 1), 0,
+                [&]() { writeRandomFile(path, size); },
+                [&]() { file_shredder::overwriteFile(path, passes, {}, shredOptions); });
+        }
+        fs::remove(path);
+    }
+
+    // Builds a tree of `levels` nested directories, each holding `dirs` subdirectories of `files` files
+    void buildTree(const fs::path& root, size_t levels, size_t dirs, size_t files, unsigned long long fileSize) {
+        fs::path level = root;
+        for (size_t depth = 0; depth < levels; ++depth) {
+            for (size_t d = 0; d < dirs; ++d) {
+                fs::path directory = level / ("d" + std::to_string(d));
+                fs::create_directories(directory);
+                for (size_t f = 0; f < files; ++f) {
+                    writeRandomFile((directory / ("f" + std::to_string(f))).string(), fileSize);
+                }
+            }
+            level /= "d0";
+        }
+    }
+
+    void benchFolder(Suite& suite, const Options& options, const Target& target) {
+        struct Shape {
+            const char* name;
+            size_t levels, dirs, files;
+            unsigned long long fileSize;
+        };
+        const Shape shapes[] = {
+            { "small-files", 1, options.quick ? 5u : 20u, 100, 4 * 1024 },
+            { "huge-files", 1, 1, 4, (options.quick ? 16 : 64) * MB },
+            { "deep-nesting", options.quick ? 30u : 100u, 1, 5, 16 * 1024 },
+        };
+        const fs::path root = fs::path(target.directory) / "tree";
+        for (const Shape& shape : shapes) {
+            size_t fileCount = shape.levels * shape.dirs * shape.files;
+            unsigned long long bytes = fileCount * shape.fileSize;
+            std::ostringstream params;
+            params << "files=" << fileCount << ",file_size=" << sizeParam(shape.fileSize) << ",depth=" << shape.levels << ",passes=1";
+            suite.measure(std::string("folder/") + shape.name, target.label, params.str(), bytes * 2, fileCount,
+                [&]() { fs::remove_all(root); buildTree(root, shape.levels, shape.dirs, shape.files, shape.fileSize); },
+                [&]() {
+                    folder_shredder::Summary summary = folder_shredder::shred(root.string(), 1, {});
+                    if (summary.filesShredded != fileCount) {
+                        std::cerr << "    warning: " << summary.filesFailed << " files failed\n";
+                    }
+                });
+        }
+        fs::remove_all(root);
+    }
+
+    void benchPartition(Suite& suite, const Options& options, const Target& target) {
+        const unsigned long long size = (options.quick ? 64 : 256) * MB;
+        const std::string path = (fs::path(target.directory) / "partition.img").string();
+        file_shredder::ShredOptions shredOptions;
+        shredOptions.quiet = true;
+        suite.measure("partition/image", target.label, "size=" + sizeParam(size) + ",passes=1", size * 2, 0,
+            [&]() { writeRandomFile(path, size); },
+            [&]() {
+                QuietCout quiet;
+                if (!file_shredder::shredPartition(path, 1, {}, shredOptions)) {
+                    std::cerr << "    warning: partition shred failed\n";
+                }
+            });
+        fs::remove(path);
+    }
+
+    // The partition path on an in-memory simulated disk (sim_device), at several queue depths
+    void benchSimulated(Suite& suite, const Options& options) {
+        const unsigned long long size = (options.quick ? 64 : 256) * MB;
+        const std::string device = "sim:size=" + std::to_string(size / MB) + "M,rate=1G,latency=1ms";
+        for (size_t depth : { 1, 4, 16 }) {
+            file_shredder::ShredOptions shredOptions;
+            shredOptions.quiet = true;
+            shredOptions.chunkSize = static_cast<size_t>(MB);
+            shredOptions.queueDepth = depth;
+            suite.measure("partition/sim", "sim", "size=" + sizeParam(size) + ",rate=1G,latency=1ms,chunk=1MB,depth=" + std::to_string(depth) + ",passes=1",
+                size * 2, 0, nullptr,
+                [&]() {
+                    QuietCout quiet;
+                    if (!file_shredder::shredPartition(device, 1, {}, shredOptions)) {
+                        std::cerr << "    warning: partition shred failed\n";
+                    }
+                });
+        }
+    }
+
+    std::string jsonEscape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+        std::time_t now = std::time(nullptr);
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        out << "{\n  \"schema\": 1,\n  \"timestamp\": \"" << timestamp << "\",\n";
+        out << "  \"host\": {\"hardware_threads\": " << std::thread::hardware_concurrency()
+            << ", \"random_kernel\": \"" << random_engine::kernelName(random_engine::activeKernel()) << "\"},\n";
+        out << "  \"config\": {\"quick\": " << (options.quick ? "true" : "false") << ", \"repeat\": " << options.repeat << "},\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            out << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"target\": \"" << r.target << "\", \"params\": \"" << jsonEscape(r.params)
+                << "\", \"bytes\": " << r.bytes << ", \"items\": " << r.items << ", \"best_s\": " << r.best() << ", \"median_s\": " << r.median();
+            if (r.bytes > 0) {
+                out << ", \"mb_per_s\": " << r.bytes / r.best() / MB;
+            }
+            if (r.items > 0) {
+                out << ", \"items_per_s\": " << r.items / r.best();
+            }
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    // Pulls "key": value out of one result line as written by writeJson
+    std::string field(const std::string& line, const std::string& key) {
+        std::string marker = "\"" + key + "\": ";
+        size_t pos = line.find(marker);
+        if (pos == std::string::npos) {
+            return "";
+        }
+        pos += marker.size();
+        if (line[pos] == '"') {
+            size_t end = line.find('"', pos + 1);
+            return line.substr(pos + 1, end - pos - 1);
+        }
+        size_t end = line.find_first_of(",}", pos);
+        return line.substr(pos, end - pos);
+    }
+
+    // Throughput per case of a saved run, keyed by name, target and params
+    std::map<std::string, double> loadBaseline(const std::string& path) {
+        std::map<std::string, double> baseline;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::string name = field(line, "name");
+            if (name.empty()) {
+                continue;
+            }
+            std::string value = field(line, "mb_per_s");
+            if (value.empty()) {
+                value = field(line, "items_per_s");
+            }
+            baseline[name + "@" + field(line, "target") + " " + field(line, "params")] = std::atof(value.c_str());
+        }
+        return baseline;
+    }
+
+    // Prints the change per case; returns false when any case is slower than the baseline by more than the tolerance.
+    bool compare(const Options& options, const std::vector<Result>& results) {
+        std::map<std::string, double> baseline = loadBaseline(options.compare);
+        if (baseline.empty()) {
+            std::cerr << "No results found in baseline " << options.compare << "\n";
+            return false;
+        }
+        bool ok = true;
+        std::cerr << "\nComparison with " << options.compare << " (tolerance " << options.tolerance * 100 << "%):\n";
+        for (const Result& r : results) {
+            auto it = baseline.find(r.name + "@" + r.target + " " + r.params);
+            if (it == baseline.end() || it->second <= 0) {
+                std::cerr << "  new       " << r.name << " @ " << r.target << "\n";
+                continue;
+            }
+            double current = r.bytes > 0 ? r.bytes / r.best() / MB : r.items / r.best();
+            double change = current / it->second - 1.0;
+            bool regressed = change < -options.tolerance;
+            ok = ok && !regressed;
+            std::cerr << (regressed ? "  REGRESSED " : "  ok        ") << r.name << " @ " << r.target << " (" << r.params << "): "
+                << (change >= 0 ? "+" : "") << static_cast<int>(change * 100) << "%\n";
+        }
+        return ok;
+    }
+
+    void usage() {
+        std::cerr << "Usage: shredder_bench [options]\n"
+            << "  --tmpfs DIR      tmpfs directory for I/O cases (default /dev/shm)\n"
+            << "  --disk DIR       disk-backed directory for I/O cases (default: current directory)\n"
+            << "  --filter TEXT    only cases whose name@target contains TEXT\n"
+            << "  --repeat N       runs per case; the best is reported (default 3)\n"
+            << "  --quick          smaller sizes\n"
+            << "  --out FILE       write JSON to FILE instead of stdout\n"
+            << "  --compare FILE   compare with a saved run; exit 1 on regressions\n"
+            << "  --tolerance F    allowed slowdown for --compare (default 0.10)\n";
+    }
+
+    bool parseArguments(int argc, char** argv, Options& options) {
+        std::string tmpfs = fs::is_directory("/dev/shm") ? "/dev/shm" : "";
+        std::string disk = ".";
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+            if (arg == "--tmpfs") tmpfs = value();
+            else if (arg == "--disk") disk = value();
+            else if (arg == "--filter") options.filter = value();
+            else if (arg == "--repeat") options.repeat = std::strtoul(value().c_str(), nullptr, 10);
+            else if (arg == "--quick") options.quick = true;
+            else if (arg == "--out") options.out = value();
+            else if (arg == "--compare") options.compare = value();
+            else if (arg == "--tolerance") options.tolerance = std::atof(value().c_str());
+            else {
+                usage();
+                return false;
+            }
+        }
+        std::string scratch = "shredder-bench-" + utils::generateRandomString(6);
+        if (!tmpfs.empty()) {
+            options.targets.push_back({ "tmpfs", (fs::path(tmpfs) / scratch).string() });
+        }
+        if (!disk.empty()) {
+            options.targets.push_back({ "disk", (fs::path(disk) / scratch).string() });
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        return 2;
+    }
+#ifdef _WIN32
+    _putenv_s("SHREDDER_PROGRESS", "off");
+#else
+    setenv("SHREDDER_PROGRESS", "off", 1);
+#endif
+    logger::Config logConfig;
+    logConfig.path = "shredder_bench.log";
+    logConfig.minLevel = logger::Level::Warning;
+    logger::configure(logConfig);
+
+    Suite suite(options);
+    std::cerr << "Memory benchmarks\n";
+    benchRandom(suite, options);
+    benchPattern(suite, options);
+    std::cerr << "Simulated device benchmarks\n";
+    benchSimulated(suite, options);
+    for (const Target& target : options.targets) {
+        std::error_code error;
+        if (!fs::create_directories(target.directory, error)) {
+            std::cerr << "Skipping " << target.label << ": cannot create " << target.directory << " (" << error.message() << ")\n";
+            continue;
+        }
+        std::cerr << "I/O benchmarks on " << target.label << " (" << target.directory << ")\n";
+        benchOverwrite(suite, options, target);
+        benchFolder(suite, options, target);
+        benchPartition(suite, options, target);
+        fs::remove_all(target.directory, error);
+    }
+
+    if (options.out.empty()) {
+        writeJson(std::cout, options, suite.results());
+    }
+    else {
+        std::ofstream out(options.out, std::ios::trunc);
+        writeJson(out, options, suite.results());
+    }
+
+    bool ok = options.compare.empty() || compare(options, suite.results());
+    logger::shutdown();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include "block_offload.h"
+#include "io_tuning.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#endif
+
+namespace block_offload {
+    namespace {
+        // Large enough that per-ioctl overhead vanishes, small enough for progress to move every second or so
+        const unsigned long long kChunk = 256ULL * 1024 * 1024;
+
+#ifdef __linux__
+        unsigned long request(Operation operation) {
+            switch (operation) {
+            case Operation::ZeroOut: return BLKZEROOUT;
+            case Operation::SecureDiscard: return BLKSECDISCARD;
+            default: return BLKDISCARD;
+            }
+        }
+
+        // The errors a device or driver answers with when it simply does not implement the operation
+        bool unsupported(int error) {
+            return error == EOPNOTSUPP || error == ENOTTY || error == EINVAL || error == ENODEV;
+        }
+#endif
+    }
+
+    Support probe(volume_utils::VolumeHandle handle, unsigned long long deviceId) {
+        Support support;
+#ifdef __linux__
+        struct stat info;
+        if (fstat(handle, &info) != 0 || !S_ISBLK(info.st_mode)) {
+            return support;     // image files: zeroing a file range only unmaps it, the old blocks keep their data
+        }
+        io_tuning::DeviceInfo device = io_tuning::probeDevice(deviceId);
+        support.zeroOut = true; // the kernel writes zero pages itself when the device has no WRITE ZEROES
+        support.hardwareZeroes = device.writeZeroesMaxBytes > 0;
+        support.discard = device.discardMaxBytes > 0;
+        support.discardGranularity = device.discardGranularity;
+#else
+        (void)handle;
+        (void)deviceId;
+#endif
+        return support;
+    }
+
+    bool run(volume_utils::VolumeHandle handle, Operation operation, unsigned long long offset, unsigned long long length,
+        const ProgressFn& progress) {
+#ifdef __linux__
+        const unsigned long long end = offset + length;
+        for (unsigned long long position = offset; position < end;) {
+            uint64_t range[2] = { position, std::min(kChunk, end - position) };
+            if (ioctl(handle, request(operation), range) != 0) {
+                int error = errno;
+                if (error == EINTR) {
+                    continue;
+                }
+                if (position == offset && unsupported(error)) {
+                    logger::debug(std::string(operationName(operation)) + " not supported by the device");
+                    return false;
+                }
+                errno = error;
+                throw std::runtime_error(std::string(operationName(operation)) + " failed at offset " + std::to_string(position) +
+                    " (" + volume_utils::lastErrorMessage() + ")");
+            }
+            if (progress) {
+                progress(range[1]);
+            }
+            position += range[1];
+        }
+        return true;
+#else
+        (void)handle;
+        (void)operation;
+        (void)offset;
+        (void)length;
+        (void)progress;
+        return false;
+#endif
+    }
+
+    std::string describe(const Support& support) {
+        if (!support.zeroOut) {
+            return "none";
+        }
+        std::string text = support.hardwareZeroes ? "zero-out (device)" : "zero-out (kernel)";
+        if (support.discard) {
+            text += ", discard";
+        }
+        return text;
+    }
+
+    const char* operationName(Operation operation) {
+        switch (operation) {
+        case Operation::ZeroOut: return "BLKZEROOUT";
+        case Operation::SecureDiscard: return "BLKSECDISCARD";
+        default: return "BLKDISCARD";
+        }
+    }
+}
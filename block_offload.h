@@ -0,0 +1,33 @@
+#pragma once
+#include "volume_utils.h"
+#include <functional>
+#include <string>
+
+// block_offload.h
+// Zeroing and discarding done by the kernel or the device instead of writing buffers from user
+// space: BLKZEROOUT (WRITE ZEROES where the device has it), BLKSECDISCARD and BLKDISCARD. Ranges
+// are issued in chunks so progress keeps moving; callers fall back to normal writes when the
+// device turns an operation down.
+namespace block_offload {
+    enum class Operation { ZeroOut, SecureDiscard, Discard };
+
+    struct Support {
+        bool zeroOut = false;           // BLKZEROOUT accepted (any block device)
+        bool hardwareZeroes = false;    // ... and the device zeroes ranges itself
+        bool discard = false;           // BLKDISCARD; secure discard is only known once tried
+        unsigned long long discardGranularity = 0;
+    };
+
+    Support probe(volume_utils::VolumeHandle handle, unsigned long long deviceId);
+
+    // Called with the bytes completed by each chunk
+    using ProgressFn = std::function<void(unsigned long long bytes)>;
+
+    // Returns false, with nothing done, when the device rejects the operation on the first chunk.
+    // Throws std::runtime_error when a later chunk fails.
+    bool run(volume_utils::VolumeHandle handle, Operation operation, unsigned long long offset, unsigned long long length,
+        const ProgressFn& progress = {});
+
+    std::string describe(const Support& support);
+    const char* operationName(Operation operation);
+}
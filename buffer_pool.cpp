@@ -0,0 +1,390 @@
+#include "buffer_pool.h"
+#include "io_tuning.h"
+#include "numa_affinity.h"
+#include "utils.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace buffer_pool {
+    struct Region {
+        unsigned char* data;
+        size_t size;
+        int node;   // NUMA node of the thread that faulted it in, -1 when unbound
+    };
+
+    namespace {
+        // Enough for every distinct pass of the Gutmann scheme (22) plus a custom pattern, within a byte cap
+        const size_t kPatternCacheLimit = 32;
+        const unsigned long long kPatternCacheBytes = 512ull * 1024 * 1024;
+        const unsigned long long kMinBudget = 64ull * 1024 * 1024;
+        const unsigned long long kMaxDefaultBudget = 1024ull * 1024 * 1024;
+
+        size_t pageSize() {
+#ifdef _WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return std::max<size_t>(info.dwPageSize, utils::kIoAlignment);
+#else
+            long size = sysconf(_SC_PAGESIZE);
+            return std::max<size_t>(size > 0 ? static_cast<size_t>(size) : 0, utils::kIoAlignment);
+#endif
+        }
+
+        // Touches every page now so the faults are not paid during the first pass.
+        void prefault(void* ptr, size_t size) {
+            for (size_t offset = 0; offset < size; offset += pageSize()) {
+                static_cast<volatile unsigned char*>(ptr)[offset] = 0;
+            }
+        }
+
+        // Rounding sizes keeps the free lists small and lets big regions use whole huge pages.
+        size_t roundSize(size_t size) {
+            size_t granule = size >= kHugePageSize ? kHugePageSize : pageSize();
+            return (std::max<size_t>(size, 1) + granule - 1) / granule * granule;
+        }
+
+        Region* mapRegion(size_t size) {
+#ifdef _WIN32
+            void* ptr = nullptr;
+            // Large pages need SeLockMemoryPrivilege; without it the call fails and normal pages are used.
+            SIZE_T largePage = GetLargePageMinimum();
+            if (largePage != 0 && size % largePage == 0) {
+                ptr = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            }
+            if (ptr == nullptr) {
+                ptr = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+                if (ptr != nullptr) {
+                    prefault(ptr, size);
+                }
+            }
+            if (ptr == nullptr) {
+                throw std::bad_alloc();
+            }
+#else
+            void* ptr = MAP_FAILED;
+            if (size >= kHugePageSize) {
+                // Reserved hugetlbfs pages first; MAP_POPULATE faults the whole region in up front.
+                ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+                if (ptr == MAP_FAILED) {
+                    // Transparent huge pages need a 2 MB-aligned range: over-map, then trim both ends.
+                    size_t span = size + kHugePageSize;
+                    void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (raw != MAP_FAILED) {
+                        uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+                        uintptr_t aligned = (start + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+                        if (aligned > start) {
+                            munmap(raw, aligned - start);
+                        }
+                        size_t tail = span - (aligned - start) - size;
+                        if (tail > 0) {
+                            munmap(reinterpret_cast<void*>(aligned + size), tail);
+                        }
+                        ptr = reinterpret_cast<void*>(aligned);
+                        madvise(ptr, size, MADV_HUGEPAGE);
+                        prefault(ptr, size);
+                    }
+                }
+            }
+            else {
+                ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+            }
+            if (ptr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+#endif
+            return new Region{ static_cast<unsigned char*>(ptr), size, numa_affinity::currentNode() };
+        }
+
+        void unmapRegion(Region* region) {
+#ifdef _WIN32
+            VirtualFree(region->data, 0, MEM_RELEASE);
+#else
+            munmap(region->data, region->size);
+#endif
+            delete region;
+        }
+
+        void makeReadOnly(Region* region) {
+#ifdef _WIN32
+            DWORD previous = 0;
+            VirtualProtect(region->data, region->size, PAGE_READONLY, &previous);
+#else
+            mprotect(region->data, region->size, PROT_READ);
+#endif
+        }
+
+        class Arena {
+        public:
+            std::vector<Region*> acquire(size_t count, size_t size) {
+                const size_t rounded = roundSize(size);
+                const unsigned long long need = static_cast<unsigned long long>(count) * rounded;
+                std::vector<Region*> regions;
+                std::vector<Region*> evicted;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    released_.wait(lock, [&]() { return leased_ == 0 || leased_ + need <= budgetLocked(); });
+                    leased_ += need;
+                    // Regions faulted in on the caller's node first; any other idle region still beats a fresh mapping
+                    const int node = numa_affinity::currentNode();
+                    for (bool local : { true, false }) {
+                        auto range = idle_.equal_range(rounded);
+                        for (auto it = range.first; it != range.second && regions.size() < count;) {
+                            if (local && it->second->node != node) {
+                                ++it;
+                                continue;
+                            }
+                            regions.push_back(it->second);
+                            idleBytes_ -= rounded;
+                            it = idle_.erase(it);
+                        }
+                    }
+                    trimLocked(evicted);
+                }
+                for (Region* region : evicted) {
+                    unmapRegion(region);
+                }
+
+                try {
+                    while (regions.size() < count) {
+                        regions.push_back(mapRegion(rounded));
+                    }
+                }
+                catch (...) {
+                    for (Region* region : regions) {
+                        release(region);
+                    }
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    leased_ -= static_cast<unsigned long long>(count - regions.size()) * rounded;
+                    released_.notify_all();
+                    throw;
+                }
+                return regions;
+            }
+
+            void release(Region* region) {
+                std::vector<Region*> evicted;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    leased_ -= region->size;
+                    idle_.emplace(region->size, region);
+                    idleBytes_ += region->size;
+                    trimLocked(evicted);
+                }
+                released_.notify_all();
+                for (Region* evictedRegion : evicted) {
+                    unmapRegion(evictedRegion);
+                }
+            }
+
+            void setBudget(unsigned long long bytes) {
+                std::vector<Region*> evicted;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    budget_ = std::max(bytes, static_cast<unsigned long long>(pageSize()));
+                    trimLocked(evicted);
+                }
+                released_.notify_all();
+                for (Region* region : evicted) {
+                    unmapRegion(region);
+                }
+            }
+
+            unsigned long long budget() {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return budgetLocked();
+            }
+
+        private:
+            unsigned long long budgetLocked() {
+                if (budget_ == 0) {
+                    unsigned long long available = io_tuning::availableMemory();
+                    budget_ = available == 0 ? kMinBudget : std::min(std::max(available / 4, kMinBudget), kMaxDefaultBudget);
+                }
+                return budget_;
+            }
+
+            // Idle regions are dropped, largest first, while leased plus idle memory exceeds the budget.
+            void trimLocked(std::vector<Region*>& evicted) {
+                while (!idle_.empty() && leased_ + idleBytes_ > budgetLocked()) {
+                    auto last = std::prev(idle_.end());
+                    idleBytes_ -= last->first;
+                    evicted.push_back(last->second);
+                    idle_.erase(last);
+                }
+            }
+
+            std::mutex mutex_;
+            std::condition_variable released_;
+            std::multimap<size_t, Region*> idle_;
+            unsigned long long idleBytes_ = 0;
+            unsigned long long leased_ = 0;
+            unsigned long long budget_ = 0; // 0 = not yet sized
+        };
+
+        Arena& arena() {
+            static Arena* instance = new Arena(); // never destroyed: leases may outlive static teardown
+            return *instance;
+        }
+
+        struct PatternEntry {
+            std::shared_ptr<const unsigned char> block;
+            size_t size = 0;
+            unsigned long long lastUse = 0;
+        };
+
+        std::mutex patternMutex;
+        std::map<std::vector<unsigned char>, PatternEntry> patternCache;
+        unsigned long long patternClock = 0;
+
+        // N 16-byte vectors hold lcm(N, 16) bytes of an N-byte pattern, so storing them in turn repeats
+        // the pattern with no per-byte work; the fixed-size copies compile to vector stores.
+        template <size_t N>
+        void fillRepeating(unsigned char* dst, size_t size, const unsigned char* pattern) {
+            unsigned char seed[16 * N];
+            for (size_t i = 0; i < sizeof(seed); ++i) {
+                seed[i] = pattern[i % N];
+            }
+            size_t offset = 0;
+            for (; offset + sizeof(seed) <= size; offset += sizeof(seed)) {
+                std::memcpy(dst + offset, seed, sizeof(seed));
+            }
+            std::memcpy(dst + offset, seed, size - offset);
+        }
+
+        template <>
+        void fillRepeating<1>(unsigned char* dst, size_t size, const unsigned char* pattern) {
+            if (pattern[0] != 0) { // fresh anonymous memory is already zero
+                std::memset(dst, pattern[0], size);
+            }
+        }
+
+        // Longer patterns: lay down one copy, then keep doubling the filled prefix
+        void fillDoubling(unsigned char* dst, size_t size, const std::vector<unsigned char>& pattern) {
+            size_t filled = std::min(pattern.size(), size);
+            std::memcpy(dst, pattern.data(), filled);
+            while (filled < size) {
+                size_t copy = std::min(filled - filled % pattern.size(), size - filled);
+                std::memcpy(dst + filled, dst, copy);
+                filled += copy;
+            }
+        }
+
+        std::shared_ptr<const unsigned char> buildPatternBlock(const std::vector<unsigned char>& pattern, size_t size) {
+            Region* region = mapRegion(roundSize(size));
+            std::shared_ptr<Region> owner(region, unmapRegion);
+            switch (pattern.size()) {
+            case 1: fillRepeating<1>(region->data, region->size, pattern.data()); break;
+            case 2: fillRepeating<2>(region->data, region->size, pattern.data()); break;
+            case 3: fillRepeating<3>(region->data, region->size, pattern.data()); break;
+            case 4: fillRepeating<4>(region->data, region->size, pattern.data()); break;
+            case 5: fillRepeating<5>(region->data, region->size, pattern.data()); break;
+            case 6: fillRepeating<6>(region->data, region->size, pattern.data()); break;
+            case 7: fillRepeating<7>(region->data, region->size, pattern.data()); break;
+            case 8: fillRepeating<8>(region->data, region->size, pattern.data()); break;
+            default: fillDoubling(region->data, region->size, pattern); break;
+            }
+            makeReadOnly(region);
+            return std::shared_ptr<const unsigned char>(owner, region->data);
+        }
+    }
+
+    Lease& Lease::operator=(Lease&& other) noexcept {
+        if (this != &other) {
+            if (region_ != nullptr) {
+                arena().release(region_);
+            }
+            region_ = other.region_;
+            other.region_ = nullptr;
+        }
+        return *this;
+    }
+
+    Lease::~Lease() {
+        if (region_ != nullptr) {
+            arena().release(region_);
+        }
+    }
+
+    unsigned char* Lease::get() const {
+        return region_ != nullptr ? region_->data : nullptr;
+    }
+
+    size_t Lease::size() const {
+        return region_ != nullptr ? region_->size : 0;
+    }
+
+    std::vector<Lease> acquire(size_t count, size_t size) {
+        std::vector<Lease> leases;
+        if (count == 0) {
+            return leases;
+        }
+        for (Region* region : arena().acquire(count, size)) {
+            leases.emplace_back(region);
+        }
+        return leases;
+    }
+
+    Lease acquire(size_t size) {
+        return std::move(acquire(1, size).front());
+    }
+
+    std::shared_ptr<const unsigned char> patternBlock(const std::vector<unsigned char>& pattern, size_t size) {
+        if (pattern.empty()) {
+            throw std::invalid_argument("Pattern must not be empty");
+        }
+        std::lock_guard<std::mutex> lock(patternMutex);
+        PatternEntry& entry = patternCache[pattern];
+        entry.lastUse = ++patternClock;
+        if (!entry.block || entry.size < size) {
+            // Blocks already handed out stay valid; they are freed when their last user lets go.
+            entry.block = buildPatternBlock(pattern, size);
+            entry.size = roundSize(size);
+        }
+        std::shared_ptr<const unsigned char> block = entry.block;
+
+        auto cachedBytes = [&]() {
+            unsigned long long total = 0;
+            for (const auto& cached : patternCache) {
+                total += cached.second.size;
+            }
+            return total;
+        };
+        // The entry just used is the newest, so it is never the one evicted
+        while (patternCache.size() > kPatternCacheLimit || (patternCache.size() > 1 && cachedBytes() > kPatternCacheBytes)) {
+            auto oldest = std::min_element(patternCache.begin(), patternCache.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+            patternCache.erase(oldest);
+        }
+        return block;
+    }
+
+    std::shared_ptr<const unsigned char> zeroBlock(size_t size) {
+        return patternBlock({ 0x00 }, size);
+    }
+
+    std::shared_ptr<const unsigned char> onesBlock(size_t size) {
+        return patternBlock({ 0xFF }, size);
+    }
+
+    void setBudget(unsigned long long bytes) {
+        arena().setBudget(bytes);
+    }
+
+    unsigned long long budget() {
+        return arena().budget();
+    }
+}
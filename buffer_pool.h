@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// buffer_pool.h
+// Process-wide pool for the large buffers behind every overwrite. Constant-pattern blocks (zeros,
+// 0xFF, repeated custom patterns) are built once and shared read-only across files and threads;
+// scratch buffers for random data are recycled through an arena held under a global memory budget.
+// Memory is page-aligned and pre-faulted, and regions of 2 MB or more are backed by huge pages
+// when the system provides them. Scratch regions remember the NUMA node they were faulted in on, and a
+// thread bound to a node gets that node's idle regions first.
+namespace buffer_pool {
+    const size_t kHugePageSize = 2 * 1024 * 1024;
+
+    struct Region;
+
+    // A scratch buffer borrowed from the arena; it goes back to the arena when the lease is destroyed.
+    class Lease {
+    public:
+        Lease() = default;
+        explicit Lease(Region* region) : region_(region) {}
+        Lease(Lease&& other) noexcept : region_(other.region_) { other.region_ = nullptr; }
+        Lease& operator=(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        unsigned char* get() const;
+        size_t size() const;
+
+    private:
+        Region* region_ = nullptr;
+    };
+
+    // Blocks until all `count` buffers fit in the budget alongside the other leases, so a job never
+    // holds part of its set while waiting for the rest. A set larger than the whole budget is granted
+    // once nothing else is leased. Do not call while already holding a lease.
+    std::vector<Lease> acquire(size_t count, size_t size);
+    Lease acquire(size_t size);
+
+    // Read-only block of at least `size` bytes holding `pattern` repeated from offset 0.
+    std::shared_ptr<const unsigned char> patternBlock(const std::vector<unsigned char>& pattern, size_t size);
+    std::shared_ptr<const unsigned char> zeroBlock(size_t size);
+    std::shared_ptr<const unsigned char> onesBlock(size_t size);
+
+    // Bytes of scratch memory the arena may hold; defaults to a quarter of available memory, capped at 1 GB.
+    void setBudget(unsigned long long bytes);
+    unsigned long long budget();
+}
@@ -0,0 +1,192 @@
+#include "checkpoint.h"
+#include "logger.h"
+#include "sim_device.h"
+#include "utils.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace checkpoint {
+    namespace {
+        const char* kMagic = "shredder-checkpoint 1";
+
+        unsigned long long fnv1a(const std::string& text) {
+            unsigned long long hash = 1469598103934665603ULL;
+            for (unsigned char c : text) {
+                hash = (hash ^ c) * 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        std::string journalPath(const Options& options, const std::string& target) {
+            std::ostringstream name;
+            // A simulated device is named by its description; only the disk part of it has to match
+            std::string key = sim_device::isSimulated(target) ? targetIdentity(target) : fs::absolute(target).string();
+            name << "shredder-" << std::hex << std::setw(16) << std::setfill('0') << fnv1a(key) << ".checkpoint";
+            return (fs::path(options.directory) / name.str()).string();
+        }
+
+        std::string toHex(const unsigned char* data, size_t length) {
+            std::ostringstream out;
+            for (size_t i = 0; i < length; ++i) {
+                out << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(data[i]);
+            }
+            return out.str();
+        }
+
+        bool fromHex(const std::string& text, unsigned char* data, size_t length) {
+            if (text.size() != length * 2 || text.find_first_not_of("0123456789abcdef") != std::string::npos) {
+                return false;
+            }
+            for (size_t i = 0; i < length; ++i) {
+                data[i] = static_cast<unsigned char>(std::stoul(text.substr(i * 2, 2), nullptr, 16));
+            }
+            return true;
+        }
+
+        // Writes the whole file next to its final name, syncs it, then renames it into place,
+        // so a crash leaves either the old record or the new one.
+        bool replaceDurably(const std::string& path, const std::string& contents) {
+            std::string temporary = path + ".tmp";
+#ifdef _WIN32
+            std::wstring wideTemporary = utils::stringToWString(temporary);
+            HANDLE file = CreateFileW(wideTemporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            DWORD written = 0;
+            bool ok = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) &&
+                written == contents.size() && FlushFileBuffers(file);
+            CloseHandle(file);
+            return ok && MoveFileExW(wideTemporary.c_str(), utils::stringToWString(path).c_str(),
+                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+            int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+            if (fd < 0) {
+                return false;
+            }
+            bool ok = ::write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()) && fsync(fd) == 0;
+            close(fd);
+            if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+                return false;
+            }
+            // The rename itself is only durable once the directory is synced
+            std::string directory = fs::path(path).parent_path().string();
+            int dirFd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd >= 0) {
+                fsync(dirFd);
+                close(dirFd);
+            }
+            return true;
+#endif
+        }
+    }
+
+    std::string targetIdentity(const std::string& path) {
+        sim_device::Spec spec;
+        std::string error;
+        if (sim_device::parse(path, spec, error)) {
+            // Faults and timing may change between runs; the disk itself may not
+            return "sim:" + std::to_string(spec.size) + ":" + std::to_string(spec.sectorSize) + ":" + spec.file;
+        }
+#ifdef _WIN32
+        struct _stat64 info;
+        if (_stat64(path.c_str(), &info) != 0) {
+            return "unknown";
+        }
+        return std::to_string(info.st_dev) + ":" + std::to_string(info.st_ino) + ":" + std::to_string(info.st_size);
+#else
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            return "unknown";
+        }
+        if (S_ISBLK(info.st_mode)) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            off_t size = fd >= 0 ? lseek(fd, 0, SEEK_END) : -1;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return "blk:" + std::to_string(info.st_rdev) + ":" + std::to_string(size);
+        }
+        return std::to_string(info.st_dev) + ":" + std::to_string(info.st_ino) + ":" + std::to_string(info.st_size);
+#endif
+    }
+
+    bool pending(const Options& options, const std::string& target) {
+        return fs::exists(journalPath(options, target));
+    }
+
+    Journal::Journal(const Options& options, const std::string& target, const std::string& scheme)
+        : options_(options), path_(journalPath(options, target)), target_(target), identity_(targetIdentity(target)), scheme_(scheme) {
+        if (options_.resume) {
+            std::ifstream file(path_);
+            std::string magic, key, identity, journalScheme, seed;
+            size_t pass = 0;
+            unsigned long long offset = 0;
+            std::getline(file, magic);
+            std::getline(file, key);    // target path, informational
+            bool parsed = magic == kMagic &&
+                std::getline(file, identity) && std::getline(file, journalScheme) && std::getline(file, seed) &&
+                static_cast<bool>(file >> pass >> offset) && fromHex(seed, seed_, sizeof(seed_));
+            if (parsed && identity == identity_ && journalScheme == scheme_ && pass >= 1) {
+                pass_ = pass;
+                offset_ = offset;
+                resumed_ = true;
+                logger::info("Resuming from checkpoint at pass " + std::to_string(pass_) + ", offset " + std::to_string(offset_), { target_ });
+            }
+            else if (file.is_open()) {
+                logger::warning("Checkpoint does not match the target or scheme; starting over", { target_ });
+            }
+        }
+        if (!resumed_) {
+            std::random_device entropy;
+            for (unsigned char& byte : seed_) {
+                byte = static_cast<unsigned char>(entropy());
+            }
+        }
+        write();
+    }
+
+    random_engine::Keystream Journal::keystream(size_t pass) const {
+        return random_engine::keystreamFromSeed(seed_, pass);
+    }
+
+    bool Journal::due() const {
+        return std::chrono::steady_clock::now() - lastWrite_ >= std::chrono::seconds(options_.intervalSeconds);
+    }
+
+    void Journal::record(size_t pass, unsigned long long offset) {
+        pass_ = pass;
+        offset_ = offset;
+        write();
+    }
+
+    void Journal::finish() {
+        std::error_code error;
+        fs::remove(path_, error);
+    }
+
+    void Journal::write() {
+        std::ostringstream record;
+        record << kMagic << "\n" << target_ << "\n" << identity_ << "\n" << scheme_ << "\n"
+            << toHex(seed_, sizeof(seed_)) << "\n" << pass_ << " " << offset_ << "\n";
+        if (!replaceDurably(path_, record.str())) {
+            throw std::runtime_error("Unable to write checkpoint journal " + path_);
+        }
+        lastWrite_ = std::chrono::steady_clock::now();
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "random_engine.h"
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+// checkpoint.h
+// Crash-safe journal for long overwrites. It records the target's identity, the scheme, the current
+// pass and the offset up to which that pass is durable, and is replaced atomically (write, fsync,
+// rename) at most once per interval. Random passes draw from a keystream derived from a seed kept in
+// the journal, so a resumed pass regenerates exactly the data the interrupted run would have written.
+namespace checkpoint {
+    struct Options {
+        bool enabled = false;
+        bool resume = false;                                // continue from a matching journal instead of starting over
+        unsigned intervalSeconds = 30;                      // longest stretch of work an interruption can lose
+        unsigned long long segmentBytes = 1ULL << 30;       // writes between checks of the interval
+        std::string directory = ".";
+    };
+
+    // Identifies what is being overwritten: device, inode and size for files; device and size for block devices.
+    std::string targetIdentity(const std::string& path);
+
+    // True when a journal for this target was left behind by an interrupted run
+    bool pending(const Options& options, const std::string& target);
+
+    class Journal {
+    public:
+        // Starts a new journal, or picks up the existing one when options.resume is set and it records
+        // the same identity and scheme. A mismatching journal is discarded.
+        Journal(const Options& options, const std::string& target, const std::string& scheme);
+
+        bool resumed() const { return resumed_; }
+        size_t pass() const { return pass_; }                   // first pass still to do (1-based)
+        unsigned long long offset() const { return offset_; }   // bytes of that pass already durable
+
+        random_engine::Keystream keystream(size_t pass) const;
+
+        bool due() const;
+        // Everything before `offset` in `pass` must already be on stable storage.
+        void record(size_t pass, unsigned long long offset);
+        // The overwrite finished; the journal is removed.
+        void finish();
+
+        const std::string& path() const { return path_; }
+
+    private:
+        void write();
+
+        Options options_;
+        std::string path_;
+        std::string target_;
+        std::string identity_;
+        std::string scheme_;
+        unsigned char seed_[32];
+        size_t pass_ = 1;
+        unsigned long long offset_ = 0;
+        bool resumed_ = false;
+        std::chrono::steady_clock::time_point lastWrite_;
+    };
+}
@@ -0,0 +1,164 @@
+#include "cli.h"
+#include "batch.h"
+#include "sim_device.h"
+#include "utils.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cli {
+    namespace {
+        struct Arguments {
+            std::string manifest;
+            std::vector<std::string> words;     // kind and paths
+            std::vector<std::string> options;   // manifest-style options applied to every command-line target
+            size_t parallel = 0;
+            bool dryRun = false;
+            bool yes = false;
+            bool help = false;
+        };
+
+        Arguments parse(int argc, char* argv[]) {
+            Arguments arguments;
+            for (int i = 1; i < argc; ++i) {
+                std::string argument = argv[i];
+                auto value = [&]() -> std::string {
+                    if (i + 1 >= argc) {
+                        throw std::runtime_error(argument + " needs a value");
+                    }
+                    return argv[++i];
+                };
+                if (argument == "--help" || argument == "-h") arguments.help = true;
+                else if (argument == "--manifest") arguments.manifest = value();
+                else if (argument == "--yes" || argument == "-y") arguments.yes = true;
+                else if (argument == "--dry-run") arguments.dryRun = true;
+                else if (argument == "--parallel") {
+                    unsigned long parallel = 0;
+                    if (!batch::parseNumber(value(), parallel)) {
+                        throw std::runtime_error("--parallel needs a number");
+                    }
+                    arguments.parallel = parallel;
+                }
+                else if (argument == "--passes") arguments.options.push_back("passes=" + value());
+                else if (argument == "--pattern") arguments.options.push_back("pattern=" + value());
+                else if (argument == "--verify") arguments.options.push_back("verify=" + value());
+                else if (argument == "--discard") arguments.options.push_back("discard");
+                else if (argument == "--checkpoint") arguments.options.push_back("checkpoint");
+                else if (argument == "--resume") arguments.options.push_back("resume");
+                else if (argument == "--calibrate") arguments.options.push_back("calibrate");
+                else if (argument == "--scheme") arguments.options.push_back("scheme=" + value());
+                else if (argument == "--engine") arguments.options.push_back("engine=" + value());
+                else if (argument == "--mmap-window") arguments.options.push_back("window=" + value());
+                else if (argument == "--rate") arguments.options.push_back("rate=" + value());
+                else if (argument == "--iops") arguments.options.push_back("iops=" + value());
+                else if (argument == "--ioprio") arguments.options.push_back("ioprio=" + value());
+                else if (argument == "--latency-target") arguments.options.push_back("latency=" + value());
+                else if (argument == "--device-rate") arguments.options.push_back("device-rate=" + value());
+                else if (argument == "--reserve") arguments.options.push_back("reserve=" + value());
+                else if (argument == "--device-iops") arguments.options.push_back("device-iops=" + value());
+                else if (argument.size() > 1 && argument[0] == '-') {
+                    throw std::runtime_error("unknown option " + argument);
+                }
+                else arguments.words.push_back(argument);
+            }
+            return arguments;
+        }
+
+        std::vector<batch::Job> jobsFrom(const Arguments& arguments) {
+            if (!arguments.manifest.empty()) {
+                if (!arguments.words.empty() || !arguments.options.empty()) {
+                    throw std::runtime_error("targets and job options go in the manifest when --manifest is used");
+                }
+                return batch::parseManifest(arguments.manifest);
+            }
+            if (arguments.words.size() < 2) {
+                throw std::runtime_error("expected --manifest FILE or <kind> <path>...");
+            }
+            std::vector<batch::Job> jobs;
+            for (size_t i = 1; i < arguments.words.size(); ++i) {
+                std::vector<std::string> words = { arguments.words[0], arguments.words[i] };
+                words.insert(words.end(), arguments.options.begin(), arguments.options.end());
+                jobs.push_back(batch::parseJob(words, 0));
+            }
+            return jobs;
+        }
+    }
+
+    void printUsage() {
+        std::cout << "Usage:\n"
+            "  shredder                      interactive menu\n"
+            "  shredder --manifest FILE [--parallel N] [--dry-run] [--yes]\n"
+            "  shredder <file|folder|partition|free-space> <path>... [options] [--yes]\n"
+            "  a partition path may be a simulated device, sim:size=1G,rate=200M,latency=1ms,... (Linux; see README)\n"
+            "\n"
+            "Options for command-line targets (manifest lines take the same as key=value words):\n"
+            "  --scheme NAME                 classic (files' default), random (partitions' default), dod, gutmann or nist-clear\n"
+            "  --passes N                    overwrite passes for classic and random (default 3)\n"
+            "  --pattern TEXT                repeat TEXT instead of random data\n"
+            "  --verify MODE                 off, sampled, full or every-pass\n"
+            "  --discard                     partitions: discard the device afterwards\n"
+            "  --checkpoint, --resume        files and partitions: journal progress, or resume from the journal\n"
+            "  --calibrate                   files and partitions: measure the best write size first\n"
+            "  --engine stream|mmap|direct   files: buffered writes (default), a mapping filled with streaming stores,\n"
+            "                                or unbuffered writes that leave nothing in the page cache\n"
+            "  --mmap-window MB              files: bytes mapped at a time by the mmap engine (default 64)\n"
+            "  --reserve SIZE|N%             free space: leave this much free, e.g. 1G or 5% (default 256M)\n"
+            "  --rate MB, --iops N           cap each job's writes per second\n"
+            "  --device-rate MB, --device-iops N   cap all jobs on one disk together\n"
+            "  --ioprio CLASS                normal, best-effort or idle I/O priority\n"
+            "  --latency-target MS           back off while single writes (up to a chunk, often 8 MB) take longer than MS\n"
+            "\n"
+            "  --parallel N                  disks worked on at once (default: all)\n"
+            "  --dry-run                     print the plan and exit\n"
+            "  --yes                         run without asking; required, nothing is shredded without it\n"
+            "\n"
+            "Exit codes: 0 all jobs succeeded, 1 a job failed, 2 a job could not start or the arguments are invalid.\n";
+    }
+
+    int run(int argc, char* argv[]) {
+        std::vector<batch::Job> jobs;
+        Arguments arguments;
+        try {
+            arguments = parse(argc, argv);
+            if (arguments.help) {
+                printUsage();
+                return batch::kExitOk;
+            }
+            jobs = jobsFrom(arguments);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n\n";
+            printUsage();
+            return batch::kExitInvalid;
+        }
+        if (jobs.empty()) {
+            std::cerr << "Error: the manifest lists no jobs.\n";
+            return batch::kExitInvalid;
+        }
+
+        batch::printPlan(jobs);
+        if (arguments.dryRun) {
+            return batch::kExitOk;
+        }
+        if (!arguments.yes) {
+            std::cerr << "Nothing was shredded; add --yes to run these jobs.\n";
+            return batch::kExitInvalid;
+        }
+        // Simulated devices are ordinary files or memory and need no privileges
+        bool needsAdmin = std::any_of(jobs.begin(), jobs.end(), [](const batch::Job& job) {
+            return job.kind != batch::Kind::Partition || !sim_device::isSimulated(job.target);
+        });
+        if (needsAdmin && !utils::isAdmin()) {
+            std::cerr << "This program requires administrative privileges. Please run as administrator.\n";
+            return batch::kExitInvalid;
+        }
+
+        batch::Config config;
+        config.maxDevices = arguments.parallel;
+        std::vector<batch::Result> results = batch::run(jobs, config);
+        batch::printResults(results);
+        return batch::exitCode(results);
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// cli.h
+// Command-line entry point for scripted runs; without arguments the program stays interactive.
+//   shredder --manifest jobs.txt [--parallel N] [--dry-run] [--yes]
+//   shredder <file|folder|partition|free-space> <path>... [--scheme NAME] [--passes N] [--pattern TEXT]
+//            [--verify off|sampled|full|every-pass] [--discard] [--checkpoint] [--resume] [--calibrate]
+//            [--engine stream|mmap|direct] [--mmap-window MB] [--reserve SIZE|N%] [--rate MB] [--iops N] [--device-rate MB]
+//            [--device-iops N] [--ioprio CLASS] [--latency-target MS] [--parallel N] [--dry-run] [--yes]
+// Nothing is shredded without --yes; the plan is printed instead. Returns the process exit code.
+namespace cli {
+    int run(int argc, char* argv[]);
+    void printUsage();
+}
@@ -0,0 +1,272 @@
+#include "dir_scanner.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace dir_scanner {
+    namespace {
+        std::atomic<size_t> handles{ 0 };
+
+#ifdef __linux__
+        // Not declared by glibc; the layout getdents64 fills in
+        struct LinuxDirent64 {
+            uint64_t d_ino;
+            int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+
+        const size_t kDirentBufferSize = 64 * 1024;
+
+        std::string errnoText(int error) {
+            return std::string(std::strerror(error));
+        }
+
+        Kind kindOf(mode_t mode) {
+            if (S_ISREG(mode)) {
+                return Kind::File;
+            }
+            if (S_ISDIR(mode)) {
+                return Kind::Directory;
+            }
+            return S_ISLNK(mode) ? Kind::Symlink : Kind::Other;
+        }
+#else
+        Kind kindOf(const fs::file_status& status) {
+            if (fs::is_regular_file(status)) {
+                return Kind::File;
+            }
+            if (fs::is_directory(status)) {
+                return Kind::Directory;
+            }
+            return fs::is_symlink(status) ? Kind::Symlink : Kind::Other;
+        }
+#endif
+    }
+
+    Directory::Directory(std::string path, int fd, unsigned long long device) : path_(std::move(path)), fd_(fd), device_(device) {
+        handles++;
+    }
+
+    Directory::~Directory() {
+#ifdef __linux__
+        close(fd_);
+#endif
+        handles--;
+    }
+
+    std::string Directory::childPath(const std::string& name) const {
+        return !path_.empty() && path_.back() == '/' ? path_ + name : path_ + "/" + name;
+    }
+
+#ifdef __linux__
+    std::shared_ptr<Directory> Directory::open(const std::string& path, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            error = errnoText(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        return std::shared_ptr<Directory>(new Directory(path, fd, static_cast<unsigned long long>(info.st_dev)));
+    }
+
+    std::shared_ptr<Directory> Directory::openChild(const std::string& name, std::string& error) const {
+        int fd = openat(fd_, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            error = errnoText(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        return std::shared_ptr<Directory>(new Directory(childPath(name), fd, static_cast<unsigned long long>(info.st_dev)));
+    }
+
+    bool Directory::forEach(const std::function<void(const Entry&)>& visit, std::string& error) const {
+        thread_local std::vector<char> buffer(kDirentBufferSize);
+        for (;;) {
+            long read = syscall(SYS_getdents64, fd_, buffer.data(), buffer.size());
+            if (read < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errnoText(errno);
+                return false;
+            }
+            if (read == 0) {
+                return true;
+            }
+            for (long offset = 0; offset < read;) {
+                const LinuxDirent64* dirent = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+                offset += dirent->d_reclen;
+                const char* name = dirent->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+                Entry entry{ name, Kind::Other, 0, false, static_cast<unsigned long long>(dirent->d_ino), 1 };
+                switch (dirent->d_type) {
+                case DT_DIR: entry.kind = Kind::Directory; break;
+                case DT_LNK: entry.kind = Kind::Symlink; break;
+                case DT_REG: entry.kind = Kind::File; break;
+                case DT_UNKNOWN: break;
+                default: visit(entry); continue;
+                }
+                // Regular files for their size; untyped entries (some network and FUSE filesystems) for their type
+                if (dirent->d_type == DT_REG || dirent->d_type == DT_UNKNOWN) {
+                    struct stat info;
+                    if (fstatat(fd_, name, &info, AT_SYMLINK_NOFOLLOW) == 0) {
+                        entry.kind = kindOf(info.st_mode);
+                        entry.size = static_cast<unsigned long long>(info.st_size);
+                        entry.sizeKnown = entry.kind == Kind::File;
+                        entry.links = static_cast<unsigned long>(info.st_nlink);
+                    }
+                }
+                visit(entry);
+            }
+        }
+    }
+
+    bool Directory::removeEntry(const std::string& name, std::string& error) const {
+        if (unlinkat(fd_, name.c_str(), 0) != 0) {
+            error = errnoText(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool Directory::removeChildDirectory(const std::string& name, std::string& error) const {
+        if (unlinkat(fd_, name.c_str(), AT_REMOVEDIR) != 0) {
+            error = errnoText(errno);
+            return false;
+        }
+        return true;
+    }
+
+    unsigned long long Directory::firstPhysical(const std::string& name) const {
+        int fd = openat(fd_, name.c_str(), O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            return 0;
+        }
+        // No FIEMAP_FLAG_SYNC: a file still in delayed allocation has no address yet, and forcing one is a write-back
+        unsigned char storage[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+        struct fiemap* request = reinterpret_cast<struct fiemap*>(storage);
+        request->fm_length = FIEMAP_MAX_OFFSET;
+        request->fm_extent_count = 1;
+        unsigned long long physical = 0;
+        if (ioctl(fd, FS_IOC_FIEMAP, request) == 0 && request->fm_mapped_extents == 1) {
+            const struct fiemap_extent& extent = request->fm_extents[0];
+            if ((extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE)) == 0) {
+                physical = extent.fe_physical;
+            }
+        }
+        close(fd);
+        return physical;
+    }
+
+    size_t budget() {
+        static size_t limit = []() {
+            struct rlimit limits;
+            if (getrlimit(RLIMIT_NOFILE, &limits) != 0) {
+                return static_cast<size_t>(512);
+            }
+            if (limits.rlim_cur < limits.rlim_max) {
+                struct rlimit raised = limits;
+                raised.rlim_cur = limits.rlim_max;
+                if (setrlimit(RLIMIT_NOFILE, &raised) == 0) {
+                    limits = raised;
+                }
+            }
+            rlim_t usable = limits.rlim_cur == RLIM_INFINITY ? 1 << 20 : limits.rlim_cur;
+            return static_cast<size_t>(std::max<rlim_t>(usable / 2, 16));
+        }();
+        return limit;
+    }
+#else
+    std::shared_ptr<Directory> Directory::open(const std::string& path, std::string& error) {
+        std::error_code ec;
+        if (!fs::is_directory(fs::symlink_status(path, ec))) {
+            error = ec ? ec.message() : "not a directory";
+            return nullptr;
+        }
+        return std::shared_ptr<Directory>(new Directory(path, -1, utils::getDeviceId(path)));
+    }
+
+    std::shared_ptr<Directory> Directory::openChild(const std::string& name, std::string& error) const {
+        return open(childPath(name), error);
+    }
+
+    bool Directory::forEach(const std::function<void(const Entry&)>& visit, std::string& error) const {
+        std::error_code ec;
+        fs::directory_iterator it(path_, ec);
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            Entry entry{ name.c_str(), Kind::Other, 0, false, 0, 1 };
+            std::error_code entryError;
+            fs::file_status status = it->symlink_status(entryError);
+            if (!entryError) {
+                entry.kind = kindOf(status);
+            }
+            if (entry.kind == Kind::File) {
+                entry.size = static_cast<unsigned long long>(it->file_size(entryError));
+                entry.sizeKnown = !entryError;
+            }
+            visit(entry);
+        }
+        if (ec) {
+            error = ec.message();
+            return false;
+        }
+        return true;
+    }
+
+    bool Directory::removeEntry(const std::string& name, std::string& error) const {
+        std::error_code ec;
+        if (!fs::remove(childPath(name), ec)) {
+            error = ec ? ec.message() : "not removed";
+            return false;
+        }
+        return true;
+    }
+
+    bool Directory::removeChildDirectory(const std::string& name, std::string& error) const {
+        return removeEntry(name, error);
+    }
+
+    unsigned long long Directory::firstPhysical(const std::string&) const {
+        return 0;
+    }
+
+    size_t budget() {
+        return 512;
+    }
+#endif
+
+    size_t openHandles() {
+        return handles;
+    }
+}
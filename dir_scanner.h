@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+// dir_scanner.h
+// Directory handles for tree walks. On Linux a Directory is an open descriptor: entries come from
+// getdents64 in large batches with their type from d_type, so only regular files (for their size)
+// and entries the filesystem does not type are stat'ed, and every lookup, unlink and child open is
+// relative to the descriptor, with no full path built per entry. Elsewhere the same interface runs
+// on std::filesystem. Handles are shared so work queued for a directory can keep its descriptor.
+namespace dir_scanner {
+    enum class Kind { File, Directory, Symlink, Other };
+
+    struct Entry {
+        const char* name;           // valid during the callback only
+        Kind kind;
+        unsigned long long size;    // files only; 0 when the size could not be read
+        bool sizeKnown;
+        unsigned long long inode;   // 0 when unknown
+        unsigned long links;        // hard links of a file; 1 when unknown
+    };
+
+    class Directory {
+    public:
+        // Empty on failure, with the reason in `error`
+        static std::shared_ptr<Directory> open(const std::string& path, std::string& error);
+        // Opens a subdirectory without following a symlink put in its place since it was listed
+        std::shared_ptr<Directory> openChild(const std::string& name, std::string& error) const;
+        ~Directory();
+        Directory(const Directory&) = delete;
+        Directory& operator=(const Directory&) = delete;
+
+        const std::string& path() const { return path_; }
+        std::string childPath(const std::string& name) const;
+        unsigned long long device() const { return device_; }
+        // The open descriptor on Linux, -1 elsewhere
+        int descriptor() const { return fd_; }
+
+        // Calls `visit` for every entry but . and ..; false when listing stopped on an error.
+        bool forEach(const std::function<void(const Entry&)>& visit, std::string& error) const;
+        // Removes a file or symlink, never what a symlink points to
+        bool removeEntry(const std::string& name, std::string& error) const;
+        bool removeChildDirectory(const std::string& name, std::string& error) const;
+        // Device address of a file's first byte from a one-extent FIEMAP, 0 when unknown (or off Linux)
+        unsigned long long firstPhysical(const std::string& name) const;
+
+    private:
+        Directory(std::string path, int fd, unsigned long long device);
+
+        std::string path_;
+        int fd_;
+        unsigned long long device_;
+    };
+
+    // Directory descriptors open in this process; callers queueing work can stay below budget()
+    size_t openHandles();
+    // Half the descriptor limit, after raising the soft limit to the hard one
+    size_t budget();
+}
@@ -0,0 +1,93 @@
+#include "direct_writer.h"
+#include "utils.h"
+#include <stdexcept>
+
+namespace direct_writer {
+    DirectFile::DirectFile(const std::string& path, size_t depth) : path_(path) {
+        // Any failure of the unbuffered open falls back to the cache; a real error shows up on the buffered one
+        unbuffered_ = volume_utils::openForOverwrite(path, true);
+        buffered_ = volume_utils::openForOverwrite(path, false);
+        if (buffered_ == volume_utils::kInvalidVolume) {
+            std::string error = volume_utils::lastErrorMessage();
+            if (unbuffered_ != volume_utils::kInvalidVolume) {
+                volume_utils::closeVolume(unbuffered_);
+            }
+            throw std::runtime_error("Failed to open file for overwriting: " + path + " (" + error + ")");
+        }
+        direct_ = unbuffered_ != volume_utils::kInvalidVolume;
+        // Page alignment satisfies every logical block size a filesystem accepts for unbuffered I/O
+        alignment_ = direct_ ? utils::kIoAlignment : 1;
+        queue_.reset(new io_queue::WriteQueue(direct_ ? unbuffered_ : buffered_, depth));
+    }
+
+    DirectFile::~DirectFile() {
+        queue_.reset();
+        if (unbuffered_ != volume_utils::kInvalidVolume) {
+            volume_utils::closeVolume(unbuffered_);
+        }
+        volume_utils::closeVolume(buffered_);
+    }
+
+    void DirectFile::submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        if (!direct_) {
+            queue_->submit(buffer, length, offset, tag);
+            cached_ += length;
+            return;
+        }
+        size_t aligned = 0;
+        if (reinterpret_cast<uintptr_t>(buffer) % alignment_ == 0 && offset % alignment_ == 0) {
+            aligned = length / alignment_ * alignment_;
+        }
+        if (aligned < length) {
+            writeBuffered(buffer + aligned, length - aligned, offset + aligned);
+        }
+        if (aligned == 0) {
+            completed_.push_back(tag);
+            return;
+        }
+        queue_->submit(buffer, aligned, offset, tag);
+    }
+
+    uint64_t DirectFile::wait() {
+        if (!completed_.empty()) {
+            uint64_t tag = completed_.front();
+            completed_.pop_front();
+            return tag;
+        }
+        uint64_t tag = queue_->wait();
+        if (cached_ >= kEvictInterval) {
+            evict();
+        }
+        return tag;
+    }
+
+    void DirectFile::sync() {
+        if (direct_ && !volume_utils::flushVolume(unbuffered_)) {
+            throw std::runtime_error("Unable to flush data to disk: " + path_ + " (" + volume_utils::lastErrorMessage() + ")");
+        }
+        evict();
+    }
+
+    void DirectFile::writeBuffered(const unsigned char* buffer, size_t length, uint64_t offset) {
+        if (!volume_utils::writeAt(buffered_, buffer, length, offset)) {
+            throw std::runtime_error("Write failed at offset " + std::to_string(offset) + " (" + volume_utils::lastErrorMessage() + ")");
+        }
+        cached_ += length;
+    }
+
+    void DirectFile::evict() {
+        // Pages still being written are not dropped; they go with the next eviction
+        if (!volume_utils::dropCache(buffered_)) {
+            throw std::runtime_error("Unable to flush data to disk: " + path_ + " (" + volume_utils::lastErrorMessage() + ")");
+        }
+        cached_ = 0;
+    }
+
+    std::string describe(const DirectFile& file) {
+        std::string queue = file.usingUring() ? "io_uring, queue depth " + std::to_string(file.depth()) : std::string("synchronous writes");
+        if (!file.direct()) {
+            return "buffered, dropped from the page cache every " + utils::formatSize(kEvictInterval) + ", " + queue;
+        }
+        return "unbuffered, " + utils::formatSize(file.alignment()) + " aligned, " + queue;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "io_queue.h"
+#include "volume_utils.h"
+#include "write_pipeline.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+// direct_writer.h
+// Overwrites a file without leaving its data in the page cache, so shredding a large file neither
+// evicts the working set of other processes nor piles up dirty pages for write-back to stall on.
+// Aligned writes go through O_DIRECT (FILE_FLAG_NO_BUFFERING on Windows) and io_queue. A piece that
+// is not sector aligned, such as the end of an odd-sized file, is written through a second, buffered
+// handle and evicted once it is durable. On filesystems that refuse O_DIRECT (tmpfs, some FUSE
+// mounts) every write is buffered, and the file's pages are synced and dropped (POSIX_FADV_DONTNEED)
+// after every kEvictInterval bytes.
+namespace direct_writer {
+    const size_t kEvictInterval = 64 * 1024 * 1024;
+
+    class DirectFile : public write_pipeline::AsyncSink {
+    public:
+        // Throws std::runtime_error when the file cannot be opened for writing.
+        DirectFile(const std::string& path, size_t depth = io_queue::kDefaultQueueDepth);
+        ~DirectFile() override;
+        DirectFile(const DirectFile&) = delete;
+        DirectFile& operator=(const DirectFile&) = delete;
+
+        // False when the filesystem refused unbuffered writes and the cache is evicted instead
+        bool direct() const { return direct_; }
+        size_t alignment() const { return alignment_; }
+        bool usingUring() const { return queue_->usingUring(); }
+
+        size_t depth() const override { return queue_->depth(); }
+        // Any length, offset and buffer; whatever is not aligned is written through the cache synchronously.
+        void submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) override;
+        uint64_t wait() override;
+        // Everything written so far is on the media and out of the page cache. Nothing may be in flight.
+        void sync();
+
+    private:
+        void writeBuffered(const unsigned char* buffer, size_t length, uint64_t offset);
+        void evict();
+
+        std::string path_;
+        volume_utils::VolumeHandle unbuffered_ = volume_utils::kInvalidVolume;
+        volume_utils::VolumeHandle buffered_ = volume_utils::kInvalidVolume;
+        std::unique_ptr<io_queue::WriteQueue> queue_;
+        std::deque<uint64_t> completed_;    // tags written synchronously, returned before the queue's
+        bool direct_ = false;
+        size_t alignment_ = 0;
+        unsigned long long cached_ = 0;     // bytes written through the cache since the last eviction
+    };
+
+    std::string describe(const DirectFile& file);
+}
@@ -0,0 +1,228 @@
+#include "extent_map.h"
+#include "utils.h"
+#include <algorithm>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
+namespace extent_map {
+    namespace {
+        // Clips to the apparent size, sorts by offset and joins neighbours that are also contiguous on disk.
+        void normalise(Map& map) {
+            std::vector<Extent> clipped;
+            for (Extent extent : map.extents) {
+                if (extent.offset >= map.apparentSize || extent.length == 0) {
+                    continue;
+                }
+                extent.length = std::min(extent.length, map.apparentSize - extent.offset);
+                clipped.push_back(extent);
+            }
+            std::sort(clipped.begin(), clipped.end(), [](const Extent& a, const Extent& b) { return a.offset < b.offset; });
+
+            map.extents.clear();
+            map.allocatedBytes = 0;
+            for (const Extent& extent : clipped) {
+                if (!map.extents.empty()) {
+                    Extent& last = map.extents.back();
+                    bool adjacent = last.offset + last.length >= extent.offset;
+                    bool sameRun = (last.physical == 0 && extent.physical == 0) ||
+                        (last.physical != 0 && last.physical + (extent.offset - last.offset) == extent.physical);
+                    if (adjacent && sameRun) {
+                        last.length = std::max(last.length, extent.offset + extent.length - last.offset);
+                        continue;
+                    }
+                    if (last.offset + last.length > extent.offset) {
+                        // Overlap without a matching address: keep each byte in one extent only
+                        unsigned long long skip = last.offset + last.length - extent.offset;
+                        if (skip >= extent.length) {
+                            continue;
+                        }
+                        map.extents.push_back({ extent.offset + skip, extent.length - skip, extent.physical ? extent.physical + skip : 0 });
+                        continue;
+                    }
+                }
+                map.extents.push_back(extent);
+            }
+            for (const Extent& extent : map.extents) {
+                map.allocatedBytes += extent.length;
+            }
+        }
+
+#ifdef _WIN32
+        bool allocatedRanges(HANDLE file, Map& map) {
+            FILE_ALLOCATED_RANGE_BUFFER query = {};
+            query.FileOffset.QuadPart = 0;
+            query.Length.QuadPart = static_cast<LONGLONG>(map.apparentSize);
+            std::vector<FILE_ALLOCATED_RANGE_BUFFER> ranges(256);
+            while (true) {
+                DWORD bytesReturned = 0;
+                BOOL ok = DeviceIoControl(file, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), ranges.data(),
+                    static_cast<DWORD>(ranges.size() * sizeof(ranges[0])), &bytesReturned, nullptr);
+                if (!ok && GetLastError() != ERROR_MORE_DATA) {
+                    return false;
+                }
+                size_t count = bytesReturned / sizeof(ranges[0]);
+                for (size_t i = 0; i < count; ++i) {
+                    map.extents.push_back({ static_cast<unsigned long long>(ranges[i].FileOffset.QuadPart),
+                        static_cast<unsigned long long>(ranges[i].Length.QuadPart), 0 });
+                }
+                if (ok || count == 0) {
+                    return true;
+                }
+                // Continue after the last range returned
+                const FILE_ALLOCATED_RANGE_BUFFER& last = ranges[count - 1];
+                LONGLONG next = last.FileOffset.QuadPart + last.Length.QuadPart;
+                query.Length.QuadPart -= next - query.FileOffset.QuadPart;
+                query.FileOffset.QuadPart = next;
+            }
+        }
+#else
+#ifdef __linux__
+        bool fiemap(int fd, Map& map) {
+            const unsigned kBatch = 512;
+            std::vector<unsigned char> storage(sizeof(struct fiemap) + kBatch * sizeof(struct fiemap_extent));
+            struct fiemap* request = reinterpret_cast<struct fiemap*>(storage.data());
+            unsigned long long start = 0;
+            while (start < map.apparentSize) {
+                std::fill(storage.begin(), storage.end(), 0);
+                request->fm_start = start;
+                request->fm_length = FIEMAP_MAX_OFFSET - start;
+                request->fm_flags = FIEMAP_FLAG_SYNC;   // delayed allocations get real extents first
+                request->fm_extent_count = kBatch;
+                if (ioctl(fd, FS_IOC_FIEMAP, request) != 0) {
+                    return false;
+                }
+                if (request->fm_mapped_extents == 0) {
+                    break;
+                }
+                bool last = false;
+                for (unsigned i = 0; i < request->fm_mapped_extents; ++i) {
+                    const struct fiemap_extent& extent = request->fm_extents[i];
+                    // Inline or packed data has no address of its own; it is still overwritten through the file.
+                    bool addressed = (extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE)) == 0;
+                    map.extents.push_back({ extent.fe_logical, extent.fe_length, addressed ? extent.fe_physical : 0 });
+                    start = extent.fe_logical + extent.fe_length;
+                    last = last || (extent.fe_flags & FIEMAP_EXTENT_LAST) != 0;
+                }
+                if (last) {
+                    break;
+                }
+            }
+            map.source = "fiemap";
+            return true;
+        }
+#endif
+
+#ifdef SEEK_DATA
+        bool seekData(int fd, Map& map) {
+            off_t position = 0;
+            const off_t end = static_cast<off_t>(map.apparentSize);
+            while (position < end) {
+                off_t data = lseek(fd, position, SEEK_DATA);
+                if (data < 0) {
+                    if (errno == ENXIO) {
+                        break;  // only a hole remains
+                    }
+                    map.extents.clear();
+                    return false;
+                }
+                off_t hole = lseek(fd, data, SEEK_HOLE);
+                if (hole < 0) {
+                    hole = end;
+                }
+                map.extents.push_back({ static_cast<unsigned long long>(data), static_cast<unsigned long long>(hole - data), 0 });
+                position = hole;
+            }
+            map.source = "seek";
+            return true;
+        }
+#endif
+#endif
+    }
+
+    Map build(const std::string& path, unsigned long long apparentSize) {
+        Map map;
+        map.apparentSize = apparentSize;
+        if (apparentSize == 0) {
+            return wholeFile(0);
+        }
+#ifdef _WIN32
+        HANDLE file = CreateFileW(utils::stringToWString(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return wholeFile(apparentSize);
+        }
+        // Only sparse files report holes; everything else is allocated end to end.
+        BY_HANDLE_FILE_INFORMATION info = {};
+        bool mapped = GetFileInformationByHandle(file, &info) && (info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) != 0 &&
+            allocatedRanges(file, map);
+        CloseHandle(file);
+        if (!mapped) {
+            return wholeFile(apparentSize);
+        }
+        map.source = "allocated-ranges";
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return wholeFile(apparentSize);
+        }
+        bool mapped = false;
+#ifdef __linux__
+        mapped = fiemap(fd, map);
+        if (!mapped) {
+            map.extents.clear();
+        }
+#endif
+#ifdef SEEK_DATA
+        if (!mapped) {
+            mapped = seekData(fd, map);
+        }
+#endif
+        close(fd);
+        if (!mapped) {
+            return wholeFile(apparentSize);
+        }
+#endif
+        normalise(map);
+        return map;
+    }
+
+    Map wholeFile(unsigned long long apparentSize) {
+        Map map;
+        map.apparentSize = apparentSize;
+        map.source = "whole file";
+        if (apparentSize > 0) {
+            map.extents.push_back({ 0, apparentSize, 0 });
+        }
+        map.allocatedBytes = apparentSize;
+        return map;
+    }
+
+    void sortPhysical(Map& map) {
+        std::stable_sort(map.extents.begin(), map.extents.end(), [](const Extent& a, const Extent& b) {
+            if ((a.physical == 0) != (b.physical == 0)) {
+                return a.physical != 0;
+            }
+            return a.physical < b.physical;
+        });
+    }
+
+    std::string describe(const Map& map) {
+        std::ostringstream out;
+        out << utils::formatSize(map.allocatedBytes) << " allocated of " << utils::formatSize(map.apparentSize) << " apparent in "
+            << map.extents.size() << (map.extents.size() == 1 ? " extent" : " extents") << " (" << map.source << ")";
+        return out.str();
+    }
+}
@@ -1,373 +1,852 @@
-#include "file_shredder.h"
-#include "utils.h"
-#include "volume_utils.h"
-#include <filesystem>
-#include <fstream>
-#include <iostream>
-#include <chrono>
-#include <thread>
-using namespace std;
-
-namespace fs = std::filesystem;
-using namespace std::chrono;
-
-namespace file_shredder {
-    void overwriteFile(const string& filepath, size_t passes, const std::vector<unsigned char>& customPattern) {
-        if (!fs::exists(filepath)) {
-            throw runtime_error("File does not exist: " + filepath);
-        }
-        utils::logMessage("Starting to overwrite file: " + filepath + " with " + std::to_string(passes) + " passes.");
-
-        auto filesize = fs::file_size(filepath);
-        size_t buffersize = utils::determineBufferSize();
-        vector<unsigned char> buffer = utils::generateRandomBuffer(buffersize);
-
-        ofstream file(filepath, ios::binary | ios::in);
-        if (!file.is_open()) {
-            throw runtime_error("Failed to open file for overwriting: " + filepath);
-        }
-
-        cout << "Using a buffer size of " << (buffersize / (1024 * 1024)) << " MB.\n";
-        cout << "Overwriting file with random patterns (" << passes << " passes)...\n";
-
-        for (size_t pass = 1; pass <= passes; ++pass) {
-            cout << "Pass " << pass << "/" << passes << " in progress...\n";
-            utils::logMessage("Pass " + std::to_string(pass) + " of " + std::to_string(passes) + " started.");
-            auto start = high_resolution_clock::now();
-            ULONGLONG totalBytesWritten = 0;
-
-            // Check and fill the buffer accordingly
-            if (!customPattern.empty()) {
-                // Fill the buffer with the custom pattern, repeat the pattern if it's shorter than the buffer size
-                size_t patternIndex = 0;
-                for (size_t i = 0; i < buffer.size(); ++i) {
-                    buffer[i] = customPattern[patternIndex];
-                    patternIndex = (patternIndex + 1) % customPattern.size(); // Cycle through the custom pattern
-                }
-            }
-            else {
-                // Use the existing logic to fill the buffer
-                if (pass % 2 == 0) {
-                    buffer = utils::generateRandomBuffer(buffersize); // Generate a random buffer
-                }
-                else {
-                    fill(buffer.begin(), buffer.end(), static_cast<unsigned char>(0xFF)); // Fill with 0xFF
-                }
-            }
-
-            // Writing the buffer to the file
-            for (size_t offset = 0; offset < filesize; offset += buffersize) {
-                size_t writesize = min(buffersize, filesize - offset);
-                file.write(reinterpret_cast<const char*>(buffer.data()), writesize);
-                totalBytesWritten += writesize;
-                auto now = high_resolution_clock::now();
-                double elapsed = duration<double>(now - start).count();
-                double eta = (totalBytesWritten > 0) ? (elapsed / totalBytesWritten) * (filesize - totalBytesWritten) : 0.0;
-
-                utils::displayProgressBar(totalBytesWritten, filesize, elapsed, eta);
-            }
-            file.flush();
-            cout << "\nPass " << pass << " completed.\n";
-            utils::logMessage("Pass " + std::to_string(pass) + " of " + std::to_string(passes) + " completed.");
-        }
-
-        cout << "Final pass: overwriting with zeros...\n";
-        utils::logMessage("Final pass: Overwriting " + filepath + " with zeros started.");
-        auto start = high_resolution_clock::now();
-        ULONGLONG totalBytesWritten = 0;
-
-        for (size_t offset = 0; offset < filesize; offset += buffersize) {
-            size_t writesize = min(buffersize, filesize - offset);
-            fill(buffer.begin(), buffer.begin() + writesize, 0);
-            file.write(reinterpret_cast<const char*>(buffer.data()), writesize);
-
-            totalBytesWritten += writesize;
-            auto now = high_resolution_clock::now();
-            double elapsed = duration<double>(now - start).count();
-            double eta = (totalBytesWritten > 0) ? (elapsed / totalBytesWritten) * (filesize - totalBytesWritten) : 0.0;
-
-            utils::displayProgressBar(totalBytesWritten, filesize, elapsed, eta);
-        }
-        file.flush();
-        cout << "\nFinal pass completed.\n";
-        utils::logMessage("Final pass of overwriting " + filepath + " completed.");
-        file.close();
-        cout << "File successfully overwritten.\n";
-        utils::logMessage("File overwrite completed successfully for: " + filepath);
-    }
-
-    void securelyDelete(const std::string& filepath, size_t passes, const std::vector<unsigned char>& customPattern) {
-        try {
-            std::cout << "Preparing to securely delete: " << filepath << std::endl;
-            utils::logMessage("Preparing to securely delete file: " + filepath);
-            overwriteFile(filepath, passes, customPattern);
-
-            std::string newPath = filepath + "." + utils::generateRandomString(10);
-            fs::rename(filepath, newPath);
-            utils::logMessage("File renamed for secure deletion: " + filepath + " to " + newPath);
-
-            std::ofstream file(newPath, std::ios::binary | std::ios::trunc);
-            file.close();
-
-            std::cout << "Deleting the file...\n";
-            if (fs::remove(newPath)) {
-                std::cout << "File securely deleted: " << filepath << std::endl;
-                utils::logMessage("File securely deleted: " + filepath);
-            }
-            else {
-                throw std::runtime_error("Failed to delete file: " + newPath);
-            }
-        }
-        catch (const std::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
-            utils::logMessage("Failed to securely delete file: " + filepath + "; Error: " + e.what());
-        }
-    }
-
-    void shredFolder(const std::string& folderPath, size_t passes, const std::vector<unsigned char>& customPattern) {
-        if (!fs::exists(folderPath) || !fs::is_directory(folderPath)) {
-            std::cerr << "Error: Folder does not exist or is not a directory: " << folderPath << std::endl;
-            return;
-        }
-
-        utils::logMessage("Starting to shred folder: " + folderPath);
-
-        for (const auto& entry : fs::directory_iterator(folderPath)) {
-            if (fs::is_directory(entry.path())) {
-                shredFolder(entry.path().string(), passes, customPattern);
-            }
-            else if (fs::is_regular_file(entry.path())) {
-                securelyDelete(entry.path().string(), passes, customPattern);
-            }
-        }
-
-        try {
-            fs::remove(folderPath);
-            std::cout << "Folder securely shredded: " << folderPath << std::endl;
-            utils::logMessage("Folder shredding completed successfully: " + folderPath);
-        }
-        catch (const std::exception& e) {
-            std::cerr << "Error removing folder: " << folderPath << " - " << e.what() << std::endl;
-            utils::logMessage("Folder shredding failed: " + folderPath + " with error: " + e.what());
-        }
-    }
-
-    bool shredPartition(const std::string& partitionPath, size_t passes, const std::vector<unsigned char>& customPattern) {
-        if (!utils::isAdmin()) {
-            std::cerr << "Error: Administrative privileges required." << std::endl;
-            return false;
-        }
-
-        std::wstring widePartitionPath = utils::stringToWString(partitionPath);
-
-        // For GetVolumeInformation, we need a path with trailing backslash
-        std::wstring volumeInfoPath = widePartitionPath;
-        if (volumeInfoPath.back() != L'\\') {
-            volumeInfoPath += L'\\';
-        }
-
-        // Check if partition is formatted by attempting to get volume information
-        wchar_t volumeName[MAX_PATH + 1] = { 0 };
-        wchar_t fileSystemName[MAX_PATH + 1] = { 0 };
-        DWORD serialNumber = 0;
-        DWORD maxComponentLen = 0;
-        DWORD fileSystemFlags = 0;
-
-        if (!GetVolumeInformationW(
-            volumeInfoPath.c_str(),
-            volumeName,
-            MAX_PATH + 1,
-            &serialNumber,
-            &maxComponentLen,
-            &fileSystemFlags,
-            fileSystemName,
-            MAX_PATH + 1
-        )) {
-            std::cerr << "Error: Cannot shred unformatted partition: " << partitionPath << std::endl
-                << "Partition must be formatted with a valid file system." << std::endl;
-            return false;
-        }
-
-        if (wcslen(fileSystemName) == 0) {
-            std::cerr << "Error: No valid file system found on partition: " << partitionPath << std::endl;
-            return false;
-        }
-
-        // For CreateFile, we need the original path format without trailing backslash
-        std::cout << "Attempting to lock and dismount volume..." << std::endl;
-        utils::logMessage("Starting to shred partition: " + partitionPath);
-        HANDLE hVolume = volume_utils::lockVolume(widePartitionPath);
-
-        if (hVolume == INVALID_HANDLE_VALUE) {
-            std::cerr << "Error: Unable to lock volume. Error code: " << GetLastError() << std::endl
-                << "Make sure the volume is not in use and you have administrative privileges." << std::endl;
-            return false;
-        }
-
-        if (!volume_utils::dismountVolume(hVolume)) {
-            std::cerr << "Error: Failed to dismount volume. Error code: " << GetLastError() << std::endl;
-            CloseHandle(hVolume);
-            return false;
-        }
-
-        ULONGLONG volumeSize = volume_utils::getVolumeSize(hVolume);
-        if (volumeSize == 0) {
-            std::cerr << "Error: Unable to determine volume size. Error code: " << GetLastError() << std::endl;
-            CloseHandle(hVolume);
-            return false;
-        }
-
-        const size_t bufferSize = utils::determineBufferSize();
-        std::vector<char> buffer(bufferSize);
-        std::cout << "Shredding partition: " << partitionPath << std::endl;
-
-        cout << "Using a buffer size of " << (bufferSize / (1024 * 1024)) << " MB.\n";
-
-        std::cout << "Volume size: " << utils::formatSize(volumeSize) << std::endl;
-
-        try {
-            // Perform the specified number of passes with random data
-            for (int pass = 1; pass <= passes; ++pass) {
-                std::cout << "Pass " << pass << "/" << passes << " in progress..." << std::endl;
-
-                if (!customPattern.empty()) {
-                    // Use the custom pattern to fill the buffer, repeating it if necessary
-                    size_t patternIndex = 0;
-                    for (size_t i = 0; i < buffer.size(); ++i) {
-                        buffer[i] = customPattern[patternIndex];
-                        patternIndex = (patternIndex + 1) % customPattern.size();  // Wrap around the custom pattern
-                    }
-                }
-                else {
-                    // Fill the buffer with random data
-                    for (size_t i = 0; i < buffer.size(); ++i) {
-                        buffer[i] = static_cast<char>(std::rand() % 256);
-                    }
-                }
-
-                LARGE_INTEGER offset = { 0 };
-                SetFilePointerEx(hVolume, offset, nullptr, FILE_BEGIN);
-                DWORD bytesWritten = 0;
-                ULONGLONG totalBytesWritten = 0;
-
-                auto start = std::chrono::high_resolution_clock::now();
-                auto lastUpdate = start;
-
-                while (totalBytesWritten < volumeSize) {
-                    size_t writeSize = static_cast<size_t>(
-                        std::min<ULONGLONG>(buffer.size(), volumeSize - totalBytesWritten));
-
-                    if (!WriteFile(hVolume, buffer.data(), static_cast<DWORD>(writeSize), &bytesWritten, nullptr)) {
-                        DWORD error = GetLastError();
-                        throw std::runtime_error("Write failed at offset " + std::to_string(offset.QuadPart) +
-                            " (Error Code: " + std::to_string(error) + ")");
-                    }
-
-                    if (bytesWritten == 0) {
-                        break;
-                    }
-
-                    totalBytesWritten += bytesWritten;
-                    offset.QuadPart += bytesWritten;
-
-                    // Update progress bar after 10 MB or 1 second
-                    auto now = std::chrono::high_resolution_clock::now();
-                    double elapsed = std::chrono::duration<double>(now - start).count();
-                    double timeSinceLastUpdate = std::chrono::duration<double>(now - lastUpdate).count();
-
-                    if (totalBytesWritten % (10 * 1024 * 1024) == 0 || timeSinceLastUpdate >= 1.0) {
-                        double eta = (totalBytesWritten > 0)
-                            ? (elapsed / totalBytesWritten) * (volumeSize - totalBytesWritten)
-                            : 0.0;
-
-                        std::cout << "\r";
-                        utils::displayProgressBar(totalBytesWritten, volumeSize, elapsed, eta);
-                        lastUpdate = now;
-                    }
-                }
-
-                std::cout << "\r";
-                utils::displayProgressBar(volumeSize, volumeSize,
-                    std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count(),
-                    0.0);
-                std::cout << std::endl;
-
-                if (!FlushFileBuffers(hVolume)) {
-                    throw std::runtime_error("Unable to flush data to disk (Error Code: " +
-                        std::to_string(GetLastError()) + ")");
-                }
-
-                std::cout << "Pass " << pass << " completed." << std::endl;
-                utils::logMessage("Pass " + std::to_string(pass) + " of " + std::to_string(passes) + " completed on partition: " + partitionPath);
-            }
-
-            // Final overwrite with zeroes
-            std::cout << "Final pass: Overwriting with zeros..." << std::endl;
-            std::fill(buffer.begin(), buffer.end(), 0);
-
-            LARGE_INTEGER offset = { 0 };
-            SetFilePointerEx(hVolume, offset, nullptr, FILE_BEGIN);
-            DWORD bytesWritten = 0;
-            ULONGLONG totalBytesWritten = 0;
-
-            auto start = std::chrono::high_resolution_clock::now();
-            auto lastUpdate = start;
-
-            while (totalBytesWritten < volumeSize) {
-                size_t writeSize = static_cast<size_t>(
-                    std::min<ULONGLONG>(buffer.size(), volumeSize - totalBytesWritten));
-                if (!WriteFile(hVolume, buffer.data(), static_cast<DWORD>(writeSize), &bytesWritten, nullptr)) {
-                    DWORD error = GetLastError();
-                    throw std::runtime_error("Write failed at offset " + std::to_string(offset.QuadPart) +
-                        " (Error Code: " + std::to_string(error) + ")");
-                }
-
-                if (bytesWritten == 0) {
-                    break;
-                }
-
-                totalBytesWritten += bytesWritten;
-                offset.QuadPart += bytesWritten;
-
-                // Update progress bar after 10 MB or 1 second
-                auto now = std::chrono::high_resolution_clock::now();
-                double elapsed = std::chrono::duration<double>(now - start).count();
-                double timeSinceLastUpdate = std::chrono::duration<double>(now - lastUpdate).count();
-
-                if (totalBytesWritten % (10 * 1024 * 1024) == 0 || timeSinceLastUpdate >= 1.0) {
-                    double eta = (totalBytesWritten > 0)
-                        ? (elapsed / totalBytesWritten) * (volumeSize - totalBytesWritten)
-                        : 0.0;
-
-                    std::cout << "\r";
-                    utils::displayProgressBar(totalBytesWritten, volumeSize, elapsed, eta);
-                    lastUpdate = now;
-                }
-            }
-
-            std::cout << "\r";
-            utils::displayProgressBar(volumeSize, volumeSize,
-                std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count(),
-                0.0);
-            std::cout << std::endl;
-
-            if (!FlushFileBuffers(hVolume)) {
-                throw std::runtime_error("Unable to flush data to disk (Error Code: " +
-                    std::to_string(GetLastError()) + ")");
-            }
-
-            std::cout << "Final pass completed." << std::endl;
-        }
-        catch (const std::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
-            utils::logMessage("Partition shredding failed: " + partitionPath + " with error: " + e.what());
-            CloseHandle(hVolume);
-            return false;
-        }
-
-        std::cout << "Partition " << partitionPath << " shredded successfully." << std::endl;
-        utils::logMessage("Partition shredding completed successfully: " + partitionPath);
-        CloseHandle(hVolume);
-        return true;
-    }
-}
+#include "file_shredder.h"
+#include "utils.h"
+#include "logger.h"
+#include "progress.h"
+#include "buffer_pool.h"
+#include "volume_utils.h"
+#include "folder_shredder.h"
+#include "free_space_wiper.h"
+#include "random_engine.h"
+#include "write_pipeline.h"
+#include "io_queue.h"
+#include "io_tuning.h"
+#include "block_offload.h"
+#include "verifier.h"
+#include "extent_map.h"
+#include "checkpoint.h"
+#include "mmap_writer.h"
+#include "direct_writer.h"
+#include "io_qos.h"
+#include "metrics.h"
+#include "schemes.h"
+#include "sim_device.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <optional>
+#include <functional>
+#include <map>
+#include <deque>
+#include <numeric>
+using namespace std;
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+
+namespace file_shredder {
+    namespace {
+        // Accounts one target in the progress totals. Whatever was not written by the time it goes
+        // out of scope (a failed pass, an exception) is taken back out of the expected bytes.
+        class TargetProgress {
+        public:
+            TargetProgress(progress::Device* device, unsigned long long expected, bool announced, bool countFile)
+                : device_(device), expected_(expected), countFile_(countFile && !announced) {
+                if (!announced) {
+                    progress::addExpected(device_, expected_);
+                }
+                if (countFile_) {
+                    progress::fileQueued();
+                }
+            }
+
+            ~TargetProgress() {
+                if (written_ < expected_) {
+                    progress::removeExpected(device_, expected_ - written_);
+                }
+                if (countFile_) {
+                    progress::fileDone();
+                }
+            }
+
+            void add(unsigned long long bytes) {
+                written_ += bytes;
+                progress::addBytes(device_, bytes);
+            }
+
+            // Adapts the pipeline's running total to per-chunk increments
+            write_pipeline::ProgressFn pipelineCallback() {
+                return [this, last = 0ull](uint64_t total) mutable {
+                    add(total - last);
+                    last = total;
+                };
+            }
+
+        private:
+            progress::Device* device_;
+            unsigned long long expected_;
+            unsigned long long written_ = 0;
+            bool countFile_;
+        };
+
+        // Writes buffer[offset % bufferSize] across [begin, end), keeping the sink full.
+        void writeRepeated(write_pipeline::AsyncSink& sink, const unsigned char* buffer, size_t bufferSize,
+            unsigned long long begin, unsigned long long end, TargetProgress& progress) {
+            size_t inFlight = 0;
+            for (unsigned long long offset = begin; offset < end;) {
+                if (inFlight >= sink.depth()) {
+                    progress.add(sink.wait());
+                    inFlight--;
+                }
+                size_t phase = static_cast<size_t>(offset % bufferSize);
+                size_t length = static_cast<size_t>(std::min<unsigned long long>(bufferSize - phase, end - offset));
+                sink.submit(buffer + phase, length, offset, length); // the tag carries the byte count
+                inFlight++;
+                offset += length;
+            }
+            for (; inFlight > 0; inFlight--) {
+                progress.add(sink.wait());
+            }
+        }
+
+        // Moves a pipeline run that starts at `base` onto the sink's absolute offsets
+        class OffsetSink : public write_pipeline::AsyncSink {
+        public:
+            OffsetSink(write_pipeline::AsyncSink& sink, unsigned long long base) : sink_(sink), base_(base) {}
+            size_t depth() const override { return sink_.depth(); }
+            void submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+                sink_.submit(buffer, length, base_ + offset, tag);
+            }
+            uint64_t wait() override { return sink_.wait(); }
+
+        private:
+            write_pipeline::AsyncSink& sink_;
+            unsigned long long base_;
+        };
+
+        // Writes one pass over [start, total) in segments. With a journal, the end of a segment is made
+        // durable and recorded whenever the checkpoint interval has passed, so an interruption loses at
+        // most about one interval of work. Segments end on multiples of `segment`.
+        void runPass(checkpoint::Journal* journal, size_t pass, unsigned long long start, unsigned long long total,
+            unsigned long long segment, const std::function<void(unsigned long long, unsigned long long)>& write,
+            const std::function<void()>& sync) {
+            if (journal == nullptr) {
+                write(start, total);
+                return;
+            }
+            for (unsigned long long begin = start; begin < total;) {
+                unsigned long long end = std::min(total, (begin / segment + 1) * segment);
+                write(begin, end);
+                if (end < total && journal->due()) {
+                    sync();
+                    journal->record(pass, end);
+                }
+                begin = end;
+            }
+        }
+
+        const unsigned long long kHashBasis = 1469598103934665603ULL;
+
+        // FNV-1a over `size` bytes, continuing from `hash`
+        unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        // What a journal must match before a run may resume from it. Random passes depend only on the
+        // journal's seed; pattern passes also on the block period the pattern restarts at.
+        std::string schemeOf(schemes::Id scheme, size_t passes, const std::vector<unsigned char>& customPattern, size_t period, unsigned long long length) {
+            std::string text = std::string("scheme=") + schemes::info(scheme).name + " passes=" + std::to_string(passes) +
+                " bytes=" + std::to_string(length) + " period=" + std::to_string(period);
+            if (customPattern.empty()) {
+                return text + " pattern=none";
+            }
+            return text + " pattern=" + std::to_string(hashBytes(kHashBasis, customPattern.data(), customPattern.size()));
+        }
+
+        // A file's journal offset counts bytes along its extents in the order they are written, physical
+        // order on rotational disks. The logical ranges in that order are part of what a journal must
+        // match, so a layout changed by copy-on-write or defragmentation restarts the pass from zero.
+        std::string layoutOf(const std::vector<extent_map::Extent>& extents) {
+            unsigned long long hash = kHashBasis;
+            for (const extent_map::Extent& extent : extents) {
+                hash = hashBytes(hash, &extent.offset, sizeof(extent.offset));
+                hash = hashBytes(hash, &extent.length, sizeof(extent.length));
+            }
+            return " layout=" + std::to_string(hash);
+        }
+
+        // Past this common multiple of pattern length and alignment (long custom patterns) a pattern restarts at every block
+        const size_t kMaxPatternPeriod = 64 * 1024 * 1024;
+
+        // Bytes after which a pass block repeats. A 3-byte Gutmann pattern in a power-of-two block would jump
+        // phase at every block boundary, so the period is the largest multiple of both the pattern length and
+        // `alignment` (which keeps unbuffered writes whole sectors) that fits in `size`, or one such multiple
+        // when `size` is smaller.
+        size_t patternPeriod(size_t patternLength, size_t size, size_t alignment) {
+            const size_t common = std::lcm(std::max<size_t>(patternLength, 1), std::max<size_t>(alignment, 1));
+            if (size % patternLength == 0 || common > kMaxPatternPeriod) {
+                return size;
+            }
+            return size >= common ? size - size % common : common;
+        }
+
+        // The shared read-only block behind a constant, pattern or custom pass, and the period it repeats at
+        std::shared_ptr<const unsigned char> passBlock(const schemes::Pass& pass, const std::vector<unsigned char>& customPattern,
+            size_t size, size_t alignment, size_t& period) {
+            const std::vector<unsigned char> pattern = pass.kind == schemes::PassKind::Custom ? customPattern : pass.pattern();
+            period = patternPeriod(pattern.size(), size, alignment);
+            return buffer_pool::patternBlock(pattern, period);
+        }
+
+        std::string passLabel(size_t pass, const std::vector<schemes::Pass>& sequence) {
+            return "Pass " + std::to_string(pass) + "/" + std::to_string(sequence.size()) + " (" + schemes::describe(sequence[pass - 1]) + ")";
+        }
+
+        // The extents of a file laid end to end, so one pipeline run covers all of them.
+        class ExtentRun {
+        public:
+            explicit ExtentRun(const std::vector<extent_map::Extent>& extents) : extents_(extents) {
+                unsigned long long position = 0;
+                for (const extent_map::Extent& extent : extents_) {
+                    starts_.push_back(position);
+                    position += extent.length;
+                }
+            }
+
+            // Calls fn(fileOffset, offsetInSpan, length) for each piece of [position, position + length).
+            template <typename Fn>
+            void forEach(unsigned long long position, size_t length, Fn&& fn) const {
+                size_t index = static_cast<size_t>(std::upper_bound(starts_.begin(), starts_.end(), position) - starts_.begin()) - 1;
+                size_t done = 0;
+                while (done < length && index < extents_.size()) {
+                    unsigned long long within = position + done - starts_[index];
+                    size_t piece = static_cast<size_t>(std::min<unsigned long long>(length - done, extents_[index].length - within));
+                    fn(extents_[index].offset + within, done, piece);
+                    done += piece;
+                    index++;
+                }
+            }
+
+        private:
+            const std::vector<extent_map::Extent>& extents_;
+            std::vector<unsigned long long> starts_;
+        };
+
+        // Lays a pipeline run that starts at `base` of an extent run onto the file. A chunk that spans
+        // several extents goes out as several writes and completes once all of them have.
+        class ExtentSink : public write_pipeline::AsyncSink {
+        public:
+            ExtentSink(write_pipeline::AsyncSink& sink, const ExtentRun& run, unsigned long long base) : sink_(sink), run_(run), base_(base) {}
+            size_t depth() const override { return sink_.depth(); }
+            void submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+                size_t pieces = 0;
+                run_.forEach(base_ + offset, length, [&](unsigned long long, size_t, size_t) { pieces++; });
+                remaining_[tag] = pieces;
+                run_.forEach(base_ + offset, length, [&](unsigned long long fileOffset, size_t at, size_t piece) {
+                    while (inFlight_ >= sink_.depth()) {
+                        collect();
+                    }
+                    sink_.submit(buffer + at, piece, fileOffset, tag);
+                    inFlight_++;
+                });
+            }
+            uint64_t wait() override {
+                while (finished_.empty()) {
+                    collect();
+                }
+                uint64_t tag = finished_.front();
+                finished_.pop_front();
+                return tag;
+            }
+
+        private:
+            void collect() {
+                uint64_t tag = sink_.wait();
+                inFlight_--;
+                if (--remaining_[tag] == 0) {
+                    remaining_.erase(tag);
+                    finished_.push_back(tag);
+                }
+            }
+
+            write_pipeline::AsyncSink& sink_;
+            const ExtentRun& run_;
+            unsigned long long base_;
+            size_t inFlight_ = 0;
+            std::map<uint64_t, size_t> remaining_;
+            std::deque<uint64_t> finished_;
+        };
+
+        // Calls fn(fileOffset, length) for the file ranges behind [begin, end) of the run, at most `step` bytes at a time.
+        template <typename Fn>
+        void forEachSpan(const ExtentRun& run, unsigned long long begin, unsigned long long end, size_t step, Fn&& fn) {
+            for (unsigned long long position = begin; position < end; position += step) {
+                run.forEach(position, static_cast<size_t>(std::min<unsigned long long>(step, end - position)),
+                    [&](unsigned long long start, size_t, size_t span) { fn(start, span); });
+            }
+        }
+
+        // Writes block[offset % period] over [begin, end) of the run, so the content depends only on the file offset.
+        void writeBlock(std::ofstream& file, const unsigned char* block, size_t period, const ExtentRun& run,
+            unsigned long long begin, unsigned long long end, TargetProgress& progress) {
+            forEachSpan(run, begin, end, 1ULL << 30, [&](unsigned long long start, size_t span) {
+                file.seekp(static_cast<std::streamoff>(start));
+                for (unsigned long long offset = start; offset < start + span;) {
+                    size_t phase = static_cast<size_t>(offset % period);
+                    size_t length = static_cast<size_t>(std::min<unsigned long long>(period - phase, start + span - offset));
+                    io_qos::Write admitted(length);
+                    metrics::Scoped timed(metrics::Timer::Write, length);
+                    if (!file.write(reinterpret_cast<const char*>(block + phase), length)) {
+                        throw std::runtime_error("Write failed while overwriting");
+                    }
+                    progress.add(length);
+                    offset += length;
+                }
+            });
+        }
+
+        bool shouldVerify(const verifier::Options& options, bool finalPass) {
+            return options.mode != verifier::Mode::Off && (finalPass || options.everyPass);
+        }
+
+        // Logs the outcome of a read-back and throws when the target does not hold what was written.
+        void checkVerification(const verifier::Result& result, const std::string& target, size_t pass, bool quiet) {
+            std::string summary = "Verification of pass " + std::to_string(pass) + ": " + verifier::describe(result);
+            if (!quiet) {
+                progress::note(summary);
+            }
+            if (!result.passed()) {
+                logger::error(summary, { target, pass, result.bytesMismatched, result.seconds });
+                throw runtime_error(summary);
+            }
+            logger::info("Verification passed", { target, pass, result.bytesChecked, result.seconds });
+        }
+    }
+
+    bool parseEngine(const std::string& text, WriteEngine& engine) {
+        if (text == "stream") {
+            engine = WriteEngine::Stream;
+        }
+        else if (text == "mmap") {
+            engine = WriteEngine::Mmap;
+        }
+        else if (text == "direct") {
+            engine = WriteEngine::Direct;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* engineName(WriteEngine engine) {
+        switch (engine) {
+        case WriteEngine::Mmap: return "mmap";
+        case WriteEngine::Direct: return "direct";
+        default: return "stream";
+        }
+    }
+
+    void overwriteFile(const string& filepath, size_t passes, const std::vector<unsigned char>& customPattern, const ShredOptions& options) {
+        if (!fs::exists(filepath)) {
+            throw runtime_error("File does not exist: " + filepath);
+        }
+
+        // Shares cout's buffer, or discards everything when running quietly
+        ostream out(options.quiet ? nullptr : cout.rdbuf());
+        auto filesize = fs::file_size(filepath);
+        logger::info("Starting to overwrite file with " + std::to_string(passes) + " passes", { filepath, {}, filesize });
+        unsigned long long deviceId = utils::getDeviceId(filepath);
+
+        // Only allocated extents are overwritten; holes read back as zeros and are never materialised.
+        extent_map::Map extents = options.mapExtents ? extent_map::build(filepath, filesize) : extent_map::wholeFile(filesize);
+        unsigned long long leadingExtent = !extents.extents.empty() && extents.extents.front().offset == 0 ? extents.extents.front().length : 0;
+        if (io_tuning::probeDevice(deviceId).rotational) {
+            extent_map::sortPhysical(extents);
+        }
+        const unsigned long long allocated = extents.allocatedBytes;
+        const ExtentRun run(extents.extents);
+
+        std::optional<progress::Session> session;
+        if (!options.quiet) {
+            session.emplace();
+        }
+        // Calibration writes from offset 0, so it is confined to the leading extent
+        io_tuning::Plan plan = options.calibrate ? io_tuning::calibrate(filepath, leadingExtent)
+            : io_tuning::tune(deviceId, allocated);
+        if (options.chunkSize != 0) {
+            plan.chunkSize = options.chunkSize;
+        }
+        size_t buffersize = plan.chunkSize;
+        size_t blockSize = static_cast<size_t>(min<uintmax_t>(buffersize, filesize));
+
+        const schemes::Id scheme = schemes::resolve(options.scheme, schemes::Id::Classic);
+        const std::vector<schemes::Pass> sequence = schemes::expand(scheme, passes, !customPattern.empty());
+        const size_t total = sequence.size();
+
+        std::optional<checkpoint::Journal> journal;
+        if (options.checkpoint.enabled) {
+            journal.emplace(options.checkpoint, filepath, schemeOf(scheme, passes, customPattern, blockSize, allocated) + layoutOf(extents.extents));
+        }
+        const size_t firstPass = journal ? journal->pass() : 1;
+        const unsigned long long firstOffset = journal ? journal->offset() : 0;
+        const unsigned long long done = (firstPass - 1) * allocated + firstOffset;
+        TargetProgress tracker(progress::device(deviceId), allocated * total - std::min(done, allocated * total), options.announced, true);
+
+        ofstream file(filepath, ios::binary | ios::in);
+        if (!file.is_open()) {
+            throw runtime_error("Failed to open file for overwriting: " + filepath);
+        }
+        // The mmap engine writes through windows of a shared mapping; the stream stays open but unused
+        std::optional<mmap_writer::MappedFile> mapped;
+        if (options.engine == WriteEngine::Mmap) {
+            mapped.emplace(filepath, options.mmapWindow != 0 ? options.mmapWindow : mmap_writer::kDefaultWindowSize);
+        }
+        // The direct engine bypasses the page cache through handles of its own
+        std::optional<direct_writer::DirectFile> direct;
+        if (options.engine == WriteEngine::Direct) {
+            direct.emplace(filepath, options.queueDepth != 0 ? options.queueDepth : plan.queueDepth);
+        }
+        auto syncFile = [&]() {
+            if (mapped) {
+                mapped->sync();
+                return;
+            }
+            if (direct) {
+                direct->sync();
+                return;
+            }
+            file.flush();
+            if (!file || !volume_utils::syncFile(filepath)) {
+                throw runtime_error("Unable to flush data to disk: " + filepath);
+            }
+        };
+        // Writes block[offset % period] over [begin, end) of the run through the selected engine
+        auto writePattern = [&](const unsigned char* block, size_t period, unsigned long long begin, unsigned long long end) {
+            if (direct) {
+                forEachSpan(run, begin, end, 1ULL << 30, [&](unsigned long long start, size_t span) {
+                    writeRepeated(*direct, block, period, start, start + span, tracker);
+                });
+                return;
+            }
+            if (!mapped) {
+                writeBlock(file, block, period, run, begin, end, tracker);
+                return;
+            }
+            forEachSpan(run, begin, end, plan.chunkSize, [&](unsigned long long start, size_t span) {
+                io_qos::admit(span);
+                mapped->writePattern(start, span, block, period);
+                tracker.add(span);
+            });
+        };
+
+        out << "Extent map: " << extent_map::describe(extents) << ".\n";
+        logger::info("Extent map: " + extent_map::describe(extents), { filepath, {}, allocated });
+        out << "I/O plan: " << io_tuning::describe(plan) << ".\n";
+        if (mapped) {
+            out << "Write engine: mmap (" << mmap_writer::kernelName() << ", " << utils::formatSize(mapped->windowSize()) << " windows).\n";
+        }
+        if (direct) {
+            out << "Write engine: direct (" << direct_writer::describe(*direct) << ").\n";
+            if (!direct->direct()) {
+                out << "The filesystem refused unbuffered I/O; written pages are dropped from the cache instead.\n";
+                logger::warning("Unbuffered I/O refused; writing through the page cache and dropping it as it goes", { filepath });
+            }
+        }
+        if (journal && journal->resumed()) {
+            out << "Resuming interrupted run at pass " << firstPass << ", " << utils::formatSize(firstOffset) << " into the pass.\n";
+        }
+        out << "Overwriting file: " << schemes::info(scheme).title << " (" << total << " passes)...\n";
+
+        for (size_t pass = firstPass; pass <= total; ++pass) {
+            const schemes::Pass& step = sequence[pass - 1];
+            const bool last = pass == total;
+            if (!options.quiet) {
+                progress::note(passLabel(pass, sequence) + " in progress...");
+            }
+            logger::debug("Pass started (" + schemes::describe(step) + ")", { filepath, pass });
+            auto start = high_resolution_clock::now();
+            unsigned long long startOffset = pass == firstPass ? firstOffset : 0;
+            verifier::Expected expected;
+
+            if (step.kind == schemes::PassKind::Random) {
+                // Random pass: every chunk gets its own slice of a fresh keystream, generated
+                // on the pipeline's worker threads while earlier chunks are being written.
+                // The extents are laid end to end; keystream offsets stay file offsets.
+                random_engine::Keystream stream = journal ? journal->keystream(pass) : random_engine::newKeystream();
+                expected = verifier::Expected::keystream(stream);
+                write_pipeline::Config config;
+                config.chunkSize = plan.chunkSize;
+                runPass(journal ? &*journal : nullptr, pass, startOffset, allocated, options.checkpoint.segmentBytes,
+                    [&](unsigned long long begin, unsigned long long end) {
+                        if (mapped) {
+                            // Generated straight into the mapping through a small cache-resident staging buffer
+                            forEachSpan(run, begin, end, plan.chunkSize, [&](unsigned long long start, size_t span) {
+                                io_qos::admit(span);
+                                mapped->writeKeystream(start, span, stream);
+                                tracker.add(span);
+                            });
+                            return;
+                        }
+                        auto fill = [&](unsigned char* chunk, size_t length, uint64_t position) {
+                            run.forEach(begin + position, length, [&](unsigned long long offset, size_t at, size_t piece) {
+                                random_engine::fill(stream, chunk + at, piece, offset, 1);
+                            });
+                        };
+                        if (direct) {
+                            ExtentSink sink(*direct, run, begin);
+                            write_pipeline::run(end - begin, config, fill, sink, tracker.pipelineCallback());
+                            return;
+                        }
+                        write_pipeline::run(end - begin, config, fill,
+                            [&](const unsigned char* chunk, size_t length, uint64_t position) {
+                                run.forEach(begin + position, length, [&](unsigned long long offset, size_t at, size_t piece) {
+                                    file.seekp(static_cast<streamoff>(offset));
+                                    io_qos::Write admitted(piece);
+                                    metrics::Scoped timed(metrics::Timer::Write, piece);
+                                    if (!file.write(reinterpret_cast<const char*>(chunk + at), piece)) {
+                                        throw runtime_error("Write failed while overwriting: " + filepath);
+                                    }
+                                });
+                            },
+                            tracker.pipelineCallback());
+                    },
+                    syncFile);
+            }
+            else {
+                // Shared read-only block: a constant, a short pattern or the custom pattern, built once
+                size_t period = blockSize;
+                shared_ptr<const unsigned char> block = passBlock(step, customPattern, blockSize, utils::kIoAlignment, period);
+                expected = step.kind == schemes::PassKind::Constant ? verifier::Expected::constant(step.bytes[0])
+                    : verifier::Expected::repeating(block, period);
+                runPass(journal ? &*journal : nullptr, pass, startOffset, allocated, options.checkpoint.segmentBytes,
+                    [&](unsigned long long begin, unsigned long long end) { writePattern(block.get(), period, begin, end); },
+                    syncFile);
+            }
+            file.flush();
+            if (!file) {
+                throw runtime_error("Write failed while overwriting: " + filepath);
+            }
+            if (journal && !last) {
+                syncFile();
+                journal->record(pass + 1, 0);
+            }
+            if (!options.quiet) {
+                progress::note("Pass " + std::to_string(pass) + " completed.");
+            }
+            metrics::record(metrics::Timer::Pass, high_resolution_clock::now() - start, allocated - startOffset);
+            logger::info("Pass completed", { filepath, pass, allocated, duration<double>(high_resolution_clock::now() - start).count() });
+            if (shouldVerify(options.verify, last)) {
+                checkVerification(verifier::verifyFile(filepath, extents.extents, expected, options.verify), filepath, pass, options.quiet);
+            }
+        }
+
+        file.close();
+        mapped.reset();
+        direct.reset();
+        if (journal) {
+            journal->finish();
+        }
+        if (!options.quiet) {
+            progress::note("File successfully overwritten.");
+        }
+        logger::info("File overwrite completed", { filepath });
+    }
+
+    bool securelyDelete(const std::string& filepath, size_t passes, const std::vector<unsigned char>& customPattern, const ShredOptions& options) {
+        std::ostream out(options.quiet ? nullptr : std::cout.rdbuf());
+        metrics::FileScope timed;
+        try {
+            out << "Preparing to securely delete: " << filepath << std::endl;
+            logger::info("Preparing to securely delete file", { filepath });
+            overwriteFile(filepath, passes, customPattern, options);
+
+            std::string newPath = filepath + "." + utils::generateRandomString(10);
+            fs::rename(filepath, newPath);
+            logger::debug("File renamed for secure deletion to " + newPath, { filepath });
+
+            std::ofstream file(newPath, std::ios::binary | std::ios::trunc);
+            file.close();
+
+            out << "Deleting the file...\n";
+            if (fs::remove(newPath)) {
+                out << "File securely deleted: " << filepath << std::endl;
+                logger::info("File securely deleted", { filepath });
+                return true;
+            }
+            else {
+                throw std::runtime_error("Failed to delete file: " + newPath);
+            }
+        }
+        catch (const std::exception& e) {
+            if (!options.quiet) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            logger::error(std::string("Failed to securely delete file: ") + e.what(), { filepath });
+            return false;
+        }
+    }
+
+    void shredFolder(const std::string& folderPath, size_t passes, const std::vector<unsigned char>& customPattern, std::optional<schemes::Id> scheme) {
+        if (!fs::exists(folderPath) || !fs::is_directory(folderPath)) {
+            std::cerr << "Error: Folder does not exist or is not a directory: " << folderPath << std::endl;
+            return;
+        }
+
+        logger::info("Starting to shred folder", { folderPath });
+        std::cout << "Shredding folder: " << folderPath << std::endl;
+
+        folder_shredder::Summary summary;
+        {
+            progress::Session session;
+            folder_shredder::Config config;
+            config.scheme = scheme;
+            summary = folder_shredder::shred(folderPath, passes, customPattern, config);
+        }
+        folder_shredder::printSummary(summary);
+
+        logger::info("Folder shredding finished (" + std::to_string(summary.filesShredded) + " files shredded, " +
+            std::to_string(summary.filesFailed) + " failed)", { folderPath, {}, summary.bytesShredded, summary.seconds });
+    }
+
+    void wipeFreeSpace(const std::string& mountPath, size_t passes, const std::vector<unsigned char>& customPattern, const free_space_wiper::Config& config) {
+        if (!fs::is_directory(mountPath)) {
+            std::cerr << "Error: Not a directory on a mounted filesystem: " << mountPath << std::endl;
+            return;
+        }
+
+        logger::info("Starting to wipe free space", { mountPath });
+        std::cout << "Wiping free space under: " << mountPath << std::endl;
+
+        free_space_wiper::Summary summary;
+        {
+            progress::Session session;
+            summary = free_space_wiper::wipe(mountPath, passes, customPattern, config);
+        }
+        free_space_wiper::printSummary(summary);
+    }
+
+    bool shredPartition(const std::string& partitionPath, size_t passes, const std::vector<unsigned char>& customPattern, const ShredOptions& options) {
+#ifdef _WIN32
+        if (!utils::isAdmin()) {
+            std::cerr << "Error: Administrative privileges required." << std::endl;
+            return false;
+        }
+
+        std::wstring widePartitionPath = utils::stringToWString(partitionPath);
+
+        // For GetVolumeInformation, we need a path with trailing backslash
+        std::wstring volumeInfoPath = widePartitionPath;
+        if (volumeInfoPath.back() != L'\\') {
+            volumeInfoPath += L'\\';
+        }
+
+        // Check if partition is formatted by attempting to get volume information
+        wchar_t volumeName[MAX_PATH + 1] = { 0 };
+        wchar_t fileSystemName[MAX_PATH + 1] = { 0 };
+        DWORD serialNumber = 0;
+        DWORD maxComponentLen = 0;
+        DWORD fileSystemFlags = 0;
+
+        if (!GetVolumeInformationW(
+            volumeInfoPath.c_str(),
+            volumeName,
+            MAX_PATH + 1,
+            &serialNumber,
+            &maxComponentLen,
+            &fileSystemFlags,
+            fileSystemName,
+            MAX_PATH + 1
+        )) {
+            std::cerr << "Error: Cannot shred unformatted partition: " << partitionPath << std::endl
+                << "Partition must be formatted with a valid file system." << std::endl;
+            return false;
+        }
+
+        if (wcslen(fileSystemName) == 0) {
+            std::cerr << "Error: No valid file system found on partition: " << partitionPath << std::endl;
+            return false;
+        }
+#endif
+
+        // For CreateFile, we need the original path format without trailing backslash
+        std::cout << "Attempting to lock and dismount volume..." << std::endl;
+        logger::info("Starting to shred partition", { partitionPath });
+        volume_utils::VolumeHandle hVolume = volume_utils::lockVolume(partitionPath);
+
+        if (hVolume == volume_utils::kInvalidVolume) {
+            std::cerr << "Error: Unable to lock volume. " << volume_utils::lastErrorMessage() << std::endl
+                << "Make sure the volume is not in use and you have administrative privileges." << std::endl;
+            return false;
+        }
+
+        if (!volume_utils::dismountVolume(hVolume)) {
+            std::cerr << "Error: Failed to dismount volume. " << volume_utils::lastErrorMessage() << std::endl;
+            volume_utils::closeVolume(hVolume);
+            return false;
+        }
+
+        unsigned long long volumeSize = volume_utils::getVolumeSize(hVolume);
+        if (volumeSize == 0) {
+            std::cerr << "Error: Unable to determine volume size. " << volume_utils::lastErrorMessage() << std::endl;
+            volume_utils::closeVolume(hVolume);
+            return false;
+        }
+
+        // Unbuffered writes must be whole physical sectors from sector-aligned (pooled, page-aligned) memory
+        const size_t sectorSize = volume_utils::getPhysicalSectorSize(hVolume);
+        io_tuning::Plan plan = options.calibrate ? io_tuning::calibrate(partitionPath, volumeSize)
+            : io_tuning::tune(io_tuning::targetDeviceId(partitionPath), volumeSize);
+        if (options.chunkSize != 0) {
+            plan.chunkSize = options.chunkSize;
+        }
+        const size_t bufferSize = std::max(plan.chunkSize / sectorSize, size_t(1)) * sectorSize;
+        std::cout << "Shredding partition: " << partitionPath << std::endl;
+
+        cout << "I/O plan: " << io_tuning::describe(plan) << ".\n";
+
+        block_offload::Support offload = block_offload::probe(hVolume, io_tuning::targetDeviceId(partitionPath));
+        std::cout << "Offload: " << block_offload::describe(offload) << "\n";
+
+        std::cout << "Volume size: " << utils::formatSize(volumeSize) << " (sector size " << volume_utils::getSectorSize(hVolume)
+            << " logical / " << sectorSize << " physical)" << std::endl;
+
+        try {
+            io_queue::WriteQueue queue(hVolume, options.queueDepth != 0 ? options.queueDepth : plan.queueDepth);
+            sim_device::Spec simulatedSpec;
+            std::string simulatedError;
+            if (queue.simulated() && sim_device::parse(partitionPath, simulatedSpec, simulatedError)) {
+                std::cout << "I/O backend: simulated device (" << sim_device::describe(simulatedSpec) << "), queue depth " << queue.depth() << std::endl;
+            }
+            else if (queue.usingUring()) {
+                std::cout << "I/O backend: io_uring, queue depth " << queue.depth() << std::endl;
+            }
+            else {
+                std::cout << "I/O backend: synchronous writes" << std::endl;
+            }
+
+            const schemes::Id scheme = schemes::resolve(options.scheme, schemes::Id::Random);
+            const std::vector<schemes::Pass> sequence = schemes::expand(scheme, passes, !customPattern.empty());
+            const size_t total = sequence.size();
+            std::cout << "Scheme: " << schemes::info(scheme).title;
+            if (schemes::info(scheme).passes == nullptr) {
+                std::cout << " (N = " << passes << ", " << total << " passes)";
+            }
+            std::cout << std::endl;
+
+            std::optional<checkpoint::Journal> journal;
+            if (options.checkpoint.enabled) {
+                journal.emplace(options.checkpoint, partitionPath, schemeOf(scheme, passes, customPattern, bufferSize, volumeSize));
+            }
+            checkpoint::Journal* journalPtr = journal ? &*journal : nullptr;
+            const size_t firstPass = journal ? journal->pass() : 1;
+            const unsigned long long firstOffset = journal ? journal->offset() : 0;
+            const unsigned long long done = std::min((firstPass - 1) * volumeSize + firstOffset, volumeSize * total);
+            // Segments end on whole chunks, so a resumed pass restarts on the same chunk grid
+            const unsigned long long segment = std::max<unsigned long long>(options.checkpoint.segmentBytes / bufferSize, 1) * bufferSize;
+            auto flush = [&]() {
+                if (!volume_utils::flushVolume(hVolume)) {
+                    throw std::runtime_error("Unable to flush data to disk (" + volume_utils::lastErrorMessage() + ")");
+                }
+            };
+            if (journal && journal->resumed()) {
+                std::cout << "Resuming interrupted run at pass " << firstPass << ", " << utils::formatSize(firstOffset) << " into the pass." << std::endl;
+            }
+
+            progress::Session session;
+            TargetProgress tracker(progress::device(io_tuning::targetDeviceId(partitionPath)), volumeSize * total - done, false, false);
+            bool offloadZeroes = offload.zeroOut && options.offload;
+
+            for (size_t pass = firstPass; pass <= total; ++pass) {
+                const schemes::Pass& step = sequence[pass - 1];
+                const bool last = pass == total;
+                progress::note(passLabel(pass, sequence) + " in progress...");
+                auto start = high_resolution_clock::now();
+                unsigned long long startOffset = pass == firstPass ? firstOffset : 0;
+                verifier::Expected expected;
+
+                if (step.kind == schemes::PassKind::Random) {
+                    // Random data is generated chunk by chunk on worker threads while earlier chunks are written
+                    random_engine::Keystream stream = journal ? journal->keystream(pass) : random_engine::newKeystream();
+                    expected = verifier::Expected::keystream(stream);
+                    write_pipeline::Config config;
+                    config.chunkSize = bufferSize;
+                    runPass(journalPtr, pass, startOffset, volumeSize, segment,
+                        [&](unsigned long long begin, unsigned long long end) {
+                            OffsetSink sink(queue, begin);
+                            write_pipeline::run(end - begin, config,
+                                [&](unsigned char* chunk, size_t length, uint64_t chunkOffset) {
+                                    random_engine::fill(stream, chunk, length, begin + chunkOffset, 1);
+                                },
+                                sink,
+                                tracker.pipelineCallback());
+                        },
+                        flush);
+                }
+                else if (step.kind == schemes::PassKind::Constant && step.bytes[0] == 0) {
+                    // Zeroes are offloaded to the kernel or device when it can take them
+                    expected = verifier::Expected::constant(0);
+                    bool offloaded = offloadZeroes;
+                    std::shared_ptr<const unsigned char> zeros;
+                    runPass(journalPtr, pass, startOffset, volumeSize, segment,
+                        [&](unsigned long long begin, unsigned long long end) {
+                            if (offloaded && block_offload::run(hVolume, block_offload::Operation::ZeroOut, begin, end - begin,
+                                [&](unsigned long long bytes) { io_qos::admit(bytes); tracker.add(bytes); })) {
+                                return;
+                            }
+                            offloaded = offloadZeroes = false;
+                            if (!zeros) {
+                                zeros = buffer_pool::zeroBlock(bufferSize);
+                            }
+                            writeRepeated(queue, zeros.get(), bufferSize, begin, end, tracker);
+                        },
+                        flush);
+                    logger::info(offloaded ? "Zero pass offloaded (BLKZEROOUT)" : "Zero pass written", { partitionPath, pass, volumeSize });
+                }
+                else {
+                    // A constant, a short pattern or the custom pattern, repeated across a shared read-only block
+                    size_t period = bufferSize;
+                    std::shared_ptr<const unsigned char> block = passBlock(step, customPattern, bufferSize, sectorSize, period);
+                    expected = step.kind == schemes::PassKind::Constant ? verifier::Expected::constant(step.bytes[0])
+                        : verifier::Expected::repeating(block, period);
+                    runPass(journalPtr, pass, startOffset, volumeSize, segment,
+                        [&](unsigned long long begin, unsigned long long end) { writeRepeated(queue, block.get(), period, begin, end, tracker); },
+                        flush);
+                }
+
+                flush();
+                if (journal && !last) {
+                    journal->record(pass + 1, 0);
+                }
+
+                progress::note("Pass " + std::to_string(pass) + " completed.");
+                metrics::record(metrics::Timer::Pass, high_resolution_clock::now() - start, volumeSize - startOffset);
+                logger::info("Partition pass completed", { partitionPath, pass, volumeSize,
+                    duration<double>(high_resolution_clock::now() - start).count() });
+                if (shouldVerify(options.verify, last)) {
+                    checkVerification(verifier::verify(hVolume, volumeSize, expected, options.verify), partitionPath, pass, false);
+                }
+            }
+
+            if (options.discard) {
+                if (block_offload::run(hVolume, block_offload::Operation::SecureDiscard, 0, volumeSize) ||
+                    block_offload::run(hVolume, block_offload::Operation::Discard, 0, volumeSize)) {
+                    progress::note("Device range discarded.");
+                }
+                else {
+                    progress::note("The device does not support discard; skipped.");
+                }
+            }
+            if (journal) {
+                journal->finish();
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            logger::error(std::string("Partition shredding failed: ") + e.what(), { partitionPath });
+            volume_utils::closeVolume(hVolume);
+            return false;
+        }
+
+        std::cout << "Partition " << partitionPath << " shredded successfully." << std::endl;
+        logger::info("Partition shredding completed", { partitionPath });
+        volume_utils::closeVolume(hVolume);
+        return true;
+    }
+}
\ No newline at end of file
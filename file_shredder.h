@@ -1,13 +1,44 @@
-#pragma once
-#include <string>
-#include <cstddef>
-#include <chrono>
-#include <vector> 
-
-// file_shredder.h
-namespace file_shredder {
-    void overwriteFile(const std::string& filepath, size_t passes, const std::vector<unsigned char>& customPattern = {});
-    void securelyDelete(const std::string& filepath, size_t passes, const std::vector<unsigned char>& customPattern = {});
-    void shredFolder(const std::string& folderPath, size_t passes, const std::vector<unsigned char>& customPattern = {});
-    bool shredPartition(const std::string& partitionPath, size_t passes, const std::vector<unsigned char>& customPattern = {});
-}
+#pragma once
+#include <string>
+#include <cstddef>
+#include <chrono>
+#include <vector> 
+#include "verifier.h"
+#include "checkpoint.h"
+#include "schemes.h"
+#include "free_space_wiper.h"
+#include <optional>
+
+// file_shredder.h
+namespace file_shredder {
+    // How file data reaches the file: buffered stream writes, a shared memory mapping filled with streaming
+    // stores, or unbuffered (O_DIRECT) writes that leave nothing in the page cache
+    enum class WriteEngine { Stream, Mmap, Direct };
+
+    struct ShredOptions {
+        bool quiet = false;     // No per-file console output; failures still go to the log
+        size_t queueDepth = 0;  // Volume writes kept in flight; 0 = autotuned
+        size_t chunkSize = 0;   // Bytes per write; 0 = autotuned
+        bool calibrate = false; // Measure chunk sizes on the target before the first pass
+        bool announced = false; // The caller already counted this file in the progress totals
+        verifier::Options verify;   // Read back the final pass (or every pass) and fail on any mismatch
+        bool mapExtents = true; // Overwrite only allocated extents; off for files known to be fully allocated
+        bool offload = true;    // Partitions: let the kernel or device zero the final pass when it can
+        bool discard = false;   // Partitions: discard the whole range once shredded (secure discard when supported)
+        checkpoint::Options checkpoint; // Journal progress so an interrupted run can resume
+        WriteEngine engine = WriteEngine::Stream;   // Files: how the data is written
+        size_t mmapWindow = 0;  // Mmap engine: bytes mapped at a time; 0 = mmap_writer's default
+        std::optional<schemes::Id> scheme;  // Unset: classic for files, random for partitions
+    };
+
+    bool parseEngine(const std::string& text, WriteEngine& engine);
+    const char* engineName(WriteEngine engine);
+
+    void overwriteFile(const std::string& filepath, size_t passes, const std::vector<unsigned char>& customPattern = {}, const ShredOptions& options = {});
+    bool securelyDelete(const std::string& filepath, size_t passes, const std::vector<unsigned char>& customPattern = {}, const ShredOptions& options = {});
+    void shredFolder(const std::string& folderPath, size_t passes, const std::vector<unsigned char>& customPattern = {},
+        std::optional<schemes::Id> scheme = {});
+    void wipeFreeSpace(const std::string& mountPath, size_t passes, const std::vector<unsigned char>& customPattern = {},
+        const free_space_wiper::Config& config = {});
+    bool shredPartition(const std::string& partitionPath, size_t passes, const std::vector<unsigned char>& customPattern = {}, const ShredOptions& options = {});
+}
@@ -0,0 +1,549 @@
+#include "folder_shredder.h"
+#include "dir_scanner.h"
+#include "file_shredder.h"
+#include "io_qos.h"
+#include "io_tuning.h"
+#include "logger.h"
+#include "progress.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+namespace fs = std::filesystem;
+
+namespace folder_shredder {
+    namespace {
+        struct DirNode {
+            std::string name;       // within the parent; the root's path as given
+            std::string path;
+            DirNode* parent;
+            // Kept open from the scan until its last small-file batch, for relative opens, while descriptors
+            // are plentiful; other directories are reopened by path when their entries are acted on
+            std::shared_ptr<dir_scanner::Directory> handle;
+            std::weak_ptr<dir_scanner::Directory> weakHandle;
+            unsigned long long device;
+            std::atomic<size_t> batches{ 0 };   // small-file batches scheduled and not yet run
+            std::atomic<size_t> pending{ 1 }; // outstanding children, plus one for the scan itself
+        };
+
+        // A directory waiting on a scanner's stack, with the parent it is opened relative to
+        struct PendingDir {
+            DirNode* node;
+            std::shared_ptr<dir_scanner::Directory> parent;
+        };
+
+        // Limits concurrent file jobs per device. Jobs over the limit are parked and handed
+        // to the pool when a running job on the same device finishes, so no worker blocks.
+        class DeviceGate {
+        public:
+            // File jobs run under the QoS context of the thread that started the shred
+            DeviceGate(const Config& config, WorkStealingPool& pool) : config_(config), pool_(pool), qos_(io_qos::current()) {}
+
+            void submit(unsigned long long device, std::function<void()> job) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Device& state = devices_[device];
+                if (state.active < limitFor(device)) {
+                    state.active++;
+                    pool_.submit(wrap(device, std::move(job)));
+                }
+                else {
+                    state.parked.push_back(std::move(job));
+                }
+            }
+
+        private:
+            struct Device {
+                size_t active = 0;
+                std::deque<std::function<void()>> parked;
+            };
+
+            size_t limitFor(unsigned long long device) const {
+                auto it = config_.deviceLimits.find(device);
+                size_t limit = it != config_.deviceLimits.end() ? it->second : config_.perDeviceLimit;
+                // Jobs released beyond the workers would only wait in the pool's LIFO queues, out of the planned order
+                return std::min(std::max<size_t>(limit, 1), pool_.size());
+            }
+
+            std::function<void()> wrap(unsigned long long device, std::function<void()> job) {
+                return [this, device, job = std::move(job)]() {
+                    {
+                        io_qos::Scope scope(qos_);
+                        job();
+                    }
+                    release(device);
+                };
+            }
+
+            void release(unsigned long long device) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Device& state = devices_[device];
+                if (!state.parked.empty()) {
+                    pool_.submit(wrap(device, std::move(state.parked.front())));
+                    state.parked.pop_front();
+                }
+                else {
+                    state.active--;
+                }
+            }
+
+            const Config& config_;
+            WorkStealingPool& pool_;
+            io_qos::Context qos_;
+            std::mutex mutex_;
+            std::map<unsigned long long, Device> devices_;
+        };
+
+        // One row of the plan: a file or a symlink, found by the scan and acted on once the scan is done.
+        // Its name lives in the run's shared name arena.
+        struct PlannedEntry {
+            DirNode* directory;
+            size_t nameOffset;
+            unsigned long long size;
+            unsigned long long inode;
+            unsigned long long physical;        // first byte on the device; only looked up on rotational disks
+            unsigned long links;
+            unsigned nameLength;
+            dir_scanner::Kind kind;             // File or Symlink
+            bool sizeKnown;
+        };
+
+        // What the executor schedules: one file through file_shredder, or small files of one directory
+        struct WorkUnit {
+            unsigned long long device;
+            unsigned long long key;             // ascending: physical address on rotational disks, elsewhere ~bytes
+            bool batch;
+            std::vector<size_t> entries;        // into the plan
+        };
+
+        std::string pathOf(const DirNode* directory, const std::string& name) {
+            const std::string& path = directory->path;
+            return !path.empty() && path.back() == '/' ? path + name : path + "/" + name;
+        }
+
+        class TreeRun {
+        public:
+            TreeRun(size_t passes, const std::vector<unsigned char>& customPattern, const Config& config)
+                : passes_(passes), customPattern_(customPattern), config_(config), pool_(config.threads), gate_(config, pool_),
+                passCount_(schemes::passCount(schemes::resolve(config.scheme, schemes::Id::Classic), passes)) {}
+
+            // Scans the whole tree into a plan, then shreds it; nothing is written before the plan is complete.
+            void run(const std::string& root) {
+                auto start = std::chrono::steady_clock::now();
+                DirNode* node = new DirNode{ root, root, nullptr, {}, {}, 0 };
+                scanners_ = 1;
+                pool_.submit([this, node]() { scan(PendingDir{ node, nullptr }); });
+                pool_.waitIdle();
+                deduplicate();
+                planSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                logger::info("Folder plan: " + std::to_string(plan_.size()) + " entries, " + utils::formatSize(bytesPlanned_) + " to shred, " +
+                    std::to_string(aliasCount_) + " hard links sharing data", { root });
+
+                schedule();
+                pool_.waitIdle();
+            }
+
+            void collect(Summary& summary) {
+                summary.filesShredded = filesShredded_;
+                summary.filesFailed = filesFailed_;
+                summary.linksRemoved = linksRemoved_;
+                summary.hardLinksRemoved = hardLinksRemoved_;
+                summary.directoriesRemoved = directoriesRemoved_;
+                summary.directoriesFailed = directoriesFailed_;
+                summary.bytesShredded = bytesShredded_;
+                summary.bytesPlanned = bytesPlanned_;
+                summary.planSeconds = planSeconds_;
+                summary.failures = failures_;
+            }
+
+        private:
+            void recordFailure(const std::string& path, const std::string& reason) {
+                logger::error("Folder shredding failed: " + reason, { path });
+                std::lock_guard<std::mutex> lock(failuresMutex_);
+                failures_.push_back(path + " (" + reason + ")");
+            }
+
+            bool rotational(unsigned long long device) {
+                std::lock_guard<std::mutex> lock(planMutex_);
+                auto it = rotational_.find(device);
+                if (it == rotational_.end()) {
+                    it = rotational_.emplace(device, io_tuning::probeDevice(device).rotational).first;
+                }
+                return it->second;
+            }
+
+            // Walks depth first from an explicit stack. While fewer scanners run than there are workers,
+            // the oldest directories on the stack, the shallowest and likely the largest, go to new scanners.
+            void scan(PendingDir start) {
+                std::deque<PendingDir> stack;
+                std::vector<PlannedEntry> found;
+                std::string names;
+                stack.push_back(std::move(start));
+                while (!stack.empty()) {
+                    PendingDir next = std::move(stack.back());
+                    stack.pop_back();
+                    scanDirectory(next, stack, found, names);
+                    while (stack.size() > 1 && scanners_ < pool_.size()) {
+                        scanners_++;
+                        pool_.submit([this, handoff = std::move(stack.front())]() { scan(handoff); });
+                        stack.pop_front();
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(planMutex_);
+                    for (PlannedEntry& entry : found) {
+                        entry.nameOffset += names_.size();
+                    }
+                    names_ += names;
+                    plan_.insert(plan_.end(), found.begin(), found.end());
+                }
+                scanners_--;
+            }
+
+            // Names found go to the scanner's own arena, appended to the run's when the scanner is done
+            void scanDirectory(PendingDir& pending, std::deque<PendingDir>& stack, std::vector<PlannedEntry>& found, std::string& names) {
+                DirNode* node = pending.node;
+                std::string error;
+                std::shared_ptr<dir_scanner::Directory> directory = pending.parent ? pending.parent->openChild(node->name, error)
+                    : dir_scanner::Directory::open(node->path, error);
+                pending.parent.reset();
+                if (!directory) {
+                    recordFailure(node->path, error);
+                    finish(node);
+                    return;
+                }
+                node->device = directory->device();
+                node->weakHandle = directory;
+
+                const bool locate = rotational(node->device);
+                bool batched = false;
+                bool listed = directory->forEach([&](const dir_scanner::Entry& entry) {
+                    if (entry.kind == dir_scanner::Kind::Directory) {
+                        node->pending++;
+                        stack.push_back(PendingDir{ new DirNode{ entry.name, directory->childPath(entry.name), node, {}, {}, node->device }, directory });
+                    }
+                    else if (entry.kind == dir_scanner::Kind::File || entry.kind == dir_scanner::Kind::Symlink) {
+                        node->pending++;
+                        bool file = entry.kind == dir_scanner::Kind::File;
+                        size_t offset = names.size();
+                        names += entry.name;
+                        batched = batched || (file && small(entry.sizeKnown, entry.size));
+                        found.push_back(PlannedEntry{ node, offset, entry.size, entry.inode,
+                            file && locate && entry.size > 0 ? directory->firstPhysical(entry.name) : 0,
+                            entry.links, static_cast<unsigned>(names.size() - offset), entry.kind, entry.sizeKnown });
+                    }
+                }, error);
+                if (!listed) {
+                    recordFailure(node->path, error);
+                }
+                // Only directories with small-file batches keep their descriptor past the scan
+                if (batched && dir_scanner::openHandles() < dir_scanner::budget()) {
+                    node->handle = directory;
+                }
+                finish(node);
+            }
+
+            // Names of one inode after the first are aliases: the data is shredded once, through the first
+            // name, and the aliases are unlinked once that succeeded. Also totals the work for progress.
+            void deduplicate() {
+                std::vector<size_t> linked;
+                for (size_t i = 0; i < plan_.size(); ++i) {
+                    if (plan_[i].kind == dir_scanner::Kind::File && plan_[i].links > 1 && plan_[i].inode != 0) {
+                        linked.push_back(i);
+                    }
+                }
+                auto inodeOf = [this](size_t i) { return std::make_pair(plan_[i].directory->device, plan_[i].inode); };
+                std::sort(linked.begin(), linked.end(), [&](size_t a, size_t b) { return inodeOf(a) != inodeOf(b) ? inodeOf(a) < inodeOf(b) : a < b; });
+                isAlias_.assign(plan_.size(), false);
+                for (size_t i = 1; i < linked.size(); ++i) {
+                    size_t primary = linked[i - 1];
+                    while (isAlias_[primary]) {
+                        primary = aliasOf_[primary];
+                    }
+                    if (inodeOf(linked[i]) == inodeOf(primary)) {
+                        isAlias_[linked[i]] = true;
+                        aliasOf_[linked[i]] = primary;
+                        aliases_[primary].push_back(linked[i]);
+                        aliasCount_++;
+                    }
+                }
+
+                for (size_t i = 0; i < plan_.size(); ++i) {
+                    const PlannedEntry& entry = plan_[i];
+                    if (entry.kind != dir_scanner::Kind::File || isAlias_[i]) {
+                        continue;
+                    }
+                    progress::fileQueued();
+                    if (entry.sizeKnown) {
+                        bytesPlanned_ += entry.size;
+                        progress::addExpected(progress::device(entry.directory->device), entry.size * passCount_);
+                    }
+                }
+            }
+
+            // On rotational disks work goes out in order of physical address, so each disk's head sweeps
+            // across it; elsewhere the largest work goes first, so the pool does not end on one big file.
+            void schedule() {
+                std::vector<WorkUnit> units;
+                std::map<DirNode*, std::vector<size_t>> smallFiles;
+                for (size_t i = 0; i < plan_.size(); ++i) {
+                    const PlannedEntry& entry = plan_[i];
+                    if (entry.kind == dir_scanner::Kind::Symlink) {
+                        removeSymlink(entry);
+                    }
+                    else if (isAlias_[i]) {
+                        continue;   // unlinked after its primary
+                    }
+                    else if (small(entry.sizeKnown, entry.size)) {
+                        smallFiles[entry.directory].push_back(i);
+                    }
+                    else {
+                        unsigned long long device = entry.directory->device;
+                        units.push_back(WorkUnit{ device, rotational(device) ? entry.physical : ~entry.size, false, { i } });
+                    }
+                }
+                for (auto& directory : smallFiles) {
+                    unsigned long long device = directory.first->device;
+                    bool byAddress = rotational(device);
+                    std::vector<size_t>& files = directory.second;
+                    if (byAddress) {
+                        std::stable_sort(files.begin(), files.end(), [this](size_t a, size_t b) { return plan_[a].physical < plan_[b].physical; });
+                    }
+                    for (size_t begin = 0; begin < files.size(); begin += config_.smallFileBatch) {
+                        WorkUnit unit{ device, 0, true, {} };
+                        unit.entries.assign(files.begin() + begin, files.begin() + std::min(files.size(), begin + config_.smallFileBatch));
+                        unsigned long long bytes = 0;
+                        for (size_t i : unit.entries) {
+                            bytes += plan_[i].size;
+                        }
+                        unit.key = byAddress ? plan_[unit.entries.front()].physical : ~bytes;
+                        units.push_back(std::move(unit));
+                        directory.first->batches++;
+                    }
+                }
+                std::stable_sort(units.begin(), units.end(), [](const WorkUnit& a, const WorkUnit& b) {
+                    return a.device != b.device ? a.device < b.device : a.key < b.key;
+                });
+
+                for (WorkUnit& unit : units) {
+                    if (unit.batch) {
+                        gate_.submit(unit.device, [this, entries = std::move(unit.entries)]() { shredBatch(entries); });
+                    }
+                    else {
+                        size_t index = unit.entries.front();
+                        gate_.submit(unit.device, [this, index]() { shredFile(index); });
+                    }
+                }
+            }
+
+            bool small(bool sizeKnown, unsigned long long size) const {
+                return sizeKnown && config_.smallFileThreshold > 0 && size <= config_.smallFileThreshold;
+            }
+
+            std::string nameOf(const PlannedEntry& entry) const {
+                return names_.substr(entry.nameOffset, entry.nameLength);
+            }
+
+            void removeSymlink(const PlannedEntry& entry) {
+                // Symlinks are never followed: the link is removed and its target left alone.
+                if (removeName(entry)) {
+                    linksRemoved_++;
+                }
+                finish(entry.directory);
+            }
+
+            bool removeName(const PlannedEntry& entry) {
+                std::shared_ptr<dir_scanner::Directory> directory = entry.directory->weakHandle.lock();
+                std::string name = nameOf(entry);
+                std::string error;
+                bool removed = false;
+                if (directory) {
+                    removed = directory->removeEntry(name, error);
+                }
+                else {
+                    std::error_code ec;
+                    removed = fs::remove(pathOf(entry.directory, name), ec);
+                    error = ec ? ec.message() : "not removed";
+                }
+                if (!removed) {
+                    recordFailure(pathOf(entry.directory, name), error);
+                }
+                return removed;
+            }
+
+            // The other names of a shredded inode go once its data is gone; after a failure they are kept.
+            void finishAliases(size_t primary, bool shredded) {
+                auto it = aliases_.find(primary);
+                if (it == aliases_.end()) {
+                    return;
+                }
+                for (size_t alias : it->second) {
+                    const PlannedEntry& entry = plan_[alias];
+                    if (shredded) {
+                        if (removeName(entry)) {
+                            hardLinksRemoved_++;
+                        }
+                    }
+                    else {
+                        recordFailure(pathOf(entry.directory, nameOf(entry)), "hard link kept: shredding its data failed");
+                    }
+                    finish(entry.directory);
+                }
+            }
+
+            // All entries are small files of one directory. The directory stays open for relative opens
+            // while descriptors are plentiful; otherwise the batch reopens it by path. The last batch
+            // of a directory closes its descriptor.
+            void shredBatch(const std::vector<size_t>& entries) {
+                DirNode* node = plan_[entries.front()].directory;
+                std::shared_ptr<dir_scanner::Directory> held = node->weakHandle.lock();
+                std::vector<std::string> names;
+                names.reserve(entries.size());
+                for (size_t i : entries) {
+                    names.push_back(nameOf(plan_[i]));
+                }
+                std::vector<small_file_shredder::Outcome> outcomes = small_file_shredder::shredBatch(
+                    node->path, names, passes_, customPattern_, config_.smallFileThreshold, config_.scheme, held ? held->descriptor() : -1);
+                if (--node->batches == 0) {
+                    node->handle.reset();
+                }
+                for (size_t i = 0; i < outcomes.size(); ++i) {
+                    progress::fileDone();
+                    if (outcomes[i].shredded) {
+                        filesShredded_++;
+                        bytesShredded_ += outcomes[i].bytes;
+                    }
+                    else {
+                        filesFailed_++;
+                        recordFailure(pathOf(node, names[i]), outcomes[i].error.empty() ? "see shredder.log" : outcomes[i].error);
+                    }
+                    finishAliases(entries[i], outcomes[i].shredded);
+                    finish(node);
+                }
+            }
+
+            void shredFile(size_t index) {
+                const PlannedEntry& entry = plan_[index];
+                std::string path = pathOf(entry.directory, nameOf(entry));
+                file_shredder::ShredOptions options;
+                options.quiet = true;
+                options.announced = true;
+                options.scheme = config_.scheme;
+                bool shredded = file_shredder::securelyDelete(path, passes_, customPattern_, options);
+                progress::fileDone();
+                if (shredded) {
+                    filesShredded_++;
+                    bytesShredded_ += entry.size;
+                }
+                else {
+                    filesFailed_++;
+                    recordFailure(path, "see shredder.log");
+                }
+                finishAliases(index, shredded);
+                finish(entry.directory);
+            }
+
+            // Drops one outstanding child; the last one out removes the directory and walks up.
+            void finish(DirNode* node) {
+                while (node != nullptr && --node->pending == 0) {
+                    DirNode* parent = node->parent;
+                    std::shared_ptr<dir_scanner::Directory> parentHandle = parent != nullptr ? parent->weakHandle.lock() : nullptr;
+                    std::string error;
+                    bool removed = false;
+                    if (parentHandle) {
+                        removed = parentHandle->removeChildDirectory(node->name, error);
+                    }
+                    else {
+                        std::error_code ec;
+                        removed = fs::remove(node->path, ec);
+                        error = ec ? ec.message() : "directory not removed";
+                    }
+                    if (removed) {
+                        directoriesRemoved_++;
+                        logger::debug("Directory removed", { node->path });
+                    }
+                    else {
+                        directoriesFailed_++;
+                        recordFailure(node->path, error);
+                    }
+                    delete node;     // closes any handle before the parent may remove it
+                    node = parent;
+                }
+            }
+
+            size_t passes_;
+            const std::vector<unsigned char>& customPattern_;
+            const Config& config_;
+            WorkStealingPool pool_;
+            DeviceGate gate_;
+            const size_t passCount_;
+            std::mutex planMutex_;
+            std::vector<PlannedEntry> plan_;
+            std::string names_;                 // names of all planned entries, back to back
+            std::map<unsigned long long, bool> rotational_;
+            std::vector<bool> isAlias_;
+            std::map<size_t, size_t> aliasOf_;
+            std::map<size_t, std::vector<size_t>> aliases_;
+            size_t aliasCount_ = 0;
+            unsigned long long bytesPlanned_ = 0;
+            double planSeconds_ = 0;
+            std::atomic<size_t> scanners_{ 0 };
+            std::atomic<size_t> filesShredded_{ 0 };
+            std::atomic<size_t> filesFailed_{ 0 };
+            std::atomic<size_t> linksRemoved_{ 0 };
+            std::atomic<size_t> hardLinksRemoved_{ 0 };
+            std::atomic<size_t> directoriesRemoved_{ 0 };
+            std::atomic<size_t> directoriesFailed_{ 0 };
+            std::atomic<unsigned long long> bytesShredded_{ 0 };
+            std::mutex failuresMutex_;
+            std::vector<std::string> failures_;
+        };
+    }
+
+    Summary shred(const std::string& root, size_t passes, const std::vector<unsigned char>& customPattern, const Config& config) {
+        auto start = std::chrono::high_resolution_clock::now();
+        Summary summary;
+        {
+            TreeRun run(passes, customPattern, config);
+            run.run(root);
+            run.collect(summary);
+        }
+        summary.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        return summary;
+    }
+
+    void printSummary(const Summary& summary) {
+        const size_t maxListedFailures = 20;
+        double rate = summary.seconds > 0 ? summary.bytesShredded / summary.seconds : 0.0;
+
+        std::cout << "=========================\n";
+        std::cout << " Folder shred summary\n";
+        std::cout << "=========================\n";
+        std::cout << "Files shredded:      " << summary.filesShredded << " (" << utils::formatSize(summary.bytesShredded) << ")\n";
+        std::cout << "Files failed:        " << summary.filesFailed << "\n";
+        std::cout << "Symlinks removed:    " << summary.linksRemoved << "\n";
+        std::cout << "Hard links removed:  " << summary.hardLinksRemoved << " (data shredded once, through another name)\n";
+        std::cout << "Directories removed: " << summary.directoriesRemoved << "\n";
+        std::cout << "Directories failed:  " << summary.directoriesFailed << "\n";
+        std::cout << "Elapsed:             " << std::fixed << std::setprecision(1) << summary.seconds << "s ("
+            << utils::formatSize(static_cast<unsigned long long>(rate)) << "/s), planning " << summary.planSeconds << "s for "
+            << utils::formatSize(summary.bytesPlanned) << "\n";
+
+        if (!summary.failures.empty()) {
+            std::cout << "Failures:\n";
+            for (size_t i = 0; i < summary.failures.size() && i < maxListedFailures; ++i) {
+                std::cout << "  " << summary.failures[i] << "\n";
+            }
+            if (summary.failures.size() > maxListedFailures) {
+                std::cout << "  ... and " << (summary.failures.size() - maxListedFailures) << " more (see shredder.log)\n";
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "small_file_shredder.h"
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+// folder_shredder.h
+// Parallel tree shredder. A planning pass first walks the whole tree, with scanners using explicit
+// stacks over dir_scanner handles, into a table of files: size, device, inode and, on rotational
+// disks, first physical block. Hard links are shredded once per inode, progress gets the exact total
+// up front, and the work goes out by device and physical address (largest first on SSDs). Files
+// are spread over a work-stealing pool, with a cap on how many files per device (st_dev) are in
+// flight; a directory is removed once all of its children are gone.
+namespace folder_shredder {
+    struct Config {
+        size_t threads = 0;                                 // 0 = one per hardware thread
+        size_t perDeviceLimit = 4;                          // concurrent files per device
+        std::map<unsigned long long, size_t> deviceLimits;  // per-st_dev overrides of perDeviceLimit
+        unsigned long long smallFileThreshold = small_file_shredder::kDefaultThreshold;  // files up to this size take the batched path; 0 disables it
+        size_t smallFileBatch = small_file_shredder::kDefaultBatchSize;                  // small files per batch job
+        std::optional<schemes::Id> scheme;                  // unset = classic
+    };
+
+    struct Summary {
+        size_t filesShredded = 0;
+        size_t filesFailed = 0;
+        size_t linksRemoved = 0;
+        size_t hardLinksRemoved = 0;        // names of an inode already shredded through another name
+        size_t directoriesRemoved = 0;
+        size_t directoriesFailed = 0;
+        unsigned long long bytesShredded = 0;
+        unsigned long long bytesPlanned = 0;
+        double seconds = 0.0;
+        double planSeconds = 0.0;
+        std::vector<std::string> failures;
+    };
+
+    Summary shred(const std::string& root, size_t passes, const std::vector<unsigned char>& customPattern, const Config& config = {});
+    void printSummary(const Summary& summary);
+}
@@ -0,0 +1,305 @@
+#include "free_space_wiper.h"
+#include "file_shredder.h"
+#include "io_qos.h"
+#include "logger.h"
+#include "utils.h"
+#include "volume_utils.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace free_space_wiper {
+    namespace {
+        enum class Preallocation { Done, NoSpace, Failed };
+
+        // Creates path with `size` bytes reserved on disk, so the overwrite cannot run out of space halfway.
+        Preallocation preallocate(const std::string& path, unsigned long long size, std::string& error) {
+#ifdef _WIN32
+            HANDLE file = CreateFileW(utils::stringToWString(path).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                error = "Error code: " + std::to_string(GetLastError());
+                return Preallocation::Failed;
+            }
+            FILE_ALLOCATION_INFO allocation = {};
+            allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+            LARGE_INTEGER end = {};
+            end.QuadPart = static_cast<LONGLONG>(size);
+            bool ok = SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation)) &&
+                SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+            DWORD code = ok ? 0 : GetLastError();
+            CloseHandle(file);
+            if (!ok) {
+                error = "Error code: " + std::to_string(code);
+                DeleteFileW(utils::stringToWString(path).c_str());
+                return code == ERROR_DISK_FULL ? Preallocation::NoSpace : Preallocation::Failed;
+            }
+            return Preallocation::Done;
+#else
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (fd < 0) {
+                error = std::strerror(errno);
+                return errno == ENOSPC ? Preallocation::NoSpace : Preallocation::Failed;
+            }
+            // posix_fallocate returns the error instead of setting errno
+            int result = posix_fallocate(fd, 0, static_cast<off_t>(size));
+            close(fd);
+            if (result != 0) {
+                error = std::strerror(result);
+                unlink(path.c_str());
+                return result == ENOSPC || result == EDQUOT ? Preallocation::NoSpace : Preallocation::Failed;
+            }
+            return Preallocation::Done;
+#endif
+        }
+
+        // Blocks this process can still allocate. Root may dip into the filesystem's reserved blocks,
+        // which hold deleted data like any other free block.
+        unsigned long long usableSpace(const fs::space_info& space) {
+            return utils::isAdmin() ? space.free : space.available;
+        }
+
+        class Wipe {
+        public:
+            Wipe(const std::string& directory, size_t passes, const std::vector<unsigned char>& customPattern,
+                const Config& config, Summary& summary)
+                : directory_(directory), passes_(passes), customPattern_(customPattern), config_(config), summary_(summary) {
+            }
+
+            // Phase one: every stream keeps claiming large fillers until the headroom drops below slackStart.
+            void fillLarge() {
+                std::vector<std::thread> streams;
+                const io_qos::Context qos = io_qos::current();
+                for (size_t i = 0; i < std::max<size_t>(config_.streams, 1); ++i) {
+                    streams.emplace_back([this, qos]() {
+                        io_qos::Scope scope(qos);
+                        while (true) {
+                            std::string path;
+                            unsigned long long size = 0;
+                            if (!claim(config_.slackStart, config_.fillerSize, false, path, size)) {
+                                return;
+                            }
+                            if (!overwrite(path, size, false)) {
+                                return;
+                            }
+                        }
+                    });
+                }
+                for (std::thread& stream : streams) {
+                    stream.join();
+                }
+            }
+
+            // Phase two: one stream, halving the file size until less than an allocation unit remains.
+            void fillSlack() {
+                unsigned long long size = config_.slackStart;
+                const unsigned long long unit = std::max<unsigned long long>(config_.allocationUnit, 1);
+                while (size >= unit) {
+                    std::string path;
+                    unsigned long long claimed = 0;
+                    if (!claim(size, size, true, path, claimed)) {
+                        size /= 2;
+                        continue;
+                    }
+                    if (!overwrite(path, claimed, true)) {
+                        return;
+                    }
+                }
+            }
+
+            bool removeFillers() {
+                bool removed = true;
+                for (const std::string& path : created_) {
+                    std::error_code error;
+                    if (!fs::remove(path, error) && error) {
+                        removed = false;
+                        summary_.failures.push_back(path + ": cannot remove filler (" + error.message() + ")");
+                    }
+                }
+                std::error_code error;
+                fs::remove(directory_, error);
+                return removed && !error;
+            }
+
+            unsigned long long headroom() const {
+                std::error_code error;
+                fs::space_info space = fs::space(directory_, error);
+                if (error || usableSpace(space) <= summary_.reserve) {
+                    return 0;
+                }
+                return usableSpace(space) - summary_.reserve;
+            }
+
+        private:
+            // Reserves the next filler of up to maxSize bytes, or fails when less than minSize is left above the reserve.
+            bool claim(unsigned long long minSize, unsigned long long maxSize, bool slack, std::string& path, unsigned long long& size) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopped_) {
+                    return false;
+                }
+                unsigned long long room = headroom();
+                if (room < minSize) {
+                    return false;
+                }
+                size = std::min(maxSize, room);
+                path = (fs::path(directory_) / ("fill-" + std::to_string(created_.size()))).string();
+                std::string error;
+                switch (preallocate(path, size, error)) {
+                case Preallocation::Done:
+                    created_.push_back(path);
+                    (slack ? summary_.slackFiles : summary_.fillerFiles)++;
+                    return true;
+                case Preallocation::NoSpace:
+                    // Less room than reported (metadata, other writers): this size is done, the next phase or size takes over
+                    return false;
+                default:
+                    summary_.failures.push_back(path + ": cannot preallocate " + utils::formatSize(size) + " (" + error + ")");
+                    logger::error("Free-space filler could not be preallocated: " + error, { path, {}, size });
+                    stopped_ = true;
+                    return false;
+                }
+            }
+
+            bool overwrite(const std::string& path, unsigned long long size, bool slack) {
+                file_shredder::ShredOptions options;
+                options.quiet = true;
+                options.mapExtents = false;     // preallocated extents may be reported as holes until written
+                options.scheme = config_.scheme;
+                try {
+                    file_shredder::overwriteFile(path, passes_, customPattern_, options);
+                    // Deleting a file with dirty pages can discard them unwritten; push the passes to the media first
+                    if (!volume_utils::syncFile(path)) {
+                        throw std::runtime_error("Unable to flush filler to disk");
+                    }
+                    logger::debug(slack ? "Slack filler written" : "Filler written", { path, {}, size });
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    summary_.bytesWiped += size;
+                    return true;
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    summary_.failures.push_back(path + ": " + e.what());
+                    logger::error(std::string("Free-space filler failed: ") + e.what(), { path, {}, size });
+                    stopped_ = true;
+                    return false;
+                }
+            }
+
+            std::string directory_;
+            size_t passes_;
+            const std::vector<unsigned char>& customPattern_;
+            const Config& config_;
+            Summary& summary_;
+            std::mutex mutex_;
+            std::vector<std::string> created_;
+            bool stopped_ = false;
+        };
+    }
+
+    bool parseReserve(const std::string& text, Config& config) {
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        if (end == text.c_str() || !std::isfinite(value) || value < 0) {
+            return false;
+        }
+        std::string unit(end);
+        if (unit == "%") {
+            if (value >= 100) {
+                return false;
+            }
+            config.reserveBytes = 0;
+            config.reserveFraction = value / 100;
+            return true;
+        }
+        // Position in "KMGT" + 1 is the power of 1024; 0 for a plain byte count
+        size_t power = unit.empty() ? 0 : std::string("KMGT").find(static_cast<char>(std::toupper(static_cast<unsigned char>(unit[0])))) + 1;
+        if (unit.size() > 1 || (!unit.empty() && power == 0)) {
+            return false;
+        }
+        double multiplier = 1;
+        for (size_t i = 0; i < power; ++i) {
+            multiplier *= 1024;
+        }
+        // 2^64: the first byte count that no longer fits
+        if (value * multiplier >= 18446744073709551616.0) {
+            return false;
+        }
+        config.reserveBytes = static_cast<unsigned long long>(value * multiplier);
+        config.reserveFraction = 0.0;
+        return true;
+    }
+
+    Summary wipe(const std::string& mountPath, size_t passes, const std::vector<unsigned char>& customPattern, const Config& config) {
+        auto start = std::chrono::high_resolution_clock::now();
+        Summary summary;
+        std::error_code error;
+        fs::space_info space = fs::space(mountPath, error);
+        if (error) {
+            summary.failures.push_back(mountPath + ": cannot query free space (" + error.message() + ")");
+            return summary;
+        }
+        summary.freeBefore = usableSpace(space);
+        summary.reserve = std::max(config.reserveBytes, static_cast<unsigned long long>(space.capacity * config.reserveFraction));
+
+        std::string directory = (fs::path(mountPath) / (".shredder-fill-" + utils::generateRandomString(8))).string();
+        if (!fs::create_directory(directory, error)) {
+            summary.failures.push_back(directory + ": cannot create filler directory (" + error.message() + ")");
+            return summary;
+        }
+        logger::info("Free-space wipe started, reserve " + utils::formatSize(summary.reserve), { mountPath, {}, summary.freeBefore });
+
+        Wipe run(directory, passes, customPattern, config, summary);
+        run.fillLarge();
+        if (summary.failures.empty()) {
+            run.fillSlack();
+        }
+        fs::space_info filled = fs::space(directory, error);
+        if (error) {
+            logger::warning("Cannot query free space while filled: " + error.message(), { mountPath });
+        }
+        else {
+            summary.freeAfter = usableSpace(filled);
+        }
+        summary.fillersRemoved = run.removeFillers();
+
+        summary.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        logger::info("Free-space wipe finished (" + std::to_string(summary.fillerFiles + summary.slackFiles) + " fillers, " +
+            std::to_string(summary.failures.size()) + " failures)", { mountPath, {}, summary.bytesWiped, summary.seconds });
+        return summary;
+    }
+
+    void printSummary(const Summary& summary) {
+        double rate = summary.seconds > 0 ? summary.bytesWiped / summary.seconds : 0.0;
+
+        std::cout << "=========================\n";
+        std::cout << " Free-space wipe summary\n";
+        std::cout << "=========================\n";
+        std::cout << "Free before:         " << utils::formatSize(summary.freeBefore) << " (reserve " << utils::formatSize(summary.reserve) << ")\n";
+        std::cout << "Bytes wiped:         " << utils::formatSize(summary.bytesWiped) << "\n";
+        std::cout << "Filler files:        " << summary.fillerFiles << " large, " << summary.slackFiles << " slack\n";
+        std::cout << "Free while filled:   " << utils::formatSize(summary.freeAfter) << "\n";
+        std::cout << "Fillers removed:     " << (summary.fillersRemoved ? "yes" : "NO") << "\n";
+        std::cout << "Elapsed:             " << std::fixed << std::setprecision(1) << summary.seconds << "s ("
+            << utils::formatSize(static_cast<unsigned long long>(rate)) << "/s)\n";
+        for (const std::string& failure : summary.failures) {
+            std::cout << "  " << failure << "\n";
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "schemes.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// free_space_wiper.h
+// Scrubs the free space of a mounted filesystem without unmounting it. Phase one fills the free
+// space with large preallocated filler files, several streams in parallel, each overwritten with
+// the normal pass machinery; phase two adds ever smaller files until less than one allocation
+// unit is left above the reserve. The fillers are removed at the end, also after a failure.
+namespace free_space_wiper {
+    struct Config {
+        size_t streams = 4;                                     // filler files written in parallel
+        unsigned long long fillerSize = 1ULL << 30;             // size of a phase-one filler
+        unsigned long long slackStart = 64ULL * 1024 * 1024;    // below this much headroom, phase two takes over
+        unsigned long long allocationUnit = 4096;               // phase two stops when less than this is left
+        unsigned long long reserveBytes = 256ULL * 1024 * 1024; // free space left for everything else on the filesystem
+        double reserveFraction = 0.0;                           // reserve as a share of capacity; the larger reserve applies
+        std::optional<schemes::Id> scheme;                      // unset = classic
+    };
+
+    struct Summary {
+        size_t fillerFiles = 0;
+        size_t slackFiles = 0;
+        unsigned long long bytesWiped = 0;
+        unsigned long long freeBefore = 0;
+        unsigned long long freeAfter = 0;       // free space left while the fillers were in place
+        unsigned long long reserve = 0;
+        bool fillersRemoved = true;
+        double seconds = 0.0;
+        std::vector<std::string> failures;
+    };
+
+    // Sets the reserve from "512M", "2G", "1048576" (bytes; K, M, G and T are binary multiples) or
+    // "5%" of capacity, replacing both reserve fields; false when the text is neither.
+    bool parseReserve(const std::string& text, Config& config);
+
+    Summary wipe(const std::string& mountPath, size_t passes, const std::vector<unsigned char>& customPattern, const Config& config = {});
+    void printSummary(const Summary& summary);
+}
@@ -0,0 +1,265 @@
+#include "io_qos.h"
+#include "logger.h"
+#include "utils.h"
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace io_qos {
+    namespace {
+        const double kBurstSeconds = 0.1;           // bucket depth: at most this much of a second's budget at once
+        const double kMinimumRate = 1024.0 * 1024;  // back-offs never go below 1 MB/s
+        const std::chrono::milliseconds kCutSpacing(200);       // one halving per burst of slow writes
+        const std::chrono::milliseconds kRaiseSpacing(500);
+        const double kRaiseFraction = 0.05;         // of the configured limit (or the peak) per raise
+
+        thread_local Context currentContext;
+
+#ifdef __linux__
+        // From linux/ioprio.h, which older kernel headers do not ship
+        const int kIoprioWhoProcess = 1;    // with who = 0: the calling thread
+        const int kIoprioClassShift = 13;
+        const int kIoprioClassBestEffort = 2;
+        const int kIoprioClassIdle = 3;
+        const int kLowestBestEffortLevel = 7;
+
+        int ioprioGet() {
+            return static_cast<int>(syscall(SYS_ioprio_get, kIoprioWhoProcess, 0));
+        }
+
+        bool ioprioSet(int value) {
+            return syscall(SYS_ioprio_set, kIoprioWhoProcess, 0, value) == 0;
+        }
+#endif
+
+        // Returns the value to restore, or -1 when nothing was changed
+        int applyPriority(Priority priority) {
+            if (priority == Priority::Normal) {
+                return -1;
+            }
+#ifdef _WIN32
+            // Background mode lowers the thread's I/O and memory priority; there is one level only
+            return SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) ? 1 : -1;
+#elif defined(__linux__)
+            int previous = ioprioGet();
+            int value = priority == Priority::Idle ? kIoprioClassIdle << kIoprioClassShift
+                : (kIoprioClassBestEffort << kIoprioClassShift) | kLowestBestEffortLevel;
+            if (previous < 0 || !ioprioSet(value)) {
+                logger::warning(std::string("Unable to set I/O priority class ") + priorityName(priority));
+                return -1;
+            }
+            return previous;
+#else
+            return -1;
+#endif
+        }
+
+        void restorePriority(int previous) {
+            if (previous < 0) {
+                return;
+            }
+#ifdef _WIN32
+            SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+#elif defined(__linux__)
+            ioprioSet(previous);
+#endif
+        }
+    }
+
+    Throttle::Throttle(const Limits& limits, double latencyTargetMs)
+        : limits_(limits), latencyTarget_(latencyTargetMs / 1000.0), rate_(limits.bytesPerSecond) {
+        refilled_ = windowStart_ = Clock::now();
+        byteTokens_ = rate_ * kBurstSeconds;
+        opTokens_ = std::max(limits_.iops * kBurstSeconds, 1.0);
+    }
+
+    void Throttle::admit(size_t bytes) {
+        double wait = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Clock::time_point now = Clock::now();
+            double elapsed = std::chrono::duration<double>(now - refilled_).count();
+            refilled_ = now;
+            // Buckets go into debt rather than splitting a write; the writer sleeps the debt off
+            if (rate_ > 0) {
+                byteTokens_ = std::min(byteTokens_ + elapsed * rate_, rate_ * kBurstSeconds) - static_cast<double>(bytes);
+                if (byteTokens_ < 0) {
+                    wait = -byteTokens_ / rate_;
+                }
+            }
+            if (limits_.iops > 0) {
+                opTokens_ = std::min(opTokens_ + elapsed * limits_.iops, std::max(limits_.iops * kBurstSeconds, 1.0)) - 1;
+                if (opTokens_ < 0) {
+                    wait = std::max(wait, -opTokens_ / limits_.iops);
+                }
+            }
+
+            windowBytes_ += bytes;
+            double window = std::chrono::duration<double>(now - windowStart_).count();
+            if (window >= 1.0) {
+                measured_ = static_cast<double>(windowBytes_) / window;
+                peak_ = std::max(peak_, measured_);
+                windowBytes_ = 0;
+                windowStart_ = now;
+            }
+        }
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+    }
+
+    void Throttle::observe(double seconds) {
+        if (latencyTarget_ <= 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        if (seconds > latencyTarget_) {
+            if (now - lastCut_ < kCutSpacing) {
+                return;
+            }
+            // Unlimited so far: start from what the disk was actually taking
+            double base = rate_ > 0 ? rate_ : measured_;
+            if (base <= 0) {
+                // No full second measured yet; a tenth of one is the least worth trusting
+                double window = std::chrono::duration<double>(now - windowStart_).count();
+                base = window >= 0.1 ? static_cast<double>(windowBytes_) / window : 0;
+            }
+            if (base <= 0) {
+                return;
+            }
+            double previous = rate_;
+            rate_ = std::max(base / 2, kMinimumRate);
+            byteTokens_ = std::min(byteTokens_, rate_ * kBurstSeconds);
+            lastCut_ = lastRaise_ = now;
+            if (previous == 0 || rate_ < previous) {
+                logger::debug("Write latency " + std::to_string(static_cast<int>(seconds * 1000)) + " ms above target; throttled to " +
+                    utils::formatSize(static_cast<unsigned long long>(rate_)) + "/s");
+            }
+        }
+        else if (rate_ > 0 && now - lastRaise_ >= kRaiseSpacing) {
+            double ceiling = limits_.bytesPerSecond > 0 ? limits_.bytesPerSecond : peak_;
+            rate_ += std::max(ceiling * kRaiseFraction, kMinimumRate);
+            if (rate_ >= ceiling) {
+                // Back at the configured limit, or unlimited again once past the best the disk has done
+                rate_ = limits_.bytesPerSecond;
+            }
+            lastRaise_ = now;
+        }
+    }
+
+    double Throttle::rate() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rate_;
+    }
+
+    Context makeContext(const Policy& policy, std::shared_ptr<Throttle> device) {
+        Context context;
+        if (policy.limits.limited() || policy.latencyTargetMs > 0) {
+            context.job = std::make_shared<Throttle>(policy.limits, policy.latencyTargetMs);
+        }
+        context.device = std::move(device);
+        context.priority = policy.priority;
+        return context;
+    }
+
+    const Context& current() {
+        return currentContext;
+    }
+
+    Scope::Scope(const Context& context) : previous_(currentContext) {
+        currentContext = context;
+        previousPriority_ = applyPriority(context.priority);
+    }
+
+    Scope::~Scope() {
+        restorePriority(previousPriority_);
+        currentContext = previous_;
+    }
+
+    void admit(size_t bytes) {
+        const Context& context = currentContext;
+        if (context.job) {
+            context.job->admit(bytes);
+        }
+        if (context.device) {
+            context.device->admit(bytes);
+        }
+    }
+
+    void observe(double seconds) {
+        const Context& context = currentContext;
+        if (context.job) {
+            context.job->observe(seconds);
+        }
+        if (context.device) {
+            context.device->observe(seconds);
+        }
+    }
+
+    Write::Write(size_t bytes) {
+        if (currentContext.job || currentContext.device) {
+            admit(bytes);
+            start_ = std::chrono::steady_clock::now();
+            timed_ = true;
+        }
+    }
+
+    Write::~Write() {
+        if (timed_) {
+            observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+        }
+    }
+
+    bool parsePriority(const std::string& text, Priority& priority) {
+        if (text == "normal") {
+            priority = Priority::Normal;
+        }
+        else if (text == "best-effort") {
+            priority = Priority::BestEffort;
+        }
+        else if (text == "idle") {
+            priority = Priority::Idle;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* priorityName(Priority priority) {
+        switch (priority) {
+        case Priority::BestEffort: return "best-effort";
+        case Priority::Idle: return "idle";
+        default: return "normal";
+        }
+    }
+
+    std::string describe(const Policy& policy) {
+        std::ostringstream text;
+        const char* separator = "";
+        if (policy.limits.bytesPerSecond > 0) {
+            text << utils::formatSize(static_cast<unsigned long long>(policy.limits.bytesPerSecond)) << "/s";
+            separator = ", ";
+        }
+        if (policy.limits.iops > 0) {
+            text << separator << policy.limits.iops << " IOPS";
+            separator = ", ";
+        }
+        if (policy.priority != Priority::Normal) {
+            text << separator << priorityName(policy.priority);
+            separator = ", ";
+        }
+        if (policy.latencyTargetMs > 0) {
+            text << separator << "latency target " << policy.latencyTargetMs << " ms";
+        }
+        return text.str();
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// io_qos.h
+// Keeps a shred from crowding out the other work on a shared disk. Write paths admit every write
+// through the throttles installed on their thread: a token bucket for bytes and one for operations,
+// per job and per disk. With a latency target a throttle also adapts: a write slower than the
+// target halves its rate, and the rate creeps back up while writes stay fast (additive increase,
+// multiplicative decrease). The I/O priority class (ioprio_set on Linux, background mode on Windows)
+// applies to the thread's own reads and writes; buffered data written back later by the kernel is
+// only paced by the throttles, which is where the direct engine helps.
+namespace io_qos {
+    enum class Priority { Normal, BestEffort, Idle };
+
+    struct Limits {
+        double bytesPerSecond = 0;  // 0 = unlimited
+        double iops = 0;            // writes per second; 0 = unlimited
+
+        bool limited() const { return bytesPerSecond > 0 || iops > 0; }
+    };
+
+    struct Policy {
+        Limits limits;                  // this job alone
+        Priority priority = Priority::Normal;
+        double latencyTargetMs = 0;     // back off when a write takes longer; 0 = fixed limits only
+
+        bool active() const { return limits.limited() || priority != Priority::Normal || latencyTargetMs > 0; }
+    };
+
+    class Throttle {
+    public:
+        Throttle(const Limits& limits, double latencyTargetMs = 0);
+        Throttle(const Throttle&) = delete;
+        Throttle& operator=(const Throttle&) = delete;
+
+        // Takes the tokens for one write, sleeping while the buckets are in debt.
+        void admit(size_t bytes);
+        // Reports how long a write took to complete.
+        void observe(double seconds);
+        // Bytes per second currently enforced, 0 when unlimited
+        double rate() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        mutable std::mutex mutex_;
+        Limits limits_;
+        double latencyTarget_;              // seconds
+        double rate_;                       // in force; below limits_ after a back-off
+        double byteTokens_ = 0;
+        double opTokens_ = 0;
+        Clock::time_point refilled_;
+        Clock::time_point lastCut_;
+        Clock::time_point lastRaise_;
+        Clock::time_point windowStart_;
+        unsigned long long windowBytes_ = 0;
+        double measured_ = 0;               // throughput over the last full second
+        double peak_ = 0;                   // highest measured throughput
+    };
+
+    // What a thread's writes are subject to. Threads a job starts take a copy of their parent's.
+    struct Context {
+        std::shared_ptr<Throttle> job;
+        std::shared_ptr<Throttle> device;
+        Priority priority = Priority::Normal;
+    };
+
+    // `device` is shared by every job on the same disk; null when the disk has no limits
+    Context makeContext(const Policy& policy, std::shared_ptr<Throttle> device = nullptr);
+    const Context& current();
+
+    // Installs a context, and its I/O priority, on the calling thread until it goes out of scope.
+    class Scope {
+    public:
+        explicit Scope(const Context& context);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Context previous_;
+        int previousPriority_ = -1;
+    };
+
+    // Called by the write paths; no-ops on threads without a context
+    void admit(size_t bytes);
+    void observe(double seconds);
+
+    // Admits a synchronous write on construction and reports its latency on destruction
+    class Write {
+    public:
+        explicit Write(size_t bytes);
+        ~Write();
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+        bool timed_ = false;
+    };
+
+    bool parsePriority(const std::string& text, Priority& priority);
+    const char* priorityName(Priority priority);
+    // e.g. "50.00 MB/s, 200 IOPS, idle, latency target 20 ms"; empty when the policy is inactive
+    std::string describe(const Policy& policy);
+}
@@ -0,0 +1,294 @@
+#include "io_queue.h"
+#include "io_qos.h"
+#include "metrics.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace io_queue {
+#ifdef __linux__
+    std::unique_ptr<Ring> Ring::create(unsigned entries) {
+        std::unique_ptr<Ring> ring(new Ring());
+        io_uring_params params = {};
+        ring->ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring->ringFd_ < 0) {
+            return nullptr;
+        }
+        ring->entries_ = params.sq_entries;
+
+        ring->sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring->sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqRing = mmap(nullptr, ring->sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd_, IORING_OFF_SQ_RING);
+        void* cqRing = mmap(nullptr, ring->cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd_, IORING_OFF_CQ_RING);
+        void* sqes = mmap(nullptr, ring->sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd_, IORING_OFF_SQES);
+        ring->sqRing_ = sqRing == MAP_FAILED ? nullptr : sqRing;
+        ring->cqRing_ = cqRing == MAP_FAILED ? nullptr : cqRing;
+        ring->sqes_ = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+        if (!ring->sqRing_ || !ring->cqRing_ || !ring->sqes_) {
+            return nullptr;
+        }
+
+        char* sq = static_cast<char*>(ring->sqRing_);
+        char* cq = static_cast<char*>(ring->cqRing_);
+        ring->sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring->sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring->sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        ring->cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring->cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring->cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ring->cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ring;
+    }
+
+    Ring::~Ring() {
+        if (sqes_) {
+            munmap(sqes_, sqesSize_);
+        }
+        if (cqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        if (sqRing_) {
+            munmap(sqRing_, sqRingSize_);
+        }
+        if (ringFd_ >= 0) {
+            close(ringFd_);
+        }
+    }
+
+    int Ring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        while (true) {
+            int result = static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, nullptr, 0));
+            if (result >= 0 || errno != EINTR) {
+                return result;
+            }
+        }
+    }
+
+    io_uring_sqe* Ring::nextEntry() {
+        if (pending_ >= entries_) {
+            throw std::logic_error("io_uring submission queue overflow");
+        }
+        unsigned tail = *sqTail_ + pending_;
+        unsigned slot = tail & *sqMask_;
+        sqArray_[slot] = slot;
+        pending_++;
+        io_uring_sqe* sqe = &sqes_[slot];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void Ring::queueWrite(int fd, const iovec* iov, uint64_t offset, uint64_t userData, bool linkNext) {
+        io_uring_sqe* sqe = nextEntry();
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(iov);
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        sqe->flags = linkNext ? IOSQE_IO_LINK : 0;
+    }
+
+    void Ring::queueDataSync(int fd, uint64_t userData, bool linkNext) {
+        io_uring_sqe* sqe = nextEntry();
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->user_data = userData;
+        sqe->flags = linkNext ? IOSQE_IO_LINK : 0;
+    }
+
+    void Ring::submit() {
+        if (pending_ == 0) {
+            return;
+        }
+        unsigned count = pending_;
+        __atomic_store_n(sqTail_, *sqTail_ + count, __ATOMIC_RELEASE);
+        pending_ = 0;
+        while (count > 0) {
+            int submitted = enter(count, 0, 0);
+            if (submitted < 0) {
+                throw std::runtime_error(std::string("io_uring submit failed: ") + std::strerror(errno));
+            }
+            count -= static_cast<unsigned>(submitted);
+        }
+    }
+
+    void Ring::waitCompletion(uint64_t& userData, int& result) {
+        while (true) {
+            unsigned head = *cqHead_;
+            if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+                userData = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                return;
+            }
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+                throw std::runtime_error(std::string("io_uring wait failed: ") + std::strerror(errno));
+            }
+        }
+    }
+#endif
+
+    WriteQueue::WriteQueue(volume_utils::VolumeHandle handle, size_t depth, bool allowUring)
+        : handle_(handle), depth_(std::max<size_t>(depth, 1)) {
+#ifdef __linux__
+        simulated_ = sim_device::simulated(handle);
+        if (simulated_) {
+            return;
+        }
+        if (allowUring && depth_ > 1) {
+            ring_ = Ring::create(static_cast<unsigned>(depth_));
+        }
+        if (ring_) {
+            ops_.resize(depth_);
+            for (size_t i = depth_; i > 0; --i) {
+                freeOps_.push_back(i - 1);
+            }
+        }
+#else
+        (void)allowUring;
+#endif
+        if (!usingUring()) {
+            depth_ = 1;
+        }
+    }
+
+    WriteQueue::~WriteQueue() {
+        // Errors were the caller's to collect; the destructor only makes sure nothing is still in flight.
+        while (inFlight_ > 0) {
+            try {
+                wait();
+            }
+            catch (...) {
+            }
+        }
+    }
+
+    bool WriteQueue::usingUring() const {
+#ifdef __linux__
+        return ring_ != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    bool WriteQueue::simulated() const {
+#ifdef __linux__
+        return simulated_;
+#else
+        return false;
+#endif
+    }
+
+    void WriteQueue::submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        if (inFlight_ >= depth_) {
+            throw std::logic_error("WriteQueue::submit called on a full queue");
+        }
+#ifdef __linux__
+        if (ring_) {
+            io_qos::admit(length);
+            size_t index = freeOps_.back();
+            Op& op = ops_[index];
+            op.iov.iov_base = const_cast<unsigned char*>(buffer);
+            op.iov.iov_len = length;
+            op.offset = offset;
+            op.tag = tag;
+            op.submitted = std::chrono::steady_clock::now();
+            ring_->queueWrite(handle_, &op.iov, offset, index);
+            ring_->submit();
+            freeOps_.pop_back();
+            inFlight_++;
+            return;
+        }
+        if (simulated_) {
+            io_qos::admit(length);
+            std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+            simulatedOps_.push_back(SimulatedOp{ buffer, length, offset, tag, submitted, sim_device::write(handle_, buffer, length, offset) });
+            inFlight_++;
+            return;
+        }
+#endif
+        io_qos::Write admitted(length);
+        metrics::Scoped timed(metrics::Timer::Write, length);
+        if (!volume_utils::writeAt(handle_, buffer, length, offset)) {
+            throw std::runtime_error("Write failed at offset " + std::to_string(offset) + " (" +
+                volume_utils::lastErrorMessage() + ")");
+        }
+        completed_.push_back(tag);
+        inFlight_++;
+    }
+
+    uint64_t WriteQueue::wait() {
+        if (inFlight_ == 0) {
+            throw std::logic_error("WriteQueue::wait called with nothing in flight");
+        }
+        inFlight_--;
+#ifdef __linux__
+        if (ring_) {
+            uint64_t index = 0;
+            int result = 0;
+            ring_->waitCompletion(index, result);
+            freeOps_.push_back(static_cast<size_t>(index));
+            const Op& op = ops_[static_cast<size_t>(index)];
+            std::chrono::nanoseconds latency = std::chrono::steady_clock::now() - op.submitted;
+            io_qos::observe(std::chrono::duration<double>(latency).count());
+            metrics::record(metrics::Timer::Write, latency, op.iov.iov_len);
+            const unsigned char* buffer = static_cast<const unsigned char*>(op.iov.iov_base);
+            size_t length = op.iov.iov_len;
+            size_t done = result > 0 ? static_cast<size_t>(result) : 0;
+
+            // Short writes, and an unaligned tail O_DIRECT rejects with EINVAL, are finished synchronously;
+            // EINVAL on an aligned write is a real error.
+            if (result >= 0 || (result == -EINVAL && volume_utils::unalignedForHandle(handle_, buffer, length, op.offset))) {
+                if (done < length && !volume_utils::writeAt(handle_, buffer + done, length - done, op.offset + done)) {
+                    throw std::runtime_error("Write failed at offset " + std::to_string(op.offset + done) + " (" +
+                        volume_utils::lastErrorMessage() + ")");
+                }
+                return op.tag;
+            }
+            throw std::runtime_error("Write failed at offset " + std::to_string(op.offset) + " (" +
+                std::strerror(-result) + ")");
+        }
+        if (simulated_) {
+            SimulatedOp op = simulatedOps_.front();
+            simulatedOps_.pop_front();
+            std::this_thread::sleep_until(op.completion.at);
+            std::chrono::nanoseconds latency = std::chrono::steady_clock::now() - op.submitted;
+            io_qos::observe(std::chrono::duration<double>(latency).count());
+            metrics::record(metrics::Timer::Write, latency, op.length);
+            if (op.completion.error != 0) {
+                throw std::runtime_error("Write failed at offset " + std::to_string(op.offset) + " (" +
+                    std::strerror(op.completion.error) + ")");
+            }
+            // Short writes are finished synchronously, as on io_uring
+            size_t done = op.completion.written;
+            if (done < op.length && !volume_utils::writeAt(handle_, op.buffer + done, op.length - done, op.offset + done)) {
+                throw std::runtime_error("Write failed at offset " + std::to_string(op.offset + done) + " (" +
+                    volume_utils::lastErrorMessage() + ")");
+            }
+            return op.tag;
+        }
+#endif
+        uint64_t tag = completed_.front();
+        completed_.pop_front();
+        return tag;
+    }
+
+    void WriteQueue::drain() {
+        while (inFlight_ > 0) {
+            wait();
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "sim_device.h"
+#include "volume_utils.h"
+#include "write_pipeline.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#endif
+
+// io_queue.h
+// Keeps up to `depth` positional writes in flight on one volume handle. On Linux the writes go
+// through io_uring when the kernel allows it; everywhere else (or when io_uring setup fails)
+// each submit is a synchronous volume_utils::writeAt. On a simulated device (sim_device) the
+// writes complete on the device's clock, so queue depth overlaps their latency as on real hardware.
+// Every write is admitted through io_qos.
+namespace io_queue {
+    const size_t kDefaultQueueDepth = 8;
+
+#ifdef __linux__
+    // Minimal io_uring driver on raw syscalls, so the build does not depend on liburing.
+    // Entries are queued locally and handed to the kernel in one io_uring_enter by submit().
+    class Ring {
+    public:
+        static std::unique_ptr<Ring> create(unsigned entries);
+        ~Ring();
+
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+
+        unsigned capacity() const { return entries_; }
+        // linkNext chains the following entry so it only starts once this one succeeded in full.
+        void queueWrite(int fd, const iovec* iov, uint64_t offset, uint64_t userData, bool linkNext = false);
+        void queueDataSync(int fd, uint64_t userData, bool linkNext = false);
+        void submit();
+        void waitCompletion(uint64_t& userData, int& result);
+
+    private:
+        Ring() = default;
+        io_uring_sqe* nextEntry();
+        int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+        int ringFd_ = -1;
+        unsigned entries_ = 0;
+        unsigned pending_ = 0;
+        void* sqRing_ = nullptr;
+        size_t sqRingSize_ = 0;
+        void* cqRing_ = nullptr;
+        size_t cqRingSize_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        size_t sqesSize_ = 0;
+        unsigned* sqTail_ = nullptr;
+        unsigned* sqMask_ = nullptr;
+        unsigned* sqArray_ = nullptr;
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        unsigned* cqMask_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+    };
+#endif
+
+    class WriteQueue : public write_pipeline::AsyncSink {
+    public:
+        WriteQueue(volume_utils::VolumeHandle handle, size_t depth = kDefaultQueueDepth, bool allowUring = true);
+        ~WriteQueue() override;
+
+        WriteQueue(const WriteQueue&) = delete;
+        WriteQueue& operator=(const WriteQueue&) = delete;
+
+        bool usingUring() const;
+        bool simulated() const;
+        size_t depth() const override { return depth_; }
+        size_t inFlight() const { return inFlight_; }
+
+        // Callers wait() before submitting once inFlight() reaches depth(). Buffers must stay
+        // untouched until their tag is returned by wait().
+        void submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) override;
+        uint64_t wait() override;
+        void drain();
+
+    private:
+        volume_utils::VolumeHandle handle_;
+        size_t depth_;
+        size_t inFlight_ = 0;
+        std::deque<uint64_t> completed_; // synchronous mode: tags already written
+#ifdef __linux__
+        struct Op {
+            iovec iov;
+            uint64_t offset;
+            uint64_t tag;
+            std::chrono::steady_clock::time_point submitted;
+        };
+        std::unique_ptr<Ring> ring_;
+        std::vector<Op> ops_;
+        std::vector<size_t> freeOps_;
+
+        struct SimulatedOp {
+            const unsigned char* buffer;
+            size_t length;
+            uint64_t offset;
+            uint64_t tag;
+            std::chrono::steady_clock::time_point submitted;
+            sim_device::Completion completion;
+        };
+        bool simulated_ = false;
+        std::deque<SimulatedOp> simulatedOps_;  // completions come in submission order
+#endif
+    };
+}
@@ -0,0 +1,319 @@
+#include "io_tuning.h"
+#include "logger.h"
+#include "random_engine.h"
+#include "utils.h"
+#include "write_pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+namespace io_tuning {
+    namespace {
+        const char* kCacheFile = "shredder_tuning.cache";
+        std::mutex cacheMutex;
+        // The cache file's entries by disk, read once per process; writeCache keeps them current
+        std::map<std::string, Plan> cachedPlans;
+        bool cacheLoaded = false;
+
+        // Sysfs answers by device id, probed once per process; a folder shred asks for every file
+        std::mutex devicesMutex;
+        std::map<unsigned long long, DeviceInfo> devices;
+
+        size_t roundUp(size_t value, size_t multiple) {
+            return multiple == 0 ? value : (value + multiple - 1) / multiple * multiple;
+        }
+
+#ifndef _WIN32
+        unsigned long long readSysfsNumber(const std::string& path, unsigned long long fallback) {
+            std::ifstream file(path);
+            unsigned long long value = 0;
+            if (file >> value) {
+                return value;
+            }
+            return fallback;
+        }
+
+        std::string readSysfsString(const std::string& path) {
+            std::ifstream file(path);
+            std::string value;
+            file >> value;
+            return value;
+        }
+#endif
+
+        // Callers hold cacheMutex
+        void loadCache() {
+            if (cacheLoaded) {
+                return;
+            }
+            cacheLoaded = true;
+            std::ifstream cache(kCacheFile);
+            std::string line;
+            while (std::getline(cache, line)) {
+                std::istringstream fields(line);
+                std::string device;
+                Plan plan;
+                if (fields >> device >> plan.chunkSize >> plan.queueDepth && plan.chunkSize > 0 && plan.queueDepth > 0) {
+                    cachedPlans.emplace(device, plan);   // the first entry for a disk wins
+                }
+            }
+        }
+
+        bool readCache(const std::string& key, Plan& plan) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            loadCache();
+            auto it = cachedPlans.find(key);
+            if (it == cachedPlans.end()) {
+                return false;
+            }
+            plan.chunkSize = it->second.chunkSize;
+            plan.queueDepth = it->second.queueDepth;
+            return true;
+        }
+
+        void writeCache(const std::string& key, const Plan& plan, double megabytesPerSecond) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            loadCache();
+            cachedPlans[key] = plan;
+            std::vector<std::string> lines;
+            {
+                std::ifstream cache(kCacheFile);
+                std::string line;
+                while (std::getline(cache, line)) {
+                    if (line.compare(0, key.size() + 1, key + " ") != 0) {
+                        lines.push_back(line);
+                    }
+                }
+            }
+            std::ostringstream entry;
+            entry << key << " " << plan.chunkSize << " " << plan.queueDepth << " " << static_cast<long long>(megabytesPerSecond);
+            lines.push_back(entry.str());
+
+            std::ofstream cache(kCacheFile, std::ios::trunc);
+            for (const auto& line : lines) {
+                cache << line << "\n";
+            }
+        }
+
+        DeviceInfo readDevice(unsigned long long deviceId) {
+            DeviceInfo info;
+#ifndef _WIN32
+            dev_t device = static_cast<dev_t>(deviceId);
+            std::string base = "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device));
+            // Partitions have no queue of their own; the limits live on the parent disk.
+            bool partition = readSysfsNumber(base + "/partition", 0) != 0;
+            std::string disk = partition ? base + "/.." : base;
+            std::string queue = disk + "/queue";
+
+            unsigned long long logical = readSysfsNumber(queue + "/logical_block_size", 0);
+            if (logical == 0) {
+                return info;
+            }
+            info.known = true;
+            info.key = readSysfsString(disk + "/dev");
+            info.logicalBlockSize = static_cast<unsigned long>(logical);
+            info.optimalIoSize = readSysfsNumber(queue + "/optimal_io_size", 0);
+            info.maxIoSize = readSysfsNumber(queue + "/max_sectors_kb", 0) * 1024;
+            info.rotational = readSysfsNumber(queue + "/rotational", 0) != 0;
+            info.writeZeroesMaxBytes = readSysfsNumber(queue + "/write_zeroes_max_bytes", 0);
+            info.discardMaxBytes = readSysfsNumber(queue + "/discard_max_bytes", 0);
+            info.discardGranularity = readSysfsNumber(queue + "/discard_granularity", 0);
+            std::ifstream uevent(disk + "/uevent");
+            std::string line;
+            while (std::getline(uevent, line)) {
+                if (line.compare(0, 12, "DEVNAME=nvme") == 0) {
+                    info.nvme = true;
+                }
+            }
+            if (info.key.empty()) {
+                info.key = std::to_string(major(device)) + ":" + std::to_string(minor(device));
+            }
+            // The nearest ancestor of the disk's device (PCI function, NVMe controller) that reports a node
+            std::error_code error;
+            std::filesystem::path parent = std::filesystem::canonical(disk + "/device", error);
+            for (; !error && parent.has_relative_path(); parent = parent.parent_path()) {
+                std::ifstream nodeFile(parent / "numa_node");
+                long node = -1;
+                if (nodeFile >> node) {
+                    info.numaNode = node >= 0 ? static_cast<int>(node) : -1;
+                    break;
+                }
+            }
+#else
+            (void)deviceId;
+#endif
+            return info;
+        }
+    }
+
+    unsigned long long targetDeviceId(const std::string& path) {
+#ifdef _WIN32
+        return utils::getDeviceId(path);
+#else
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            return 0;
+        }
+        return static_cast<unsigned long long>(S_ISBLK(info.st_mode) ? info.st_rdev : info.st_dev);
+#endif
+    }
+
+    DeviceInfo probeDevice(unsigned long long deviceId) {
+        {
+            std::lock_guard<std::mutex> lock(devicesMutex);
+            auto it = devices.find(deviceId);
+            if (it != devices.end()) {
+                return it->second;
+            }
+        }
+        DeviceInfo info = readDevice(deviceId);
+        std::lock_guard<std::mutex> lock(devicesMutex);
+        return devices.emplace(deviceId, info).first->second;
+    }
+
+    unsigned long long availableMemory() {
+#ifdef _WIN32
+        MEMORYSTATUSEX status;
+        status.dwLength = sizeof(status);
+        if (GlobalMemoryStatusEx(&status)) {
+            return status.ullAvailPhys;
+        }
+        return 0;
+#else
+        std::ifstream meminfo("/proc/meminfo");
+        std::string name;
+        unsigned long long value = 0;
+        std::string unit;
+        while (meminfo >> name >> value >> unit) {
+            if (name == "MemAvailable:") {
+                return value * 1024;
+            }
+        }
+        long pages = sysconf(_SC_AVPHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        return (pages > 0 && pageSize > 0) ? static_cast<unsigned long long>(pages) * pageSize : 0;
+#endif
+    }
+
+    Plan tune(unsigned long long deviceId, unsigned long long targetSize) {
+        DeviceInfo info = probeDevice(deviceId);
+        Plan plan;
+
+        if (!(info.known && readCache(info.key, plan))) {
+            // Spinning disks want long sequential requests and few of them; flash wants parallelism.
+            plan.chunkSize = info.rotational ? 16 * 1024 * 1024 : 8 * 1024 * 1024;
+            plan.queueDepth = !info.known ? 4 : info.rotational ? 2 : info.nvme ? 16 : 8;
+            if (info.optimalIoSize > 0) {
+                // Whole stripes, so a RAID array never has to read-modify-write
+                plan.chunkSize = roundUp(plan.chunkSize, static_cast<size_t>(info.optimalIoSize));
+            }
+        }
+        else {
+            plan.calibrated = true;
+        }
+
+        // Never allocate more than the target needs.
+        size_t alignment = std::max<size_t>(info.logicalBlockSize, kMinChunkSize);
+        if (targetSize > 0 && targetSize < plan.chunkSize) {
+            plan.chunkSize = roundUp(static_cast<size_t>(targetSize), alignment);
+        }
+
+        // Keep every buffer the pipeline may hold under an eighth of the free memory.
+        unsigned long long memory = availableMemory();
+        size_t buffers = plan.queueDepth + write_pipeline::kMaxDefaultGenerators + 2;
+        while (memory > 0 && plan.chunkSize > 1024 * 1024 && static_cast<unsigned long long>(plan.chunkSize) * buffers > memory / 8) {
+            plan.chunkSize /= 2;
+        }
+
+        plan.chunkSize = std::min(std::max(roundUp(plan.chunkSize, alignment), kMinChunkSize), kMaxChunkSize);
+        if (targetSize > 0) {
+            unsigned long long chunks = (targetSize + plan.chunkSize - 1) / plan.chunkSize;
+            plan.queueDepth = static_cast<size_t>(std::min<unsigned long long>(plan.queueDepth, chunks));
+        }
+        plan.queueDepth = std::max<size_t>(plan.queueDepth, 1);
+        return plan;
+    }
+
+    Plan calibrate(const std::string& path, unsigned long long targetSize) {
+        unsigned long long deviceId = targetDeviceId(path);
+        Plan plan = tune(deviceId, targetSize);
+#ifndef _WIN32
+        const size_t maxProbeSize = 32 * 1024 * 1024;
+        const unsigned long long probeRegion = std::min<unsigned long long>(targetSize, 256ULL * 1024 * 1024) / maxProbeSize * maxProbeSize;
+        DeviceInfo info = probeDevice(deviceId);
+        if (!info.known || probeRegion == 0) {
+            return plan;
+        }
+
+        int fd = open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        if (fd < 0) {
+            fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        }
+        if (fd < 0) {
+            logger::warning("Calibration skipped: cannot open target", { path });
+            return plan;
+        }
+
+        utils::AlignedBuffer buffer = utils::allocateAligned(maxProbeSize);
+        random_engine::fill(random_engine::newKeystream(), buffer.get(), maxProbeSize);
+
+        const size_t candidates[] = { 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024, 16 * 1024 * 1024, maxProbeSize };
+        size_t bestChunk = 0;
+        double bestRate = 0.0;
+        for (size_t chunk : candidates) {
+            if (info.optimalIoSize > 0 && chunk % info.optimalIoSize != 0) {
+                continue;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            bool failed = false;
+            for (unsigned long long offset = 0; offset < probeRegion && !failed; offset += chunk) {
+                failed = pwrite(fd, buffer.get(), chunk, static_cast<off_t>(offset)) != static_cast<ssize_t>(chunk);
+            }
+            failed = failed || fdatasync(fd) != 0;
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            if (failed || seconds <= 0) {
+                continue;
+            }
+            double rate = probeRegion / seconds / (1024 * 1024);
+            logger::info("Calibration " + info.key + ": " + utils::formatSize(chunk) + " chunks -> " +
+                std::to_string(static_cast<long long>(rate)) + " MB/s", { path, {}, probeRegion, seconds });
+            // A larger chunk has to win by more than 5% to justify its memory.
+            if (rate > bestRate * 1.05) {
+                bestRate = rate;
+                bestChunk = chunk;
+            }
+        }
+        close(fd);
+
+        if (bestChunk != 0) {
+            // The cache holds the device's answer; the target-size clamps are reapplied by tune().
+            Plan cached;
+            cached.chunkSize = bestChunk;
+            cached.queueDepth = tune(deviceId, 0).queueDepth;
+            writeCache(info.key, cached, bestRate);
+            plan = tune(deviceId, targetSize);
+        }
+#else
+        (void)deviceId;
+#endif
+        return plan;
+    }
+
+    std::string describe(const Plan& plan) {
+        return utils::formatSize(plan.chunkSize) + " chunks, queue depth " + std::to_string(plan.queueDepth) +
+            (plan.calibrated ? " (calibrated)" : " (heuristic)");
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// io_tuning.h
+// Picks the chunk size and queue depth for a target from its size, the device's queue limits
+// in sysfs and the memory available. An optional calibration probe measures a few chunk sizes
+// on the device and caches the winner in shredder_tuning.cache, which later runs reuse.
+namespace io_tuning {
+    struct DeviceInfo {
+        bool known = false;
+        std::string key;                        // "major:minor" of the whole disk
+        unsigned long logicalBlockSize = 512;
+        unsigned long long optimalIoSize = 0;   // stripe width on RAID, 0 when not reported
+        unsigned long long maxIoSize = 0;       // largest single request the queue accepts
+        bool rotational = false;
+        bool nvme = false;
+        unsigned long long writeZeroesMaxBytes = 0; // > 0 when the device zeroes ranges itself (WRITE ZEROES)
+        unsigned long long discardMaxBytes = 0;     // > 0 when the device accepts discards
+        unsigned long long discardGranularity = 0;
+        int numaNode = -1;                          // node of the controller the disk hangs off, -1 when unknown
+    };
+
+    struct Plan {
+        size_t chunkSize = 0;
+        size_t queueDepth = 0;
+        bool calibrated = false;
+    };
+
+    const size_t kMinChunkSize = 4096;
+    const size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+    // Device of a target path: st_rdev for block devices, st_dev for everything else.
+    unsigned long long targetDeviceId(const std::string& path);
+    // Reads sysfs on the first call for a device; later calls return the same answer.
+    DeviceInfo probeDevice(unsigned long long deviceId);
+    unsigned long long availableMemory();
+
+    Plan tune(unsigned long long deviceId, unsigned long long targetSize);
+    // Overwrites up to the first 256 MB of path at a few chunk sizes; only call on data being shredded anyway.
+    Plan calibrate(const std::string& path, unsigned long long targetSize);
+    std::string describe(const Plan& plan);
+}
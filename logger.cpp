@@ -0,0 +1,357 @@
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace logger {
+    namespace {
+        using Clock = std::chrono::system_clock;
+
+        struct Record {
+            Clock::time_point time;
+            Level level = Level::Info;
+            std::string message;
+            Fields fields;
+        };
+
+        const char* levelName(Level level) {
+            switch (level) {
+            case Level::Debug: return "debug";
+            case Level::Info: return "info";
+            case Level::Warning: return "warning";
+            case Level::Error: return "error";
+            }
+            return "info";
+        }
+
+        void appendEscaped(std::string& out, const std::string& text) {
+            for (unsigned char c : text) {
+                switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out += escaped;
+                    }
+                    else {
+                        out += static_cast<char>(c);
+                    }
+                }
+            }
+        }
+
+        void appendTimestamp(std::string& out, Clock::time_point time) {
+            std::time_t seconds = Clock::to_time_t(time);
+            long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+            std::tm utc{};
+#ifdef _WIN32
+            gmtime_s(&utc, &seconds);
+#else
+            gmtime_r(&seconds, &utc);
+#endif
+            char buffer[32];
+            std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+            out += buffer;
+            std::snprintf(buffer, sizeof(buffer), ".%03lldZ", millis);
+            out += buffer;
+        }
+
+        void appendRecord(std::string& out, const Record& record) {
+            out += "{\"ts\":\"";
+            appendTimestamp(out, record.time);
+            out += "\",\"level\":\"";
+            out += levelName(record.level);
+            out += "\",\"msg\":\"";
+            appendEscaped(out, record.message);
+            out += '"';
+            if (!record.fields.target.empty()) {
+                out += ",\"target\":\"";
+                appendEscaped(out, record.fields.target);
+                out += '"';
+            }
+            if (record.fields.pass) {
+                out += ",\"pass\":" + std::to_string(*record.fields.pass);
+            }
+            if (record.fields.bytes) {
+                out += ",\"bytes\":" + std::to_string(*record.fields.bytes);
+            }
+            if (record.fields.seconds) {
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%.3f", *record.fields.seconds);
+                out += ",\"duration_s\":";
+                out += buffer;
+            }
+            out += "}\n";
+        }
+
+        // Bounded multi-producer single-consumer ring (Vyukov's sequence-numbered cells): producers
+        // claim a ticket with one CAS and publish the cell by bumping its sequence; no locks on push.
+        class Ring {
+        public:
+            explicit Ring(size_t capacity) {
+                size_t size = 2;
+                while (size < capacity) {
+                    size *= 2;
+                }
+                cells_ = std::vector<Cell>(size);
+                mask_ = size - 1;
+                for (size_t i = 0; i < size; ++i) {
+                    cells_[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            size_t capacity() const { return mask_ + 1; }
+
+            bool tryPush(Record& record) {
+                size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+                Cell* cell;
+                while (true) {
+                    cell = &cells_[pos & mask_];
+                    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                    intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                    if (diff == 0) {
+                        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    }
+                    else if (diff < 0) {
+                        return false; // full
+                    }
+                    else {
+                        pos = enqueuePos_.load(std::memory_order_relaxed);
+                    }
+                }
+                cell->record = std::move(record);
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Consumer side only
+            bool tryPop(Record& record) {
+                Cell& cell = cells_[dequeuePos_ & mask_];
+                if (cell.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+                    return false;
+                }
+                record = std::move(cell.record);
+                cell.sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+                dequeuePos_++;
+                return true;
+            }
+
+            // Tickets handed out so far; every one of them is published shortly after.
+            size_t claimed() const { return enqueuePos_.load(std::memory_order_acquire); }
+            size_t consumed() const { return dequeuePos_; }
+
+        private:
+            struct Cell {
+                std::atomic<size_t> sequence{ 0 };
+                Record record;
+            };
+
+            std::vector<Cell> cells_;
+            size_t mask_ = 0;
+            alignas(64) std::atomic<size_t> enqueuePos_{ 0 };
+            alignas(64) size_t dequeuePos_ = 0;
+        };
+
+        class Logger {
+        public:
+            explicit Logger(const Config& config) : config_(config), ring_(config.capacity) {
+                file_.open(config_.path, std::ios::app | std::ios::binary);
+                writer_ = std::thread(&Logger::writerLoop, this);
+            }
+
+            ~Logger() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stopping_ = true;
+                }
+                wake_.notify_one();
+                writer_.join();
+            }
+
+            void push(Level level, const std::string& message, const Fields& fields) {
+                if (level < config_.minLevel) {
+                    return;
+                }
+                Record record{ Clock::now(), level, message, fields };
+                while (!ring_.tryPush(record)) {
+                    if (config_.policy == OverflowPolicy::Drop) {
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    wake_.notify_one();
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                // Wake the writer early once the ring is half full; otherwise it drains on its interval.
+                if (ring_.claimed() - ring_.consumed() >= ring_.capacity() / 2 || level == Level::Error) {
+                    wake_.notify_one();
+                }
+            }
+
+            void flush() {
+                std::unique_lock<std::mutex> lock(mutex_);
+                size_t target = ring_.claimed();
+                if (target > flushTarget_) {
+                    flushTarget_ = target;
+                }
+                wake_.notify_one();
+                flushed_.wait(lock, [&]() { return flushedUpTo_ >= target; });
+            }
+
+            unsigned long long dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+        private:
+            void writerLoop() {
+                std::string batch;
+                Record record;
+                unsigned long long reportedDrops = 0;
+                while (true) {
+                    size_t target;
+                    bool stopping;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        wake_.wait_for(lock, std::chrono::milliseconds(config_.flushIntervalMs), [&]() {
+                            return stopping_ || flushTarget_ > flushedUpTo_ ||
+                                ring_.claimed() - ring_.consumed() >= ring_.capacity() / 2;
+                        });
+                        target = flushTarget_;
+                        stopping = stopping_;
+                    }
+                    if (stopping) {
+                        target = ring_.claimed();
+                    }
+
+                    // Drain what is published; wait out producers that hold a ticket the flush needs.
+                    while (true) {
+                        while (ring_.tryPop(record)) {
+                            appendRecord(batch, record);
+                        }
+                        if (ring_.consumed() >= target) {
+                            break;
+                        }
+                        std::this_thread::yield();
+                    }
+
+                    unsigned long long drops = dropped();
+                    if (drops != reportedDrops) {
+                        Record notice{ Clock::now(), Level::Warning,
+                            "Log ring full; " + std::to_string(drops - reportedDrops) + " records dropped", {} };
+                        appendRecord(batch, notice);
+                        reportedDrops = drops;
+                    }
+
+                    if (!batch.empty() && file_.is_open()) {
+                        file_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+                        file_.flush();
+                    }
+                    batch.clear();
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        flushedUpTo_ = ring_.consumed();
+                    }
+                    flushed_.notify_all();
+                    if (stopping) {
+                        return;
+                    }
+                }
+            }
+
+            Config config_;
+            Ring ring_;
+            std::ofstream file_;
+            std::thread writer_;
+            std::atomic<unsigned long long> dropped_{ 0 };
+
+            std::mutex mutex_;
+            std::condition_variable wake_;
+            std::condition_variable flushed_;
+            size_t flushTarget_ = 0;
+            size_t flushedUpTo_ = 0;
+            bool stopping_ = false;
+        };
+
+        std::mutex instanceMutex;
+        std::atomic<Logger*> instance{ nullptr };
+        bool exitHookInstalled = false;
+
+        void installLocked(const Config& config) {
+            delete instance.exchange(nullptr);
+            instance.store(new Logger(config), std::memory_order_release);
+            if (!exitHookInstalled) {
+                std::atexit(shutdown);
+                exitHookInstalled = true;
+            }
+        }
+
+        Logger* current() {
+            Logger* logger = instance.load(std::memory_order_acquire);
+            if (logger == nullptr) {
+                std::lock_guard<std::mutex> lock(instanceMutex);
+                logger = instance.load(std::memory_order_acquire);
+                if (logger == nullptr) {
+                    installLocked(Config{});
+                    logger = instance.load(std::memory_order_acquire);
+                }
+            }
+            return logger;
+        }
+    }
+
+    void configure(const Config& config) {
+        std::lock_guard<std::mutex> lock(instanceMutex);
+        installLocked(config);
+    }
+
+    void log(Level level, const std::string& message, const Fields& fields) {
+        current()->push(level, message, fields);
+    }
+
+    void debug(const std::string& message, const Fields& fields) {
+        log(Level::Debug, message, fields);
+    }
+
+    void info(const std::string& message, const Fields& fields) {
+        log(Level::Info, message, fields);
+    }
+
+    void warning(const std::string& message, const Fields& fields) {
+        log(Level::Warning, message, fields);
+    }
+
+    void error(const std::string& message, const Fields& fields) {
+        log(Level::Error, message, fields);
+    }
+
+    void flush() {
+        Logger* logger = instance.load(std::memory_order_acquire);
+        if (logger != nullptr) {
+            logger->flush();
+        }
+    }
+
+    void shutdown() {
+        std::lock_guard<std::mutex> lock(instanceMutex);
+        delete instance.exchange(nullptr);
+    }
+
+    unsigned long long droppedRecords() {
+        Logger* logger = instance.load(std::memory_order_acquire);
+        return logger != nullptr ? logger->dropped() : 0;
+    }
+}
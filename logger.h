@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
+
+// logger.h
+// Asynchronous JSON-lines logger. Callers push records into a bounded lock-free ring; a background
+// thread formats them and appends them to the log file in batches, one write and one flush per batch.
+// Each line carries a UTC timestamp, the level, the message and any structured fields that were set:
+//   {"ts":"2024-05-01T12:00:00.123Z","level":"info","msg":"Pass completed","target":"a.bin","pass":2,"bytes":1048576,"duration_s":0.412}
+namespace logger {
+    enum class Level { Debug, Info, Warning, Error };
+
+    // What a full ring does to a new record: drop it (counted and reported in the log), or make the
+    // caller wait until the writer thread has made room.
+    enum class OverflowPolicy { Drop, Block };
+
+    struct Config {
+        std::string path = "shredder.log";
+        size_t capacity = 8192;             // records held in memory, rounded up to a power of two
+        OverflowPolicy policy = OverflowPolicy::Block;
+        Level minLevel = Level::Info;
+        unsigned flushIntervalMs = 200;     // longest a record waits before it reaches the file
+    };
+
+    struct Fields {
+        Fields() = default;
+        Fields(std::string target, std::optional<unsigned long long> pass = {}, std::optional<unsigned long long> bytes = {},
+            std::optional<double> seconds = {})
+            : target(std::move(target)), pass(pass), bytes(bytes), seconds(seconds) {}
+
+        std::string target;
+        std::optional<unsigned long long> pass;
+        std::optional<unsigned long long> bytes;
+        std::optional<double> seconds;
+    };
+
+    // Replaces the running logger after flushing it. Call before worker threads start logging.
+    void configure(const Config& config);
+
+    void log(Level level, const std::string& message, const Fields& fields = {});
+    void debug(const std::string& message, const Fields& fields = {});
+    void info(const std::string& message, const Fields& fields = {});
+    void warning(const std::string& message, const Fields& fields = {});
+    void error(const std::string& message, const Fields& fields = {});
+
+    // Blocks until every record logged before the call is in the file.
+    void flush();
+    // Flushes and stops the writer thread; also runs automatically at exit.
+    void shutdown();
+    unsigned long long droppedRecords();
+}
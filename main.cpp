@@ -1,7 +1,20 @@
-#include "menu.h"
-
-int main()
-{
-	menu::run();
-	return 0;
+#include "menu.h"
+#include "cli.h"
+#include "logger.h"
+#include "metrics.h"
+
+int main(int argc, char* argv[])
+{
+	int code = 0;
+	{
+		metrics::Session metricsSession;
+		if (argc > 1) {
+			code = cli::run(argc, argv);
+		}
+		else {
+			menu::run();
+		}
+	}
+	logger::shutdown();
+	return code;
 }
\ No newline at end of file
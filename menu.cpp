@@ -1,144 +1,286 @@
-#include "menu.h"
-#include "utils.h"
-#include "file_shredder.h"
-#include <iostream>
-#include <filesystem>
-#include <string>
-#include <limits>
-
-namespace menu {
-    void displayMenu() {
-        std::cout << "=========================\n";
-        std::cout << " Secure File Shredder\n";
-        std::cout << "=========================\n";
-        std::cout << "1. Securely delete a file\n";
-        std::cout << "2. Securely shred a folder\n";
-        std::cout << "3. Securely delete a partition\n";
-        std::cout << "4. Exit\n";
-        std::cout << "=========================\n";
-    }
-
-    void run() {
-        if (!utils::isAdmin()) {
-            std::cerr << "This program requires administrative privileges. Please run as administrator.\n";
-            return;
-        }
-
-        while (true) {
-            displayMenu();
-            int choice;
-            std::cout << "Enter your choice: ";
-            std::cin >> choice;
-
-            std::string customPatternStr;
-            std::vector<unsigned char> customPattern;
-
-            if (choice >= 1 && choice <= 3) {
-                std::cout << "Enter a custom pattern for overwriting, or leave empty for random data: ";
-                std::cin.ignore(1000000, '\n');
-                std::getline(std::cin, customPatternStr);
-                if (!customPatternStr.empty()) {
-                    customPattern.assign(customPatternStr.begin(), customPatternStr.end());
-                }
-            }
-
-            switch (choice) {
-            case 1: {
-                std::cout << "Enter the full path of the file to shred: ";
-                std::string filepath;
-                std::getline(std::cin, filepath);
-
-                if (!std::filesystem::exists(filepath)) {
-                    std::cerr << "Error: File not found. Please check the path and try again.\n";
-                    continue;
-                }
-
-                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
-                size_t passes;
-                std::cin >> passes;
-                if (passes < 1) {
-                    std::cerr << "Error: Passes must be at least 1.\n";
-                    continue;
-                }
-
-                std::cout << "WARNING: This will permanently delete the file and it cannot be recovered.\n";
-                std::cout << "Are you sure you want to continue? (y/n): ";
-                char confirm;
-                std::cin >> confirm;
-                if (std::tolower(confirm) == 'y') {
-                    file_shredder::securelyDelete(filepath, passes, customPattern);
-                }
-                else {
-                    std::cout << "Operation canceled.\n";
-                }
-                break;
-            }
-            case 2: {
-                std::cout << "Enter the full path of the folder to shred: ";
-                std::string folderPath;
-                std::getline(std::cin, folderPath);
-
-                if (!std::filesystem::exists(folderPath)) {
-                    std::cerr << "Error: Folder not found. Please check the path and try again.\n";
-                    continue;
-                }
-
-                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
-                size_t passes;
-                std::cin >> passes;
-                if (passes < 1) {
-                    std::cerr << "Error: Passes must be at least 1.\n";
-                    continue;
-                }
-
-                std::cout << "WARNING: This will permanently delete the folder and its contents, and it cannot be recovered.\n";
-                std::cout << "Are you sure you want to continue? (y/n): ";
-                char confirm;
-                std::cin >> confirm;
-                if (std::tolower(confirm) == 'y') {
-                    file_shredder::shredFolder(folderPath, passes, customPattern);
-                }
-                else {
-                    std::cout << "Operation canceled.\n";
-                }
-                break;
-            }
-            case 3: {
-                std::cout << "Enter the partition path (e.g., \\\\.\\F:): ";
-                std::string partitionPath;
-                std::getline(std::cin, partitionPath);
-
-                if (partitionPath.empty()) {
-                    std::cerr << "Error: No partition path provided. Please enter a valid partition path.\n";
-                    continue;
-                }
-
-                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
-                size_t passes;
-                std::cin >> passes;
-                if (passes < 1) {
-                    std::cerr << "Error: Passes must be at least 1.\n";
-                    continue;
-                }
-
-                std::cout << "WARNING: This will permanently delete the partition and its contents, and it cannot be recovered.\n";
-                std::cout << "Are you sure you want to continue? (y/n): ";
-                char confirm;
-                std::cin >> confirm;
-                if (std::tolower(confirm) == 'y') {
-                    file_shredder::shredPartition(partitionPath, passes);
-                }
-                else {
-                    std::cout << "Operation canceled.\n";
-                }
-                break;
-            }
-            case 4:
-                std::cout << "Exiting the Secure File Shredder...\n";
-                return;
-            default:
-                std::cout << "Invalid choice, please try again.\n";
-            }
-        }
-    }
-}
+#include "menu.h"
+#include "utils.h"
+#include "file_shredder.h"
+#include "random_engine.h"
+#include "verifier.h"
+#include "checkpoint.h"
+#include "batch.h"
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <limits>
+#include <cctype>
+
+namespace menu {
+    namespace {
+        verifier::Options askVerify() {
+            std::cout << "Read back and verify the result? (n = no, s = sampled, f = full, a = full after every pass): ";
+            char answer;
+            std::cin >> answer;
+            verifier::Options options;
+            switch (std::tolower(answer)) {
+            case 's': options.mode = verifier::Mode::Sampled; break;
+            case 'f': options.mode = verifier::Mode::Full; break;
+            case 'a': options.mode = verifier::Mode::Full; options.everyPass = true; break;
+            default: break;
+            }
+            return options;
+        }
+
+        // Offers to resume when an interrupted run left a journal for this target, otherwise to start one
+        checkpoint::Options askCheckpoint(const std::string& target) {
+            checkpoint::Options options;
+            char answer;
+            if (checkpoint::pending(options, target)) {
+                std::cout << "An interrupted run left a checkpoint for this target. Resume it? (y/n): ";
+                std::cin >> answer;
+                options.enabled = true;
+                options.resume = std::tolower(answer) == 'y';
+            }
+            else {
+                std::cout << "Keep a checkpoint journal so an interrupted run can be resumed? (y/n): ";
+                std::cin >> answer;
+                options.enabled = std::tolower(answer) == 'y';
+            }
+            return options;
+        }
+    }
+
+    void displayMenu() {
+        std::cout << "=========================\n";
+        std::cout << " Secure File Shredder\n";
+        std::cout << "=========================\n";
+        std::cout << "1. Securely delete a file\n";
+        std::cout << "2. Securely shred a folder\n";
+        std::cout << "3. Securely delete a partition\n";
+        std::cout << "4. Wipe free space on a mounted filesystem\n";
+        std::cout << "5. Run random generator self-test\n";
+        std::cout << "6. Exit\n";
+        std::cout << "=========================\n";
+    }
+
+    void run() {
+        if (!utils::isAdmin()) {
+            std::cerr << "This program requires administrative privileges. Please run as administrator.\n";
+            return;
+        }
+
+        while (true) {
+            displayMenu();
+            int choice;
+            std::cout << "Enter your choice: ";
+            std::cin >> choice;
+
+            std::string customPatternStr;
+            std::vector<unsigned char> customPattern;
+
+            if (choice >= 1 && choice <= 4) {
+                std::cout << "Enter a custom pattern for overwriting, or leave empty for random data: ";
+                std::cin.ignore(1000000, '\n');
+                std::getline(std::cin, customPatternStr);
+                if (!customPatternStr.empty()) {
+                    customPattern.assign(customPatternStr.begin(), customPatternStr.end());
+                }
+            }
+
+            switch (choice) {
+            case 1: {
+                std::cout << "Enter the full path of the file to shred: ";
+                std::string filepath;
+                std::getline(std::cin, filepath);
+
+                if (!std::filesystem::exists(filepath)) {
+                    std::cerr << "Error: File not found. Please check the path and try again.\n";
+                    continue;
+                }
+
+                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
+                size_t passes;
+                std::cin >> passes;
+                if (passes < 1) {
+                    std::cerr << "Error: Passes must be at least 1.\n";
+                    continue;
+                }
+
+                file_shredder::ShredOptions options;
+                options.verify = askVerify();
+                options.checkpoint = askCheckpoint(filepath);
+
+                std::cout << "WARNING: This will permanently delete the file and it cannot be recovered.\n";
+                std::cout << "Are you sure you want to continue? (y/n): ";
+                char confirm;
+                std::cin >> confirm;
+                if (std::tolower(confirm) == 'y') {
+                    file_shredder::securelyDelete(filepath, passes, customPattern, options);
+                }
+                else {
+                    std::cout << "Operation canceled.\n";
+                }
+                break;
+            }
+            case 2: {
+                std::cout << "Enter the full path of the folder to shred: ";
+                std::string folderPath;
+                std::getline(std::cin, folderPath);
+
+                if (!std::filesystem::exists(folderPath)) {
+                    std::cerr << "Error: Folder not found. Please check the path and try again.\n";
+                    continue;
+                }
+
+                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
+                size_t passes;
+                std::cin >> passes;
+                if (passes < 1) {
+                    std::cerr << "Error: Passes must be at least 1.\n";
+                    continue;
+                }
+
+                std::cout << "WARNING: This will permanently delete the folder and its contents, and it cannot be recovered.\n";
+                std::cout << "Are you sure you want to continue? (y/n): ";
+                char confirm;
+                std::cin >> confirm;
+                if (std::tolower(confirm) == 'y') {
+                    file_shredder::shredFolder(folderPath, passes, customPattern);
+                }
+                else {
+                    std::cout << "Operation canceled.\n";
+                }
+                break;
+            }
+            case 3: {
+#ifdef _WIN32
+                std::cout << "Enter the partition path (e.g., \\\\.\\F:), or several separated by spaces (quote paths with spaces): ";
+#else
+                std::cout << "Enter the block device or image file path (e.g., /dev/sdb1), or several separated by spaces (quote paths with spaces): ";
+#endif
+                std::string partitionList;
+                std::getline(std::cin, partitionList);
+                std::vector<std::string> partitionPaths;
+                try {
+                    // Same rules as a manifest line
+                    partitionPaths = batch::splitWords(partitionList);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << " in the partition list.\n";
+                    continue;
+                }
+
+                if (partitionPaths.empty()) {
+                    std::cerr << "Error: No partition path provided. Please enter a valid partition path.\n";
+                    continue;
+                }
+                const std::string& partitionPath = partitionPaths.front();
+
+                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
+                size_t passes;
+                std::cin >> passes;
+                if (passes < 1) {
+                    std::cerr << "Error: Passes must be at least 1.\n";
+                    continue;
+                }
+
+                file_shredder::ShredOptions options;
+                std::cout << "Run a short write-speed calibration to tune the I/O size first? (y/n): ";
+                char calibrate;
+                std::cin >> calibrate;
+                options.calibrate = std::tolower(calibrate) == 'y';
+                options.verify = askVerify();
+
+                std::cout << "Discard (TRIM) the device once it has been shredded? (y/n): ";
+                char discard;
+                std::cin >> discard;
+                options.discard = std::tolower(discard) == 'y';
+                if (partitionPaths.size() == 1) {
+                    options.checkpoint = askCheckpoint(partitionPath);
+                }
+                else {
+                    // Several devices: a journal is only resumed when it matches its device and scheme
+                    std::cout << "Keep checkpoint journals, resuming any interrupted runs on these devices? (y/n): ";
+                    char answer;
+                    std::cin >> answer;
+                    options.checkpoint.enabled = options.checkpoint.resume = std::tolower(answer) == 'y';
+                }
+
+                std::cout << "WARNING: This will permanently delete the partition and its contents, and it cannot be recovered.\n";
+                std::cout << "Are you sure you want to continue? (y/n): ";
+                char confirm;
+                std::cin >> confirm;
+                if (std::tolower(confirm) == 'y' && partitionPaths.size() == 1) {
+                    file_shredder::shredPartition(partitionPath, passes, {}, options);
+                }
+                else if (std::tolower(confirm) == 'y') {
+                    // Every device at once, each on its own worker
+                    std::vector<batch::Job> jobs;
+                    for (const std::string& path : partitionPaths) {
+                        batch::Job job;
+                        job.kind = batch::Kind::Partition;
+                        job.target = path;
+                        job.passes = passes;
+                        job.verify = options.verify;
+                        job.discard = options.discard;
+                        job.checkpoint = options.checkpoint;
+                        job.calibrate = options.calibrate;
+                        jobs.push_back(job);
+                    }
+                    batch::printResults(batch::run(jobs));
+                }
+                else {
+                    std::cout << "Operation canceled.\n";
+                }
+                break;
+            }
+            case 4: {
+                std::cout << "Enter a directory on the filesystem whose free space should be wiped: ";
+                std::string mountPath;
+                std::getline(std::cin, mountPath);
+
+                if (!std::filesystem::is_directory(mountPath)) {
+                    std::cerr << "Error: Directory not found. Please check the path and try again.\n";
+                    continue;
+                }
+
+                std::cout << "Enter the number of overwrite passes (recommended 3 or more): ";
+                size_t passes;
+                std::cin >> passes;
+                if (passes < 1) {
+                    std::cerr << "Error: Passes must be at least 1.\n";
+                    continue;
+                }
+
+                std::cout << "Free space to leave for other programs (e.g. 1G or 5%; empty for 256 MB): ";
+                std::string reserveText;
+                std::cin.ignore(1000000, '\n');
+                std::getline(std::cin, reserveText);
+                free_space_wiper::Config config;
+                if (!reserveText.empty() && !free_space_wiper::parseReserve(reserveText, config)) {
+                    std::cerr << "Error: Enter a size such as 512M or 2G, or a percentage below 100 such as 5%.\n";
+                    continue;
+                }
+
+                std::cout << "WARNING: This will temporarily fill the filesystem almost completely.\n";
+                std::cout << "Are you sure you want to continue? (y/n): ";
+                char confirm;
+                std::cin >> confirm;
+                if (std::tolower(confirm) == 'y') {
+                    file_shredder::wipeFreeSpace(mountPath, passes, customPattern, config);
+                }
+                else {
+                    std::cout << "Operation canceled.\n";
+                }
+                break;
+            }
+            case 5:
+                random_engine::runSelfTest();
+                break;
+            case 6:
+                std::cout << "Exiting the Secure File Shredder...\n";
+                return;
+            default:
+                std::cout << "Invalid choice, please try again.\n";
+            }
+        }
+    }
+}
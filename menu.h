@@ -1,7 +1,7 @@
-// include/menu.hpp
-#pragma once
-
-namespace menu {
-    void displayMenu();
-    void run();
+// include/menu.hpp
+#pragma once
+
+namespace menu {
+    void displayMenu();
+    void run();
 }
\ No newline at end of file
@@ -0,0 +1,423 @@
+#include "metrics.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace metrics {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        // Values below 8 ns get a bucket each; above, every power of two is split into eight
+        const size_t kSubBuckets = 8;
+        const size_t kBuckets = (64 - 2) * kSubBuckets;
+
+        int highestBit(uint64_t value) {
+            int bit = 0;
+            while (value >>= 1) {
+                bit++;
+            }
+            return bit;
+        }
+
+        size_t bucketOf(uint64_t nanoseconds) {
+            if (nanoseconds < kSubBuckets) {
+                return static_cast<size_t>(nanoseconds);
+            }
+            int magnitude = highestBit(nanoseconds);
+            size_t sub = static_cast<size_t>((nanoseconds >> (magnitude - 3)) & (kSubBuckets - 1));
+            return static_cast<size_t>(magnitude - 2) * kSubBuckets + sub;
+        }
+
+        // Bucket bounds in nanoseconds: [lower, upper)
+        double bucketLower(size_t bucket) {
+            if (bucket < kSubBuckets) {
+                return static_cast<double>(bucket);
+            }
+            int magnitude = static_cast<int>(bucket / kSubBuckets) + 2;
+            return std::ldexp(static_cast<double>(kSubBuckets + bucket % kSubBuckets), magnitude - 3);
+        }
+
+        double bucketUpper(size_t bucket) {
+            if (bucket < kSubBuckets) {
+                return static_cast<double>(bucket + 1);
+            }
+            int magnitude = static_cast<int>(bucket / kSubBuckets) + 2;
+            return std::ldexp(static_cast<double>(kSubBuckets + bucket % kSubBuckets + 1), magnitude - 3);
+        }
+
+        // Written only by the owning thread, so updates are a relaxed load and store, never a locked add
+        void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        struct Histogram {
+            std::atomic<uint64_t> buckets[kBuckets] = {};
+            std::atomic<uint64_t> count{ 0 };
+            std::atomic<uint64_t> sumNanoseconds{ 0 };
+            std::atomic<uint64_t> bytes{ 0 };
+            std::atomic<uint64_t> minNanoseconds{ UINT64_MAX };
+            std::atomic<uint64_t> maxNanoseconds{ 0 };
+        };
+
+        struct Shard {
+            Histogram timers[kTimerCount];
+            uint64_t passNanoseconds = 0;   // owner only, for FileScope
+        };
+
+        // Shards outlive their threads and go to the next thread that starts recording, so short-lived
+        // generator threads do not each leave one behind. Never destroyed: threads may record during exit.
+        struct Registry {
+            std::mutex mutex;
+            std::deque<std::unique_ptr<Shard>> shards;
+            std::vector<Shard*> idle;
+            Clock::time_point start = Clock::now();
+        };
+
+        Registry& registry() {
+            static Registry* instance = new Registry();
+            return *instance;
+        }
+
+        struct LocalShard {
+            Shard* shard = nullptr;
+            ~LocalShard() {
+                if (shard != nullptr) {
+                    Registry& shared = registry();
+                    std::lock_guard<std::mutex> lock(shared.mutex);
+                    shared.idle.push_back(shard);
+                }
+            }
+        };
+
+        thread_local LocalShard localShard;
+
+        Shard& local() {
+            if (localShard.shard == nullptr) {
+                Registry& shared = registry();
+                std::lock_guard<std::mutex> lock(shared.mutex);
+                if (!shared.idle.empty()) {
+                    localShard.shard = shared.idle.back();
+                    shared.idle.pop_back();
+                }
+                else {
+                    shared.shards.push_back(std::make_unique<Shard>());
+                    localShard.shard = shared.shards.back().get();
+                }
+            }
+            return *localShard.shard;
+        }
+
+        const char* timerHelp(Timer timer) {
+            switch (timer) {
+            case Timer::Generate: return "Random data generation, per fill call";
+            case Timer::Write: return "Write calls, or queued writes from submission to completion";
+            case Timer::Flush: return "fsync, fdatasync and msync calls";
+            case Timer::Pass: return "Wall time of one overwrite pass over one target";
+            default: return "Per-file time outside the overwrite passes: open, extent map, rename, remove";
+            }
+        }
+
+        std::string formatSeconds(double seconds) {
+            std::ostringstream text;
+            text << std::fixed << std::setprecision(2);
+            if (seconds < 1e-3) {
+                text << seconds * 1e6 << " us";
+            }
+            else if (seconds < 1) {
+                text << seconds * 1e3 << " ms";
+            }
+            else {
+                text << seconds << " s";
+            }
+            return text.str();
+        }
+
+        // Writes next to the final name and renames, so a scraper never reads a half-written file
+        void writeAtomically(const std::string& path, const std::string& contents) {
+            std::string temporary = path + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                file << contents;
+                if (!file) {
+                    return;
+                }
+            }
+            std::remove(path.c_str());  // rename does not replace on Windows
+            std::rename(temporary.c_str(), path.c_str());
+        }
+
+        class Exporter {
+        public:
+            explicit Exporter(const Config& config) : config_(config) {
+                if (!config_.exportPath.empty()) {
+                    thread_ = std::thread([this]() { loop(); });
+                }
+            }
+
+            ~Exporter() {
+                if (thread_.joinable()) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        stopping_ = true;
+                    }
+                    wake_.notify_all();
+                    thread_.join();
+                }
+                Snapshot last = snapshot();
+                if (!config_.exportPath.empty()) {
+                    exportSnapshot(last);
+                }
+                if (config_.report) {
+                    printReport(last);
+                }
+            }
+
+        private:
+            void loop() {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!wake_.wait_for(lock, std::chrono::seconds(std::max(config_.intervalSeconds, 1u)), [this]() { return stopping_; })) {
+                    lock.unlock();
+                    exportSnapshot(snapshot());
+                    lock.lock();
+                }
+            }
+
+            void exportSnapshot(const Snapshot& current) {
+                writeAtomically(config_.exportPath, config_.format == Format::Json ? toJson(current) : toPrometheus(current));
+            }
+
+            Config config_;
+            std::thread thread_;
+            std::mutex mutex_;
+            std::condition_variable wake_;
+            bool stopping_ = false;
+        };
+
+        std::mutex sessionMutex;
+        size_t sessionDepth = 0;
+        Exporter* exporter = nullptr;
+    }
+
+    const char* timerName(Timer timer) {
+        switch (timer) {
+        case Timer::Generate: return "generate";
+        case Timer::Write: return "write";
+        case Timer::Flush: return "flush";
+        case Timer::Pass: return "pass";
+        default: return "file_overhead";
+        }
+    }
+
+    void record(Timer timer, std::chrono::nanoseconds elapsed, unsigned long long bytes) {
+        Shard& shard = local();
+        Histogram& histogram = shard.timers[static_cast<size_t>(timer)];
+        uint64_t nanoseconds = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(elapsed.count(), 0));
+        bump(histogram.buckets[bucketOf(nanoseconds)], 1);
+        bump(histogram.count, 1);
+        bump(histogram.sumNanoseconds, nanoseconds);
+        bump(histogram.bytes, bytes);
+        if (nanoseconds < histogram.minNanoseconds.load(std::memory_order_relaxed)) {
+            histogram.minNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+        }
+        if (nanoseconds > histogram.maxNanoseconds.load(std::memory_order_relaxed)) {
+            histogram.maxNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+        }
+        if (timer == Timer::Pass) {
+            shard.passNanoseconds += nanoseconds;
+        }
+    }
+
+    FileScope::FileScope() : start_(std::chrono::steady_clock::now()), passNanoseconds_(local().passNanoseconds) {}
+
+    FileScope::~FileScope() {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start_;
+        uint64_t passes = local().passNanoseconds - passNanoseconds_;
+        record(Timer::FileOverhead, elapsed - std::chrono::nanoseconds(std::min<uint64_t>(passes, static_cast<uint64_t>(elapsed.count()))));
+    }
+
+    Snapshot snapshot() {
+        Registry& shared = registry();
+        std::vector<uint64_t> buckets(kBuckets * kTimerCount, 0);
+        Snapshot result;
+        result.timers.resize(kTimerCount);
+        std::vector<uint64_t> sums(kTimerCount, 0);
+        std::vector<uint64_t> minimums(kTimerCount, UINT64_MAX);
+        std::vector<uint64_t> maximums(kTimerCount, 0);
+        {
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            result.uptimeSeconds = std::chrono::duration<double>(Clock::now() - shared.start).count();
+            for (const std::unique_ptr<Shard>& shard : shared.shards) {
+                for (size_t t = 0; t < kTimerCount; ++t) {
+                    const Histogram& histogram = shard->timers[t];
+                    for (size_t b = 0; b < kBuckets; ++b) {
+                        buckets[t * kBuckets + b] += histogram.buckets[b].load(std::memory_order_relaxed);
+                    }
+                    result.timers[t].count += histogram.count.load(std::memory_order_relaxed);
+                    sums[t] += histogram.sumNanoseconds.load(std::memory_order_relaxed);
+                    result.timers[t].bytes += histogram.bytes.load(std::memory_order_relaxed);
+                    minimums[t] = std::min(minimums[t], histogram.minNanoseconds.load(std::memory_order_relaxed));
+                    maximums[t] = std::max(maximums[t], histogram.maxNanoseconds.load(std::memory_order_relaxed));
+                }
+            }
+        }
+
+        for (size_t t = 0; t < kTimerCount; ++t) {
+            TimerStats& stats = result.timers[t];
+            stats.timer = static_cast<Timer>(t);
+            stats.totalSeconds = static_cast<double>(sums[t]) / 1e9;
+            const uint64_t* counts = &buckets[t * kBuckets];
+            // The shards are read while being written, so the buckets, not the count, are the reference
+            uint64_t total = 0;
+            for (size_t b = 0; b < kBuckets; ++b) {
+                total += counts[b];
+            }
+            if (total == 0) {
+                continue;
+            }
+            stats.bucketed = total;
+            struct Quantile { double q; double* value; };
+            Quantile quantiles[] = { { 0.5, &stats.p50 }, { 0.9, &stats.p90 }, { 0.99, &stats.p99 }, { 0.999, &stats.p999 } };
+            size_t next = 0;
+            uint64_t seen = 0;
+            // Exact extremes; the quantiles are bucket midpoints kept within them
+            stats.min = static_cast<double>(std::min(minimums[t], maximums[t])) / 1e9;
+            stats.max = static_cast<double>(maximums[t]) / 1e9;
+            // Prometheus buckets a factor of four apart (every second power of two), from about 1 us to about 69 s
+            int exportBit = 10;
+            for (size_t b = 0; b < kBuckets; ++b) {
+                double middle = std::min(std::max((bucketLower(b) + bucketUpper(b)) / 2 / 1e9, stats.min), stats.max);
+                while (exportBit <= 36 && bucketUpper(b) > std::ldexp(1.0, exportBit)) {
+                    stats.cumulative.emplace_back(std::ldexp(1.0, exportBit) / 1e9, seen);
+                    exportBit += 2;
+                }
+                if (counts[b] == 0) {
+                    continue;
+                }
+                seen += counts[b];
+                while (next < 4 && static_cast<double>(seen) >= quantiles[next].q * static_cast<double>(total)) {
+                    *quantiles[next].value = middle;
+                    next++;
+                }
+            }
+            for (; exportBit <= 36; exportBit += 2) {
+                stats.cumulative.emplace_back(std::ldexp(1.0, exportBit) / 1e9, seen);
+            }
+        }
+        return result;
+    }
+
+    std::string toPrometheus(const Snapshot& snapshot) {
+        std::ostringstream out;
+        out << "# HELP shredder_uptime_seconds Seconds since the shredder started recording\n"
+            << "# TYPE shredder_uptime_seconds gauge\n"
+            << "shredder_uptime_seconds " << snapshot.uptimeSeconds << "\n";
+        for (const TimerStats& stats : snapshot.timers) {
+            std::string name = std::string("shredder_") + timerName(stats.timer);
+            out << "# HELP " << name << "_seconds " << timerHelp(stats.timer) << "\n"
+                << "# TYPE " << name << "_seconds histogram\n";
+            for (const auto& bucket : stats.cumulative) {
+                out << name << "_seconds_bucket{le=\"" << bucket.first << "\"} " << bucket.second << "\n";
+            }
+            // +Inf and _count from the same bucket total as the finite buckets, so the series stays monotonic
+            out << name << "_seconds_bucket{le=\"+Inf\"} " << stats.bucketed << "\n"
+                << name << "_seconds_sum " << stats.totalSeconds << "\n"
+                << name << "_seconds_count " << stats.bucketed << "\n";
+            if (stats.timer != Timer::Flush && stats.timer != Timer::FileOverhead) {
+                out << "# HELP " << name << "_bytes_total Bytes covered by " << timerName(stats.timer) << " samples\n"
+                    << "# TYPE " << name << "_bytes_total counter\n"
+                    << name << "_bytes_total " << stats.bytes << "\n";
+            }
+        }
+        return out.str();
+    }
+
+    std::string toJson(const Snapshot& snapshot) {
+        std::ostringstream out;
+        out << "{\"uptime_s\": " << snapshot.uptimeSeconds << ", \"timers\": {";
+        for (size_t i = 0; i < snapshot.timers.size(); ++i) {
+            const TimerStats& stats = snapshot.timers[i];
+            out << (i == 0 ? "" : ", ") << "\"" << timerName(stats.timer) << "\": {\"count\": " << stats.count
+                << ", \"total_s\": " << stats.totalSeconds << ", \"bytes\": " << stats.bytes
+                << ", \"min_s\": " << stats.min << ", \"p50_s\": " << stats.p50 << ", \"p90_s\": " << stats.p90
+                << ", \"p99_s\": " << stats.p99 << ", \"p999_s\": " << stats.p999 << ", \"max_s\": " << stats.max << "}";
+        }
+        out << "}}\n";
+        return out.str();
+    }
+
+    void printReport(const Snapshot& snapshot) {
+        bool any = false;
+        for (const TimerStats& stats : snapshot.timers) {
+            any = any || stats.count > 0;
+        }
+        if (!any) {
+            return;
+        }
+        std::cout << "=========================\n";
+        std::cout << " Metrics\n";
+        std::cout << "=========================\n";
+        std::cout << "  timer            count       total        p50        p90        p99        max      bytes\n";
+        for (const TimerStats& stats : snapshot.timers) {
+            if (stats.count == 0) {
+                continue;
+            }
+            std::cout << "  " << std::left << std::setw(14) << timerName(stats.timer) << std::right << std::setw(7) << stats.count
+                << std::setw(12) << formatSeconds(stats.totalSeconds) << std::setw(11) << formatSeconds(stats.p50)
+                << std::setw(11) << formatSeconds(stats.p90) << std::setw(11) << formatSeconds(stats.p99)
+                << std::setw(11) << formatSeconds(stats.max) << std::setw(11) << (stats.bytes > 0 ? utils::formatSize(stats.bytes) : "-") << "\n";
+        }
+    }
+
+    Config configFromEnvironment() {
+        Config config;
+        const char* value = std::getenv("SHREDDER_METRICS");
+        if (value == nullptr) {
+            return config;
+        }
+        std::istringstream settings(value);
+        for (std::string setting; std::getline(settings, setting, ',');) {
+            if (setting == "off") {
+                config.report = false;
+            }
+            else if (setting.rfind("prom:", 0) == 0) {
+                config.format = Format::Prometheus;
+                config.exportPath = setting.substr(5);
+            }
+            else if (setting.rfind("json:", 0) == 0) {
+                config.format = Format::Json;
+                config.exportPath = setting.substr(5);
+            }
+            else if (setting.rfind("interval:", 0) == 0) {
+                config.intervalSeconds = static_cast<unsigned>(std::max(1, std::atoi(setting.c_str() + 9)));
+            }
+        }
+        return config;
+    }
+
+    Session::Session(const Config& config) {
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        if (sessionDepth++ == 0) {
+            exporter = new Exporter(config);
+        }
+    }
+
+    Session::~Session() {
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        if (--sessionDepth == 0) {
+            delete exporter;
+            exporter = nullptr;
+        }
+    }
+}
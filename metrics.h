@@ -0,0 +1,97 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// metrics.h
+// Where a run's time goes. The hot paths record durations into per-thread shards: plain stores by
+// the owning thread, no locks or shared cache lines. Each timer keeps an HDR-style log-linear
+// histogram (eight sub-buckets per power of two, within 12.5% of the true value from nanoseconds to
+// centuries) plus a byte count. Readers merge the shards into a snapshot, which is rendered as a
+// report on exit, and optionally written every few seconds as a Prometheus text file (for the node
+// exporter's textfile collector) or a JSON document.
+namespace metrics {
+    enum class Timer {
+        Generate,       // random data generation, per fill call
+        Write,          // one write call, or one queued write from submission to completion
+        Flush,          // fsync, fdatasync and msync
+        Pass,           // wall time of one overwrite pass over one target
+        FileOverhead,   // per file: opening, mapping, renaming and removing, everything but its passes
+    };
+    const size_t kTimerCount = 5;
+
+    const char* timerName(Timer timer);
+
+    void record(Timer timer, std::chrono::nanoseconds elapsed, unsigned long long bytes = 0);
+
+    // Records the time from construction to destruction
+    class Scoped {
+    public:
+        explicit Scoped(Timer timer, unsigned long long bytes = 0) : timer_(timer), bytes_(bytes), start_(std::chrono::steady_clock::now()) {}
+        ~Scoped() { record(timer_, std::chrono::steady_clock::now() - start_, bytes_); }
+        Scoped(const Scoped&) = delete;
+        Scoped& operator=(const Scoped&) = delete;
+
+    private:
+        Timer timer_;
+        unsigned long long bytes_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Records the lifetime of one file on this thread, less the passes recorded meanwhile, as FileOverhead
+    class FileScope {
+    public:
+        FileScope();
+        ~FileScope();
+        FileScope(const FileScope&) = delete;
+        FileScope& operator=(const FileScope&) = delete;
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+        uint64_t passNanoseconds_;
+    };
+
+    struct TimerStats {
+        Timer timer;
+        uint64_t count = 0;
+        double totalSeconds = 0;
+        unsigned long long bytes = 0;
+        double min = 0, p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;     // seconds
+        std::vector<std::pair<double, uint64_t>> cumulative;    // (upper bound in seconds, samples at or below), for export
+        uint64_t bucketed = 0;      // samples in the buckets, the histogram's +Inf and _count; may trail `count` in a live snapshot
+    };
+
+    struct Snapshot {
+        double uptimeSeconds = 0;
+        std::vector<TimerStats> timers;
+    };
+
+    Snapshot snapshot();
+    std::string toPrometheus(const Snapshot& snapshot);
+    std::string toJson(const Snapshot& snapshot);
+    void printReport(const Snapshot& snapshot);
+
+    enum class Format { Prometheus, Json };
+
+    struct Config {
+        bool report = true;                 // print the report when the session ends
+        std::string exportPath;             // empty = no periodic export
+        Format format = Format::Prometheus;
+        unsigned intervalSeconds = 10;
+    };
+
+    // From SHREDDER_METRICS, comma separated: "off" (no report), "prom:<path>", "json:<path>", "interval:<seconds>".
+    // Unset means a report on exit and no export.
+    Config configFromEnvironment();
+
+    // Exports periodically while alive; at the end exports once more and prints the report.
+    class Session {
+    public:
+        explicit Session(const Config& config = configFromEnvironment());
+        ~Session();
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+    };
+}
@@ -0,0 +1,336 @@
+#include "mmap_writer.h"
+#include "metrics.h"
+#include "volume_utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHRED_X86_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHRED_TARGET_SSE2
+#define SHRED_TARGET_AVX2
+#else
+#define SHRED_TARGET_SSE2 __attribute__((target("sse2")))
+#define SHRED_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mmap_writer {
+    namespace {
+        const size_t kScratchSize = 64 * 1024;
+        // Window starts must be multiples of the mapping granularity (the page size, 64 KB on Windows)
+        const size_t kWindowAlignment = 2 * 1024 * 1024;
+
+        using CopyFn = void (*)(unsigned char*, const unsigned char*, size_t);
+
+        void copyScalar(unsigned char* dst, const unsigned char* src, size_t length) {
+            std::memcpy(dst, src, length);
+        }
+
+#ifdef SHRED_X86_KERNELS
+        // Streaming stores need an aligned destination: the unaligned head and the tail use memcpy.
+        SHRED_TARGET_SSE2 void copySSE2(unsigned char* dst, const unsigned char* src, size_t length) {
+            size_t head = std::min(length, static_cast<size_t>((16 - reinterpret_cast<uintptr_t>(dst) % 16) % 16));
+            std::memcpy(dst, src, head);
+            size_t i = head;
+            for (; i + 64 <= length; i += 64) {
+                for (size_t lane = 0; lane < 64; lane += 16) {
+                    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + lane), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + lane)));
+                }
+            }
+            _mm_sfence();
+            std::memcpy(dst + i, src + i, length - i);
+        }
+
+        SHRED_TARGET_AVX2 void copyAVX2(unsigned char* dst, const unsigned char* src, size_t length) {
+            size_t head = std::min(length, static_cast<size_t>((32 - reinterpret_cast<uintptr_t>(dst) % 32) % 32));
+            std::memcpy(dst, src, head);
+            size_t i = head;
+            for (; i + 128 <= length; i += 128) {
+                for (size_t lane = 0; lane < 128; lane += 32) {
+                    _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + lane), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + lane)));
+                }
+            }
+            _mm_sfence();
+            std::memcpy(dst + i, src + i, length - i);
+        }
+#endif
+
+        struct Kernel {
+            CopyFn copy;
+            const char* name;
+        };
+
+        const Kernel& kernel() {
+            static const Kernel selected = [] {
+#ifdef SHRED_X86_KERNELS
+                if (random_engine::kernelSupported(random_engine::Kernel::AVX2)) {
+                    return Kernel{ copyAVX2, "avx2-stream" };
+                }
+                if (random_engine::kernelSupported(random_engine::Kernel::SSE2)) {
+                    return Kernel{ copySSE2, "sse2-stream" };
+                }
+#endif
+                return Kernel{ copyScalar, "memcpy" };
+            }();
+            return selected;
+        }
+    }
+
+    void streamCopy(unsigned char* dst, const unsigned char* src, size_t length) {
+        kernel().copy(dst, src, length);
+    }
+
+    namespace {
+        // A store into a shared mapping the file system cannot back (EIO, ENOSPC on copy-on-write or
+        // thin-provisioned storage, a concurrent truncate) faults: SIGBUS on POSIX, an in-page error on
+        // Windows. Window fills run under a guard so the fault fails this file instead of the process.
+#if defined(_WIN32) && defined(_MSC_VER)
+        bool guardedCopy(unsigned char* dst, const unsigned char* src, size_t length) {
+            __try {
+                streamCopy(dst, src, length);
+                return true;
+            }
+            __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+                return false;
+            }
+        }
+
+        void installFaultHandler() {}
+#elif defined(_WIN32)
+        bool guardedCopy(unsigned char* dst, const unsigned char* src, size_t length) {
+            streamCopy(dst, src, length);
+            return true;
+        }
+
+        void installFaultHandler() {}
+#else
+        struct FaultGuard {
+            sigjmp_buf jump;
+            const unsigned char* begin;
+            const unsigned char* end;
+        };
+
+        thread_local FaultGuard* activeGuard = nullptr;
+        struct sigaction previousAction;
+
+        void onBusError(int signal, siginfo_t* info, void* context) {
+            FaultGuard* guard = activeGuard;
+            const unsigned char* address = static_cast<const unsigned char*>(info->si_addr);
+            if (guard != nullptr && address >= guard->begin && address < guard->end) {
+                siglongjmp(guard->jump, 1);
+            }
+            // Not a window fill: whoever handled SIGBUS before us, or the default action
+            if ((previousAction.sa_flags & SA_SIGINFO) != 0 && previousAction.sa_sigaction != nullptr) {
+                previousAction.sa_sigaction(signal, info, context);
+            }
+            else if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN) {
+                previousAction.sa_handler(signal);
+            }
+            else {
+                struct sigaction fallback = {};
+                fallback.sa_handler = SIG_DFL;
+                sigaction(SIGBUS, &fallback, nullptr);
+                raise(signal);
+            }
+        }
+
+        void installFaultHandler() {
+            static std::once_flag installed;
+            std::call_once(installed, []() {
+                struct sigaction action = {};
+                action.sa_sigaction = onBusError;
+                // SA_NODEFER: the jump out of the handler does not restore the signal mask
+                action.sa_flags = SA_SIGINFO | SA_NODEFER;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGBUS, &action, &previousAction);
+            });
+        }
+
+        // No objects with destructors live between sigsetjmp and the copy it guards
+        bool guardedCopy(unsigned char* dst, const unsigned char* src, size_t length) {
+            FaultGuard guard;
+            guard.begin = dst;
+            guard.end = dst + length;
+            if (sigsetjmp(guard.jump, 0) != 0) {
+                activeGuard = nullptr;
+                return false;
+            }
+            activeGuard = &guard;
+            streamCopy(dst, src, length);
+            activeGuard = nullptr;
+            return true;
+        }
+#endif
+    }
+
+    const char* kernelName() {
+        return kernel().name;
+    }
+
+    MappedFile::MappedFile(const std::string& path, size_t windowSize)
+        : path_(path), windowSize_(std::max(kWindowAlignment, windowSize / kWindowAlignment * kWindowAlignment)),
+        scratch_(utils::allocateAligned(kScratchSize)) {
+        installFaultHandler();
+#ifdef _WIN32
+        file_ = CreateFileW(utils::stringToWString(path).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+            throw std::runtime_error("Failed to open file for mapping: " + path + " (" + volume_utils::lastErrorMessage() + ")");
+        }
+        fileSize_ = static_cast<unsigned long long>(size.QuadPart);
+        if (fileSize_ > 0) {
+            mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+            if (mapping_ == nullptr) {
+                std::string error = volume_utils::lastErrorMessage();
+                CloseHandle(file_);
+                throw std::runtime_error("Failed to map file: " + path + " (" + error + ")");
+            }
+        }
+#else
+        fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        struct stat info;
+        if (fd_ < 0 || fstat(fd_, &info) != 0) {
+            std::string error = volume_utils::lastErrorMessage();
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            throw std::runtime_error("Failed to open file for mapping: " + path + " (" + error + ")");
+        }
+        fileSize_ = static_cast<unsigned long long>(info.st_size);
+#endif
+    }
+
+    MappedFile::~MappedFile() {
+        unmap();
+#ifdef _WIN32
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        CloseHandle(file_);
+#else
+        close(fd_);
+#endif
+    }
+
+    unsigned char* MappedFile::windowAt(unsigned long long offset, size_t& available) {
+        if (offset >= fileSize_) {
+            throw std::runtime_error("Write past the end of the mapped file: " + path_);
+        }
+        if (window_ == nullptr || offset < windowStart_ || offset >= windowStart_ + windowLength_) {
+            unmap();
+            windowStart_ = offset / windowSize_ * windowSize_;
+            windowLength_ = static_cast<size_t>(std::min<unsigned long long>(windowSize_, fileSize_ - windowStart_));
+#ifdef _WIN32
+            void* view = MapViewOfFile(mapping_, FILE_MAP_WRITE, static_cast<DWORD>(windowStart_ >> 32),
+                static_cast<DWORD>(windowStart_ & 0xFFFFFFFFu), windowLength_);
+            if (view == nullptr) {
+                throw std::runtime_error("Failed to map window of " + path_ + " (" + volume_utils::lastErrorMessage() + ")");
+            }
+#else
+            void* view = mmap(nullptr, windowLength_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, static_cast<off_t>(windowStart_));
+            if (view == MAP_FAILED) {
+                throw std::runtime_error("Failed to map window of " + path_ + " (" + volume_utils::lastErrorMessage() + ")");
+            }
+            madvise(view, windowLength_, MADV_SEQUENTIAL);
+            // Start reading the next window in while this one is filled
+            unsigned long long next = windowStart_ + windowLength_;
+            if (next < fileSize_) {
+                posix_fadvise(fd_, static_cast<off_t>(next), static_cast<off_t>(std::min<unsigned long long>(windowSize_, fileSize_ - next)),
+                    POSIX_FADV_WILLNEED);
+            }
+#endif
+            window_ = static_cast<unsigned char*>(view);
+        }
+        available = static_cast<size_t>(windowStart_ + windowLength_ - offset);
+        return window_ + (offset - windowStart_);
+    }
+
+    void MappedFile::unmap() {
+        if (window_ == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        FlushViewOfFile(window_, 0);
+        UnmapViewOfFile(window_);
+#else
+        msync(window_, windowLength_, MS_ASYNC);
+        munmap(window_, windowLength_);
+#endif
+        window_ = nullptr;
+    }
+
+    void MappedFile::copyInto(unsigned char* dst, const unsigned char* src, size_t length, unsigned long long offset) {
+        if (!guardedCopy(dst, src, length)) {
+            throw std::runtime_error("Write fault in mapped window of " + path_ + " near offset " + std::to_string(offset) +
+                " (I/O error, out of space, or the file was truncated)");
+        }
+    }
+
+    void MappedFile::writePattern(unsigned long long offset, size_t length, const unsigned char* block, size_t period) {
+        while (length > 0) {
+            size_t available = 0;
+            unsigned char* dst = windowAt(offset, available);
+            size_t span = std::min(length, available);
+            for (size_t done = 0; done < span;) {
+                size_t phase = static_cast<size_t>((offset + done) % period);
+                size_t piece = std::min(period - phase, span - done);
+                copyInto(dst + done, block + phase, piece, offset + done);
+                done += piece;
+            }
+            offset += span;
+            length -= span;
+        }
+    }
+
+    void MappedFile::writeKeystream(unsigned long long offset, size_t length, const random_engine::Keystream& stream) {
+        while (length > 0) {
+            size_t available = 0;
+            unsigned char* dst = windowAt(offset, available);
+            size_t span = std::min(length, available);
+            for (size_t done = 0; done < span;) {
+                size_t piece = std::min(kScratchSize, span - done);
+                random_engine::fill(stream, scratch_.get(), piece, offset + done, 1);
+                copyInto(dst + done, scratch_.get(), piece, offset + done);
+                done += piece;
+            }
+            offset += span;
+            length -= span;
+        }
+    }
+
+    void MappedFile::sync() {
+        metrics::Scoped timed(metrics::Timer::Flush);
+#ifdef _WIN32
+        if (window_ != nullptr && !FlushViewOfFile(window_, 0)) {
+            throw std::runtime_error("Unable to flush mapped data of " + path_ + " (" + volume_utils::lastErrorMessage() + ")");
+        }
+        if (!FlushFileBuffers(file_)) {
+            throw std::runtime_error("Unable to flush data to disk: " + path_);
+        }
+#else
+        // Earlier windows are already in the page cache; fsync covers them with the current one
+        if ((window_ != nullptr && msync(window_, windowLength_, MS_SYNC) != 0) || fsync(fd_) != 0) {
+            throw std::runtime_error("Unable to flush data to disk: " + path_ + " (" + volume_utils::lastErrorMessage() + ")");
+        }
+#endif
+    }
+}
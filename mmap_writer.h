@@ -0,0 +1,60 @@
+#pragma once
+#include "random_engine.h"
+#include "utils.h"
+#include <cstddef>
+#include <string>
+
+// mmap_writer.h
+// Overwrites a file through a shared memory mapping instead of write() calls. The file is mapped
+// one window at a time and each window is filled with non-temporal (streaming) stores, so the data
+// goes to the page cache without passing through, and evicting, the CPU caches. Finished windows
+// are handed to write-back with msync(MS_ASYNC) and unmapped. The next window is read ahead
+// (POSIX_FADV_WILLNEED), since a write fault on a page that is not cached reads it in first.
+// A store the file system cannot back (SIGBUS, or an in-page error on Windows) becomes a
+// std::runtime_error from writePattern/writeKeystream.
+namespace mmap_writer {
+    const size_t kDefaultWindowSize = 64 * 1024 * 1024;
+
+    class MappedFile {
+    public:
+        // Throws std::runtime_error when the file cannot be opened. Nothing is mapped until the first write.
+        MappedFile(const std::string& path, size_t windowSize = kDefaultWindowSize);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Writes block[offset % period] over [offset, offset + length); the range must lie inside the file.
+        void writePattern(unsigned long long offset, size_t length, const unsigned char* block, size_t period);
+        // Writes the keystream bytes for [offset, offset + length), keyed by file offset.
+        void writeKeystream(unsigned long long offset, size_t length, const random_engine::Keystream& stream);
+        // Everything written so far reaches the media before this returns.
+        void sync();
+
+        size_t windowSize() const { return windowSize_; }
+
+    private:
+        // Start of the mapped window holding `offset`; `available` is set to the bytes mapped from there.
+        unsigned char* windowAt(unsigned long long offset, size_t& available);
+        void unmap();
+        // streamCopy into the mapping; a page the file system cannot back throws instead of killing the process
+        void copyInto(unsigned char* dst, const unsigned char* src, size_t length, unsigned long long offset);
+
+        std::string path_;
+        size_t windowSize_;
+        unsigned long long fileSize_ = 0;
+        unsigned long long windowStart_ = 0;
+        size_t windowLength_ = 0;
+        unsigned char* window_ = nullptr;
+        utils::AlignedBuffer scratch_;      // keystream staging, small enough to stay in L2
+#ifdef _WIN32
+        void* file_ = nullptr;
+        void* mapping_ = nullptr;
+#else
+        int fd_ = -1;
+#endif
+    };
+
+    // Copies with streaming stores where the CPU has them (SSE2/AVX2), plain memcpy elsewhere
+    void streamCopy(unsigned char* dst, const unsigned char* src, size_t length);
+    const char* kernelName();
+}
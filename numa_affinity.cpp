@@ -0,0 +1,124 @@
+#include "numa_affinity.h"
+#include "logger.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace numa_affinity {
+    namespace {
+        thread_local int boundNode = -1;
+
+#ifdef __linux__
+        // Parses a sysfs CPU list such as "0-7,16-23"
+        std::vector<int> readCpuList(const std::string& path) {
+            std::vector<int> cpus;
+            std::ifstream file(path);
+            std::string list;
+            if (!(file >> list)) {
+                return cpus;
+            }
+            std::istringstream ranges(list);
+            std::string range;
+            while (std::getline(ranges, range, ',')) {
+                size_t dash = range.find('-');
+                try {
+                    int first = std::stoi(range.substr(0, dash));
+                    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                    for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+                        cpus.push_back(cpu);
+                    }
+                }
+                catch (const std::exception&) {
+                    return {};
+                }
+            }
+            return cpus;
+        }
+
+        // The mask the process started with, captured before any thread is bound
+        const cpu_set_t& processMask() {
+            static const cpu_set_t mask = []() {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+                    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                        CPU_SET(cpu, &set);
+                    }
+                }
+                return set;
+            }();
+            return mask;
+        }
+#endif
+    }
+
+    size_t nodeCount() {
+#ifdef __linux__
+        // has_cpu is a list in the same format as a CPU list, of node numbers
+        static const size_t count = std::max<size_t>(readCpuList("/sys/devices/system/node/has_cpu").size(), 1);
+        return count;
+#else
+        return 1;
+#endif
+    }
+
+    bool bindCurrentThread(int node) {
+#ifdef __linux__
+        if (node < 0 || nodeCount() < 2) {
+            return false;
+        }
+        const cpu_set_t& allowed = processMask();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : readCpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            logger::debug("Unable to bind thread to NUMA node " + std::to_string(node));
+            return false;
+        }
+        boundNode = node;
+        return true;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+    void unbindCurrentThread() {
+#ifdef __linux__
+        if (boundNode >= 0) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &processMask());
+            boundNode = -1;
+        }
+#endif
+    }
+
+    int currentNode() {
+        return boundNode;
+    }
+
+    size_t allowedCpus() {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+            return static_cast<size_t>(CPU_COUNT(&set));
+        }
+#endif
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::string describeNode(int node) {
+        return node < 0 ? "-" : std::to_string(node);
+    }
+}
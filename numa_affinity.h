@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// numa_affinity.h
+// Keeps a device's I/O close to the device. A thread bound to the node of a disk's controller runs
+// on that node's CPUs, and the buffers it maps are faulted in, and therefore placed, on that node's
+// memory. Threads it starts inherit the binding. Linux only; elsewhere binding is a no-op.
+namespace numa_affinity {
+    // Nodes with CPUs; 1 on machines without NUMA or without sysfs
+    size_t nodeCount();
+
+    // Restricts the calling thread to the CPUs of `node`. Returns false, leaving the thread as it was,
+    // when the node is unknown (-1), has no CPUs or the machine has a single node.
+    bool bindCurrentThread(int node);
+    // Gives the calling thread back the CPUs the process started with.
+    void unbindCurrentThread();
+
+    // Node the calling thread is bound to, -1 when unbound
+    int currentNode();
+
+    // CPUs the calling thread may run on
+    size_t allowedCpus();
+
+    std::string describeNode(int node);
+}
@@ -0,0 +1,341 @@
+#include "progress.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+namespace progress {
+    struct Device {
+        unsigned long long id = 0;
+        std::string label;
+        std::atomic<unsigned long long> written{ 0 };
+        std::atomic<unsigned long long> expected{ 0 };
+        // Reporter-thread state
+        unsigned long long lastWritten = 0;
+        double rate = 0.0;
+        bool hasRate = false;
+    };
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        std::mutex devicesMutex;
+        std::deque<Device> devices;                         // deque: addresses stay stable as it grows
+        std::map<unsigned long long, Device*> devicesById;
+
+        std::atomic<unsigned long long> filesQueued{ 0 };
+        std::atomic<unsigned long long> filesDone{ 0 };
+
+        std::string deviceLabel(unsigned long long id) {
+#ifdef __linux__
+            std::string key = std::to_string(major(id)) + ":" + std::to_string(minor(id));
+            std::ifstream uevent("/sys/dev/block/" + key + "/uevent");
+            std::string line;
+            while (std::getline(uevent, line)) {
+                if (line.rfind("DEVNAME=", 0) == 0) {
+                    return line.substr(8);
+                }
+            }
+            return key;
+#else
+            return "volume " + std::to_string(id);
+#endif
+        }
+
+        std::string formatDuration(double seconds) {
+            long long total = static_cast<long long>(seconds + 0.5);
+            std::ostringstream out;
+            if (total >= 3600) {
+                out << total / 3600 << "h " << (total % 3600) / 60 << "m";
+            }
+            else if (total >= 60) {
+                out << total / 60 << "m " << total % 60 << "s";
+            }
+            else {
+                out << total << "s";
+            }
+            return out.str();
+        }
+
+        void writeFd(int fd, const std::string& text) {
+            const char* data = text.data();
+            size_t left = text.size();
+            while (left > 0) {
+#ifdef _WIN32
+                int written = _write(fd, data, static_cast<unsigned>(left));
+#else
+                ssize_t written = ::write(fd, data, left);
+#endif
+                if (written <= 0) {
+                    return;
+                }
+                data += written;
+                left -= static_cast<size_t>(written);
+            }
+        }
+
+        class Reporter {
+        public:
+            explicit Reporter(const Config& config) : config_(config), start_(Clock::now()), lastSample_(start_) {
+                thread_ = std::thread(&Reporter::loop, this);
+            }
+
+            ~Reporter() {
+                {
+                    std::lock_guard<std::mutex> lock(wakeMutex_);
+                    stopping_ = true;
+                }
+                wake_.notify_one();
+                thread_.join();
+                render(true);
+            }
+
+            void note(const std::string& line) {
+                std::lock_guard<std::mutex> lock(renderMutex_);
+                if (config_.mode == Mode::Terminal) {
+                    std::cout << "\r" << line << std::string(lineWidth_ > line.size() ? lineWidth_ - line.size() : 0, ' ') << "\n";
+                    lineWidth_ = 0;
+                    if (!lastFrame_.empty()) {
+                        std::cout << lastFrame_;
+                        lineWidth_ = lastFrame_.size();
+                    }
+                    std::cout.flush();
+                }
+                else {
+                    std::cout << line << "\n";
+                }
+            }
+
+        private:
+            void loop() {
+                std::unique_lock<std::mutex> lock(wakeMutex_);
+                while (!wake_.wait_for(lock, std::chrono::milliseconds(config_.intervalMs), [&]() { return stopping_; })) {
+                    lock.unlock();
+                    render(false);
+                    lock.lock();
+                }
+            }
+
+            // Samples the counters and folds the new throughput into the moving averages.
+            void render(bool final) {
+                std::lock_guard<std::mutex> renderLock(renderMutex_);
+                Clock::time_point now = Clock::now();
+                double dt = std::chrono::duration<double>(now - lastSample_).count();
+                double elapsed = std::chrono::duration<double>(now - start_).count();
+                lastSample_ = now;
+
+                struct Sample {
+                    std::string label;
+                    unsigned long long written;
+                    double rate;
+                };
+                std::vector<Sample> samples;
+                unsigned long long written = 0;
+                unsigned long long expected = 0;
+                double totalRate = 0.0;
+                {
+                    std::lock_guard<std::mutex> lock(devicesMutex);
+                    for (Device& device : devices) {
+                        unsigned long long deviceWritten = device.written.load(std::memory_order_relaxed);
+                        unsigned long long deviceExpected = device.expected.load(std::memory_order_relaxed);
+                        if (dt > 0) {
+                            double instant = (deviceWritten - device.lastWritten) / dt;
+                            device.rate = device.hasRate ? config_.smoothing * instant + (1.0 - config_.smoothing) * device.rate : instant;
+                            device.hasRate = true;
+                        }
+                        device.lastWritten = deviceWritten;
+                        written += deviceWritten;
+                        expected += deviceExpected;
+                        if (deviceExpected > 0) {
+                            samples.push_back({ device.label, deviceWritten, device.rate });
+                            totalRate += device.rate;
+                        }
+                    }
+                }
+                unsigned long long queued = filesQueued.load(std::memory_order_relaxed);
+                unsigned long long done = filesDone.load(std::memory_order_relaxed);
+                expected = std::max(expected, written);
+                double eta = (totalRate > 0 && expected > written) ? (expected - written) / totalRate : 0.0;
+
+                if (config_.mode == Mode::Json) {
+                    std::ostringstream out;
+                    out << "{\"elapsed_s\":" << elapsed << ",\"bytes_done\":" << written << ",\"bytes_total\":" << expected
+                        << ",\"files_done\":" << done << ",\"files_total\":" << queued
+                        << ",\"rate_bps\":" << static_cast<unsigned long long>(totalRate)
+                        << ",\"eta_s\":" << static_cast<long long>(eta) << ",\"devices\":[";
+                    for (size_t i = 0; i < samples.size(); ++i) {
+                        out << (i ? "," : "") << "{\"device\":\"" << samples[i].label << "\",\"bytes_done\":" << samples[i].written
+                            << ",\"rate_bps\":" << static_cast<unsigned long long>(samples[i].rate) << "}";
+                    }
+                    out << "],\"done\":" << (final ? "true" : "false") << "}\n";
+                    writeFd(config_.jsonFd, out.str());
+                    return;
+                }
+                if (config_.mode != Mode::Terminal || expected == 0) {
+                    return;
+                }
+
+                const int barWidth = 30;
+                double fraction = static_cast<double>(written) / expected;
+                int pos = static_cast<int>(barWidth * fraction);
+                std::ostringstream frame;
+                frame << "\r[";
+                for (int i = 0; i < barWidth; ++i) {
+                    frame << (i < pos ? '=' : i == pos ? '>' : ' ');
+                }
+                frame << "] " << std::fixed;
+                frame.precision(1);
+                frame << fraction * 100 << "% " << utils::formatSize(written) << "/" << utils::formatSize(expected);
+                if (queued > 1) {
+                    frame << " | files " << done << "/" << queued;
+                }
+                for (const Sample& sample : samples) {
+                    frame << " | " << sample.label << " " << utils::formatSize(static_cast<unsigned long long>(sample.rate)) << "/s";
+                }
+                frame << " | " << (final ? "Elapsed: " + formatDuration(elapsed) : "ETA: " + formatDuration(eta));
+
+                std::string text = frame.str();
+                size_t width = text.size();
+                if (lineWidth_ > width) {
+                    text += std::string(lineWidth_ - width, ' ');
+                }
+                lineWidth_ = width;
+                lastFrame_ = frame.str();
+                std::cout << text;
+                if (final) {
+                    std::cout << "\n";
+                    lastFrame_.clear();
+                    lineWidth_ = 0;
+                }
+                std::cout.flush();
+            }
+
+            Config config_;
+            Clock::time_point start_;
+            Clock::time_point lastSample_;
+            std::thread thread_;
+            std::mutex wakeMutex_;
+            std::condition_variable wake_;
+            bool stopping_ = false;
+            std::mutex renderMutex_;
+            std::string lastFrame_;
+            size_t lineWidth_ = 0;
+        };
+
+        std::mutex sessionMutex;
+        size_t sessionDepth = 0;
+        Reporter* reporter = nullptr;
+
+        void resetCounters() {
+            std::lock_guard<std::mutex> lock(devicesMutex);
+            for (Device& device : devices) {
+                device.written = 0;
+                device.expected = 0;
+                device.lastWritten = 0;
+                device.rate = 0.0;
+                device.hasRate = false;
+            }
+            filesQueued = 0;
+            filesDone = 0;
+        }
+    }
+
+    Config configFromEnvironment() {
+        Config config;
+        const char* value = std::getenv("SHREDDER_PROGRESS");
+        if (value == nullptr) {
+            return config;
+        }
+        std::string setting(value);
+        if (setting == "off") {
+            config.mode = Mode::Off;
+        }
+        else if (setting.rfind("json", 0) == 0) {
+            config.mode = Mode::Json;
+            if (setting.size() > 5 && setting[4] == ':') {
+                config.jsonFd = std::atoi(setting.c_str() + 5);
+            }
+        }
+        return config;
+    }
+
+    Device* device(unsigned long long deviceId) {
+        std::lock_guard<std::mutex> lock(devicesMutex);
+        auto it = devicesById.find(deviceId);
+        if (it != devicesById.end()) {
+            return it->second;
+        }
+        devices.emplace_back();
+        Device* created = &devices.back();
+        created->id = deviceId;
+        created->label = deviceLabel(deviceId);
+        devicesById[deviceId] = created;
+        return created;
+    }
+
+    void addExpected(Device* device, unsigned long long bytes) {
+        device->expected.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void removeExpected(Device* device, unsigned long long bytes) {
+        device->expected.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    void addBytes(Device* device, unsigned long long bytes) {
+        device->written.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void fileQueued() {
+        filesQueued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void fileDone() {
+        filesDone.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void note(const std::string& line) {
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        if (reporter != nullptr) {
+            reporter->note(line);
+        }
+        else {
+            std::cout << line << std::endl;
+        }
+    }
+
+    Session::Session(const Config& config) {
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        if (sessionDepth++ == 0) {
+            resetCounters();
+            if (config.mode != Mode::Off) {
+                reporter = new Reporter(config);
+            }
+        }
+    }
+
+    Session::~Session() {
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        if (--sessionDepth == 0) {
+            delete reporter;
+            reporter = nullptr;
+        }
+    }
+}
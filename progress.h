@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+
+// progress.h
+// Aggregate progress for everything being shredded. Writers only bump relaxed atomic counters;
+// one reporter thread samples them at a fixed rate and renders a single status line (aggregate
+// bytes, files done/total, per-device throughput, EWMA-smoothed ETA) or emits JSON lines on a fd.
+namespace progress {
+    enum class Mode { Terminal, Json, Off };
+
+    struct Config {
+        Mode mode = Mode::Terminal;
+        int jsonFd = 1;                 // where Json mode writes its records
+        unsigned intervalMs = 250;
+        double smoothing = 0.2;         // EWMA weight given to the newest throughput sample
+    };
+
+    // From SHREDDER_PROGRESS: "terminal" (default), "off", or "json:<fd>".
+    Config configFromEnvironment();
+
+    // Counters for one device (st_dev, or st_rdev for block devices). Stays valid for the life of the process.
+    struct Device;
+    Device* device(unsigned long long deviceId);
+
+    // Write-path updates: relaxed atomic adds, no locks and no I/O.
+    void addExpected(Device* device, unsigned long long bytes);
+    void removeExpected(Device* device, unsigned long long bytes);  // work abandoned after a failure
+    void addBytes(Device* device, unsigned long long bytes);
+    void fileQueued();
+    void fileDone();
+
+    // Prints a line above the status line, or plainly when nothing is being rendered.
+    void note(const std::string& line);
+
+    // Runs the reporter while alive. Sessions nest: only the outermost one resets the counters,
+    // starts the reporter thread and draws the final frame when it ends.
+    class Session {
+    public:
+        explicit Session(const Config& config = configFromEnvironment());
+        ~Session();
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+    };
+}
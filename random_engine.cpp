@@ -0,0 +1,474 @@
+#include "random_engine.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHRED_X86_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHRED_TARGET_SSE2
+#define SHRED_TARGET_AVX2
+#else
+#define SHRED_TARGET_SSE2 __attribute__((target("sse2")))
+#define SHRED_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace random_engine {
+    namespace {
+        using BlockFn = void (*)(const uint32_t input[16], uint64_t counter, size_t blocks, unsigned char* out);
+
+        const uint32_t kSigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+
+        void setupState(const Keystream& stream, uint32_t state[16]) {
+            std::memcpy(state, kSigma, sizeof(kSigma));
+            std::memcpy(state + 4, stream.key, sizeof(stream.key));
+            state[12] = 0;
+            state[13] = 0;
+            state[14] = static_cast<uint32_t>(stream.nonce);
+            state[15] = static_cast<uint32_t>(stream.nonce >> 32);
+        }
+
+        inline uint32_t rotl32(uint32_t v, int n) {
+            return (v << n) | (v >> (32 - n));
+        }
+
+#define CHACHA_QR(a, b, c, d)                       \
+        a += b; d ^= a; d = rotl32(d, 16);          \
+        c += d; b ^= c; b = rotl32(b, 12);          \
+        a += b; d ^= a; d = rotl32(d, 8);           \
+        c += d; b ^= c; b = rotl32(b, 7);
+
+        void blocksScalar(const uint32_t input[16], uint64_t counter, size_t blocks, unsigned char* out) {
+            for (size_t b = 0; b < blocks; ++b, ++counter) {
+                uint32_t s[16];
+                std::memcpy(s, input, sizeof(s));
+                s[12] = static_cast<uint32_t>(counter);
+                s[13] = static_cast<uint32_t>(counter >> 32);
+
+                uint32_t x[16];
+                std::memcpy(x, s, sizeof(x));
+                for (int round = 0; round < 10; ++round) {
+                    CHACHA_QR(x[0], x[4], x[8], x[12]);
+                    CHACHA_QR(x[1], x[5], x[9], x[13]);
+                    CHACHA_QR(x[2], x[6], x[10], x[14]);
+                    CHACHA_QR(x[3], x[7], x[11], x[15]);
+                    CHACHA_QR(x[0], x[5], x[10], x[15]);
+                    CHACHA_QR(x[1], x[6], x[11], x[12]);
+                    CHACHA_QR(x[2], x[7], x[8], x[13]);
+                    CHACHA_QR(x[3], x[4], x[9], x[14]);
+                }
+
+                for (int i = 0; i < 16; ++i) {
+                    uint32_t v = x[i] + s[i];
+                    out[0] = static_cast<unsigned char>(v);
+                    out[1] = static_cast<unsigned char>(v >> 8);
+                    out[2] = static_cast<unsigned char>(v >> 16);
+                    out[3] = static_cast<unsigned char>(v >> 24);
+                    out += 4;
+                }
+            }
+        }
+
+#undef CHACHA_QR
+
+#ifdef SHRED_X86_KERNELS
+        // Four blocks per iteration: each __m128i holds one state word of four consecutive blocks.
+#define SSE2_ROTL(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n))
+#define SSE2_QR(a, b, c, d)                                                             \
+        a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = SSE2_ROTL(d, 16);         \
+        c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = SSE2_ROTL(b, 12);         \
+        a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = SSE2_ROTL(d, 8);          \
+        c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = SSE2_ROTL(b, 7);
+
+        SHRED_TARGET_SSE2 void blocksSSE2(const uint32_t input[16], uint64_t counter, size_t blocks, unsigned char* out) {
+            while (blocks >= 4) {
+                __m128i s[16];
+                for (int i = 0; i < 16; ++i) {
+                    s[i] = _mm_set1_epi32(static_cast<int>(input[i]));
+                }
+                uint32_t lo[4], hi[4];
+                for (int j = 0; j < 4; ++j) {
+                    lo[j] = static_cast<uint32_t>(counter + j);
+                    hi[j] = static_cast<uint32_t>((counter + j) >> 32);
+                }
+                s[12] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo));
+                s[13] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi));
+
+                __m128i x[16];
+                for (int i = 0; i < 16; ++i) {
+                    x[i] = s[i];
+                }
+                for (int round = 0; round < 10; ++round) {
+                    SSE2_QR(x[0], x[4], x[8], x[12]);
+                    SSE2_QR(x[1], x[5], x[9], x[13]);
+                    SSE2_QR(x[2], x[6], x[10], x[14]);
+                    SSE2_QR(x[3], x[7], x[11], x[15]);
+                    SSE2_QR(x[0], x[5], x[10], x[15]);
+                    SSE2_QR(x[1], x[6], x[11], x[12]);
+                    SSE2_QR(x[2], x[7], x[8], x[13]);
+                    SSE2_QR(x[3], x[4], x[9], x[14]);
+                }
+                for (int i = 0; i < 16; ++i) {
+                    x[i] = _mm_add_epi32(x[i], s[i]);
+                }
+
+                // Transpose each group of four words back into block order.
+                for (int g = 0; g < 4; ++g) {
+                    __m128i t0 = _mm_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+                    __m128i t1 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+                    __m128i t2 = _mm_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+                    __m128i t3 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0 * 64 + g * 16), _mm_unpacklo_epi64(t0, t1));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 1 * 64 + g * 16), _mm_unpackhi_epi64(t0, t1));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * 64 + g * 16), _mm_unpacklo_epi64(t2, t3));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3 * 64 + g * 16), _mm_unpackhi_epi64(t2, t3));
+                }
+
+                blocks -= 4;
+                counter += 4;
+                out += 4 * 64;
+            }
+            if (blocks > 0) {
+                blocksScalar(input, counter, blocks, out);
+            }
+        }
+
+#undef SSE2_QR
+#undef SSE2_ROTL
+
+        // Eight blocks per iteration; the 16- and 8-bit rotations are byte shuffles.
+#define AVX2_ROTL(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n))
+#define AVX2_QR(a, b, c, d)                                                                             \
+        a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot16);      \
+        c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = AVX2_ROTL(b, 12);                   \
+        a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot8);       \
+        c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = AVX2_ROTL(b, 7);
+
+        SHRED_TARGET_AVX2 void blocksAVX2(const uint32_t input[16], uint64_t counter, size_t blocks, unsigned char* out) {
+            const __m256i rot16 = _mm256_setr_epi8(
+                2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+            const __m256i rot8 = _mm256_setr_epi8(
+                3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+
+            while (blocks >= 8) {
+                __m256i s[16];
+                for (int i = 0; i < 16; ++i) {
+                    s[i] = _mm256_set1_epi32(static_cast<int>(input[i]));
+                }
+                uint32_t lo[8], hi[8];
+                for (int j = 0; j < 8; ++j) {
+                    lo[j] = static_cast<uint32_t>(counter + j);
+                    hi[j] = static_cast<uint32_t>((counter + j) >> 32);
+                }
+                s[12] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lo));
+                s[13] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hi));
+
+                __m256i x[16];
+                for (int i = 0; i < 16; ++i) {
+                    x[i] = s[i];
+                }
+                for (int round = 0; round < 10; ++round) {
+                    AVX2_QR(x[0], x[4], x[8], x[12]);
+                    AVX2_QR(x[1], x[5], x[9], x[13]);
+                    AVX2_QR(x[2], x[6], x[10], x[14]);
+                    AVX2_QR(x[3], x[7], x[11], x[15]);
+                    AVX2_QR(x[0], x[5], x[10], x[15]);
+                    AVX2_QR(x[1], x[6], x[11], x[12]);
+                    AVX2_QR(x[2], x[7], x[8], x[13]);
+                    AVX2_QR(x[3], x[4], x[9], x[14]);
+                }
+                for (int i = 0; i < 16; ++i) {
+                    x[i] = _mm256_add_epi32(x[i], s[i]);
+                }
+
+                // Same 4x4 transpose as SSE2, per 128-bit lane: the low lane holds blocks 0-3, the high lane 4-7.
+                for (int g = 0; g < 4; ++g) {
+                    __m256i t0 = _mm256_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+                    __m256i t1 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+                    __m256i t2 = _mm256_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+                    __m256i t3 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+                    __m256i r[4] = {
+                        _mm256_unpacklo_epi64(t0, t1),
+                        _mm256_unpackhi_epi64(t0, t1),
+                        _mm256_unpacklo_epi64(t2, t3),
+                        _mm256_unpackhi_epi64(t2, t3)
+                    };
+                    for (int j = 0; j < 4; ++j) {
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j * 64 + g * 16), _mm256_castsi256_si128(r[j]));
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (j + 4) * 64 + g * 16), _mm256_extracti128_si256(r[j], 1));
+                    }
+                }
+
+                blocks -= 8;
+                counter += 8;
+                out += 8 * 64;
+            }
+            if (blocks > 0) {
+                blocksSSE2(input, counter, blocks, out);
+            }
+        }
+
+#undef AVX2_QR
+#undef AVX2_ROTL
+
+        bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+#endif
+
+        BlockFn resolve(Kernel kernel) {
+            if (kernel == Kernel::Auto) {
+                kernel = activeKernel();
+            }
+            switch (kernel) {
+#ifdef SHRED_X86_KERNELS
+            case Kernel::AVX2:
+                return blocksAVX2;
+            case Kernel::SSE2:
+                return blocksSSE2;
+#endif
+            default:
+                return blocksScalar;
+            }
+        }
+
+        double measureThroughput(Kernel kernel, const Keystream& stream, std::vector<unsigned char>& buffer, size_t threads) {
+            const int repetitions = 4;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int rep = 0; rep < repetitions; ++rep) {
+                uint64_t offset = static_cast<uint64_t>(rep) * buffer.size();
+                if (kernel == Kernel::Auto) {
+                    fill(stream, buffer.data(), buffer.size(), offset, threads);
+                }
+                else {
+                    fillWithKernel(kernel, stream, buffer.data(), buffer.size(), offset);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            return (static_cast<double>(buffer.size()) * repetitions) / seconds / 1e9;
+        }
+    }
+
+    Keystream newKeystream() {
+        std::random_device rd;
+        Keystream stream;
+        for (auto& word : stream.key) {
+            word = rd();
+        }
+        stream.nonce = (static_cast<uint64_t>(rd()) << 32) | rd();
+        return stream;
+    }
+
+    Keystream keystreamFromSeed(const unsigned char seed[32], uint64_t nonce) {
+        Keystream stream;
+        for (int i = 0; i < 8; ++i) {
+            stream.key[i] = static_cast<uint32_t>(seed[4 * i]) |
+                (static_cast<uint32_t>(seed[4 * i + 1]) << 8) |
+                (static_cast<uint32_t>(seed[4 * i + 2]) << 16) |
+                (static_cast<uint32_t>(seed[4 * i + 3]) << 24);
+        }
+        stream.nonce = nonce;
+        return stream;
+    }
+
+    bool kernelSupported(Kernel kernel) {
+        switch (kernel) {
+        case Kernel::Auto:
+        case Kernel::Scalar:
+            return true;
+#ifdef SHRED_X86_KERNELS
+        case Kernel::SSE2:
+#if defined(__x86_64__) || defined(_M_X64)
+            return true;
+#elif defined(_MSC_VER)
+            return IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != 0;
+#else
+            return __builtin_cpu_supports("sse2");
+#endif
+        case Kernel::AVX2: {
+            static const bool avx2 = cpuHasAVX2();
+            return avx2;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    Kernel activeKernel() {
+        static const Kernel kernel = kernelSupported(Kernel::AVX2) ? Kernel::AVX2
+            : kernelSupported(Kernel::SSE2) ? Kernel::SSE2
+            : Kernel::Scalar;
+        return kernel;
+    }
+
+    const char* kernelName(Kernel kernel) {
+        switch (kernel) {
+        case Kernel::Auto: return "auto";
+        case Kernel::Scalar: return "scalar";
+        case Kernel::SSE2: return "sse2";
+        case Kernel::AVX2: return "avx2";
+        }
+        return "unknown";
+    }
+
+    void fillWithKernel(Kernel kernel, const Keystream& stream, unsigned char* dst, size_t length, uint64_t streamOffset) {
+        BlockFn blocks = resolve(kernel);
+        uint32_t state[16];
+        setupState(stream, state);
+
+        uint64_t counter = streamOffset / 64;
+        size_t skip = static_cast<size_t>(streamOffset % 64);
+        unsigned char partial[64];
+
+        // Unaligned head: generate the whole block and keep its tail.
+        if (skip != 0 && length > 0) {
+            blocksScalar(state, counter, 1, partial);
+            size_t n = std::min<size_t>(64 - skip, length);
+            std::memcpy(dst, partial + skip, n);
+            dst += n;
+            length -= n;
+            ++counter;
+        }
+
+        size_t whole = length / 64;
+        if (whole > 0) {
+            blocks(state, counter, whole, dst);
+            dst += whole * 64;
+            length -= whole * 64;
+            counter += whole;
+        }
+
+        if (length > 0) {
+            blocksScalar(state, counter, 1, partial);
+            std::memcpy(dst, partial, length);
+        }
+    }
+
+    void fill(const Keystream& stream, unsigned char* dst, size_t length, uint64_t streamOffset, size_t threads) {
+        metrics::Scoped timed(metrics::Timer::Generate, length);
+        const size_t minBytesPerThread = 1024 * 1024;
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = std::min(threads, std::max<size_t>(1, length / minBytesPerThread));
+
+        if (threads <= 1) {
+            fillWithKernel(Kernel::Auto, stream, dst, length, streamOffset);
+            return;
+        }
+
+        // Chunks are block aligned so no worker has to generate a partial block at its start.
+        size_t perThread = ((length / threads) + 63) & ~static_cast<size_t>(63);
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; ++t) {
+            size_t begin = t * perThread;
+            if (begin >= length) {
+                break;
+            }
+            size_t len = std::min(perThread, length - begin);
+            workers.emplace_back(fillWithKernel, Kernel::Auto, std::cref(stream), dst + begin, len, streamOffset + begin);
+        }
+        fillWithKernel(Kernel::Auto, stream, dst, std::min(perThread, length), streamOffset);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    bool runSelfTest() {
+        bool passed = true;
+
+        // Known-answer test from RFC 7539 section 2.3.2 (block counter 1, IETF nonce folded into the 64-bit layout).
+        unsigned char seed[32];
+        for (int i = 0; i < 32; ++i) {
+            seed[i] = static_cast<unsigned char>(i);
+        }
+        const unsigned char expected[64] = {
+            0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+            0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+            0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+            0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+        };
+        Keystream reference = keystreamFromSeed(seed, 0x4a000000);
+        uint64_t counter = 1 | (static_cast<uint64_t>(0x09000000) << 32);
+        uint32_t state[16];
+        setupState(reference, state);
+        unsigned char block[64];
+        blocksScalar(state, counter, 1, block);
+        if (std::memcmp(block, expected, sizeof(block)) != 0) {
+            std::cerr << "Random engine self-test: scalar kernel failed the known-answer test.\n";
+            passed = false;
+        }
+
+        // Every vector kernel must produce exactly the scalar stream, including at unaligned offsets.
+        const Kernel kernels[] = { Kernel::Scalar, Kernel::SSE2, Kernel::AVX2 };
+        Keystream stream = newKeystream();
+        const size_t checkSize = 256 * 1024 + 37;
+        std::vector<unsigned char> scalarOut(checkSize), kernelOut(checkSize);
+        fillWithKernel(Kernel::Scalar, stream, scalarOut.data(), checkSize, 13);
+        for (Kernel kernel : kernels) {
+            if (!kernelSupported(kernel) || kernel == Kernel::Scalar) {
+                continue;
+            }
+            fillWithKernel(kernel, stream, kernelOut.data(), checkSize, 13);
+            if (kernelOut != scalarOut) {
+                std::cerr << "Random engine self-test: " << kernelName(kernel) << " kernel does not match scalar output.\n";
+                passed = false;
+            }
+        }
+        fill(stream, kernelOut.data(), checkSize, 13);
+        if (kernelOut != scalarOut) {
+            std::cerr << "Random engine self-test: multi-threaded fill does not match scalar output.\n";
+            passed = false;
+        }
+
+        std::vector<unsigned char> buffer(64 * 1024 * 1024);
+        std::cout << "Random engine throughput (" << utils::formatSize(buffer.size()) << " x 4):\n";
+        for (Kernel kernel : kernels) {
+            if (!kernelSupported(kernel)) {
+                continue;
+            }
+            double gbps = measureThroughput(kernel, stream, buffer, 1);
+            std::cout << "  " << std::left << std::setw(8) << kernelName(kernel) << std::right
+                << std::fixed << std::setprecision(2) << gbps << " GB/s (1 thread)\n";
+            logger::info(std::string("Random engine kernel ") + kernelName(kernel) + ": " + std::to_string(gbps) + " GB/s");
+        }
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        double gbps = measureThroughput(Kernel::Auto, stream, buffer, threads);
+        std::cout << "  " << std::left << std::setw(8) << kernelName(activeKernel()) << std::right
+            << std::fixed << std::setprecision(2) << gbps << " GB/s (" << threads << " threads)\n";
+        logger::info("Random engine parallel fill: " + std::to_string(gbps) + " GB/s on " + std::to_string(threads) + " threads");
+
+        std::cout << (passed ? "Random engine self-test passed.\n" : "Random engine self-test FAILED.\n");
+        return passed;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// random_engine.h
+// ChaCha20 keystream used as the random-fill source. The generator is counter based,
+// so any byte offset of the stream can be produced independently of the others.
+namespace random_engine {
+    enum class Kernel { Auto, Scalar, SSE2, AVX2 };
+
+    struct Keystream {
+        uint32_t key[8];
+        uint64_t nonce;
+    };
+
+    Keystream newKeystream();
+    Keystream keystreamFromSeed(const unsigned char seed[32], uint64_t nonce);
+
+    bool kernelSupported(Kernel kernel);
+    Kernel activeKernel();
+    const char* kernelName(Kernel kernel);
+
+    // Fills dst with bytes [streamOffset, streamOffset + length) of the keystream.
+    // threads == 0 uses every hardware thread for large buffers; threads == 1 stays on the caller.
+    void fill(const Keystream& stream, unsigned char* dst, size_t length, uint64_t streamOffset = 0, size_t threads = 0);
+    void fillWithKernel(Kernel kernel, const Keystream& stream, unsigned char* dst, size_t length, uint64_t streamOffset = 0);
+
+    bool runSelfTest();
+}
@@ -0,0 +1,69 @@
+#include "schemes.h"
+#include <cstdio>
+#include <stdexcept>
+
+namespace schemes {
+    std::vector<Pass> expand(Id id, size_t passes, bool customPattern) {
+        const Scheme& scheme = info(id);
+        if (scheme.passes != nullptr) {
+            return std::vector<Pass>(scheme.passes, scheme.passes + scheme.count);
+        }
+        std::vector<Pass> sequence;
+        for (size_t pass = 1; pass <= passes; ++pass) {
+            if (customPattern) {
+                sequence.push_back(Pass{ PassKind::Custom, { 0, 0, 0 }, 0 });
+            }
+            else if (id == Id::Classic && pass % 2 == 1) {
+                sequence.push_back(constant(0xFF));
+            }
+            else {
+                sequence.push_back(random());
+            }
+        }
+        sequence.push_back(constant(0x00));
+        return sequence;
+    }
+
+    size_t passCount(Id id, size_t passes) {
+        const Scheme& scheme = info(id);
+        return scheme.passes != nullptr ? scheme.count : passes + 1;
+    }
+
+    Id resolve(std::optional<Id> scheme, Id fallback) {
+        return scheme ? *scheme : fallback;
+    }
+
+    bool parse(const std::string& text, Id& id) {
+        for (const Scheme& scheme : kSchemes) {
+            if (text == scheme.name) {
+                id = scheme.id;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const Scheme& info(Id id) {
+        for (const Scheme& scheme : kSchemes) {
+            if (scheme.id == id) {
+                return scheme;
+            }
+        }
+        throw std::invalid_argument("Unknown overwrite scheme");
+    }
+
+    std::string describe(const Pass& pass) {
+        switch (pass.kind) {
+        case PassKind::Random: return "random";
+        case PassKind::Custom: return "custom pattern";
+        default: break;
+        }
+        std::string text;
+        for (unsigned char i = 0; i < pass.length; ++i) {
+            char hex[3];
+            std::snprintf(hex, sizeof(hex), "%02X", pass.bytes[i]);
+            text += hex;
+        }
+        return "0x" + text;
+    }
+}
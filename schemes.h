@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// schemes.h
+// Overwrite schemes as constexpr pass tables. A pass is a constant byte, a short repeating pattern
+// (Gutmann's are three bytes), random data, or the caller's custom pattern. The fixed standards are
+// written out pass by pass; classic and random runs are expanded from the requested pass count and
+// end with a zero pass, as this tool always has. Each pass kind has its own fill: shared memset or
+// broadcast blocks for constants and patterns, the keystream for random passes.
+namespace schemes {
+    enum class Id { Classic, Random, DoD, Gutmann, NistClear };
+    enum class PassKind { Constant, Pattern, Random, Custom };
+
+    struct Pass {
+        PassKind kind = PassKind::Random;
+        unsigned char bytes[3] = { 0, 0, 0 };
+        unsigned char length = 0;   // bytes used by Constant (1) and Pattern (1-3) passes
+
+        std::vector<unsigned char> pattern() const { return std::vector<unsigned char>(bytes, bytes + length); }
+    };
+
+    constexpr Pass constant(unsigned char value) { return Pass{ PassKind::Constant, { value, 0, 0 }, 1 }; }
+    constexpr Pass pattern(unsigned char a, unsigned char b, unsigned char c) { return Pass{ PassKind::Pattern, { a, b, c }, 3 }; }
+    constexpr Pass random() { return Pass{ PassKind::Random, { 0, 0, 0 }, 0 }; }
+
+    // DoD 5220.22-M (ECE short form): a character, its complement, then random data
+    constexpr Pass kDoD[] = { constant(0x00), constant(0xFF), random() };
+
+    // Peter Gutmann, "Secure Deletion of Data from Magnetic and Solid-State Memory" (1996)
+    constexpr Pass kGutmann[] = {
+        random(), random(), random(), random(),
+        constant(0x55), constant(0xAA),
+        pattern(0x92, 0x49, 0x24), pattern(0x49, 0x24, 0x92), pattern(0x24, 0x92, 0x49),
+        constant(0x00), constant(0x11), constant(0x22), constant(0x33), constant(0x44), constant(0x55), constant(0x66), constant(0x77),
+        constant(0x88), constant(0x99), constant(0xAA), constant(0xBB), constant(0xCC), constant(0xDD), constant(0xEE), constant(0xFF),
+        pattern(0x92, 0x49, 0x24), pattern(0x49, 0x24, 0x92), pattern(0x24, 0x92, 0x49),
+        pattern(0x6D, 0xB6, 0xDB), pattern(0xB6, 0xDB, 0x6D), pattern(0xDB, 0x6D, 0xB6),
+        random(), random(), random(), random(),
+    };
+
+    // NIST SP 800-88 Rev. 1 Clear: one pass of a fixed value
+    constexpr Pass kNistClear[] = { constant(0x00) };
+
+    struct Scheme {
+        Id id;
+        const char* name;       // as typed in manifests and on the command line
+        const char* title;
+        const Pass* passes;     // nullptr when expanded from the requested pass count
+        size_t count;
+    };
+
+    constexpr Scheme kSchemes[] = {
+        { Id::Classic, "classic", "N passes alternating 0xFF and random data, then zeros", nullptr, 0 },
+        { Id::Random, "random", "N passes of random data, then zeros", nullptr, 0 },
+        { Id::DoD, "dod", "DoD 5220.22-M, 3 passes", kDoD, sizeof(kDoD) / sizeof(kDoD[0]) },
+        { Id::Gutmann, "gutmann", "Gutmann, 35 passes", kGutmann, sizeof(kGutmann) / sizeof(kGutmann[0]) },
+        { Id::NistClear, "nist-clear", "NIST SP 800-88 Clear, 1 pass of zeros", kNistClear, sizeof(kNistClear) / sizeof(kNistClear[0]) },
+    };
+
+    static_assert(sizeof(kGutmann) / sizeof(kGutmann[0]) == 35, "the Gutmann method has 35 passes");
+
+    // The passes to run. Fixed schemes ignore `passes`; classic and random runs use the custom
+    // pattern for every pass but the final zero pass when one is given.
+    std::vector<Pass> expand(Id id, size_t passes, bool customPattern);
+    size_t passCount(Id id, size_t passes);
+    // `scheme` when set, otherwise the target's own default (classic for files, random for partitions)
+    Id resolve(std::optional<Id> scheme, Id fallback);
+
+    bool parse(const std::string& text, Id& id);
+    const Scheme& info(Id id);
+    std::string describe(const Pass& pass);
+}
@@ -0,0 +1,323 @@
+#include "sim_device.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace sim_device {
+    namespace {
+        const char kPrefix[] = "sim:";
+
+        using Clock = std::chrono::steady_clock;
+
+        struct Device {
+            Spec spec;
+            std::mutex mutex;
+            Clock::time_point busyUntil;        // when the shared bandwidth is free again
+            unsigned long long written = 0;
+        };
+
+        std::mutex registryMutex;
+        std::map<int, std::shared_ptr<Device>> devices;
+        std::atomic<size_t> openDevices{ 0 };  // lets the real-device paths skip the lookup
+
+        std::shared_ptr<Device> find(int fd) {
+            if (openDevices == 0) {
+                return nullptr;
+            }
+            std::lock_guard<std::mutex> lock(registryMutex);
+            auto it = devices.find(fd);
+            return it != devices.end() ? it->second : nullptr;
+        }
+
+        // "64M", "4096", "1.5G": binary multiples
+        bool parseBytes(const std::string& text, double& value) {
+            char* end = nullptr;
+            value = std::strtod(text.c_str(), &end);
+            if (end == text.c_str() || !std::isfinite(value) || value < 0) {
+                return false;
+            }
+            std::string unit(end);
+            if (unit == "K" || unit == "k") {
+                value *= 1024.0;
+            }
+            else if (unit == "M" || unit == "m") {
+                value *= 1024.0 * 1024;
+            }
+            else if (unit == "G" || unit == "g") {
+                value *= 1024.0 * 1024 * 1024;
+            }
+            else if (unit == "T" || unit == "t") {
+                value *= 1024.0 * 1024 * 1024 * 1024;
+            }
+            else if (!unit.empty()) {
+                return false;
+            }
+            // Counts are converted to 64-bit integers; 2^64 is the first that does not fit
+            return value < 18446744073709551616.0;
+        }
+
+        // "500us", "2ms", "0.1s"
+        bool parseSeconds(const std::string& text, double& value) {
+            char* end = nullptr;
+            value = std::strtod(text.c_str(), &end);
+            if (end == text.c_str() || !std::isfinite(value) || value < 0) {
+                return false;
+            }
+            std::string unit(end);
+            if (unit == "us") {
+                value /= 1e6;
+            }
+            else if (unit == "ms") {
+                value /= 1e3;
+            }
+            else if (unit != "s") {
+                return false;
+            }
+            return true;
+        }
+
+        std::string formatSeconds(double seconds) {
+            std::ostringstream text;
+            if (seconds < 1e-3) {
+                text << seconds * 1e6 << " us";
+            }
+            else {
+                text << seconds * 1e3 << " ms";
+            }
+            return text.str();
+        }
+    }
+
+    bool isSimulated(const std::string& target) {
+        return target.compare(0, sizeof(kPrefix) - 1, kPrefix) == 0;
+    }
+
+    bool parse(const std::string& target, Spec& spec, std::string& error) {
+        if (!isSimulated(target)) {
+            error = "not a simulated device";
+            return false;
+        }
+        spec = Spec();
+        std::istringstream settings(target.substr(sizeof(kPrefix) - 1));
+        for (std::string setting; std::getline(settings, setting, ',');) {
+            if (setting.empty()) {
+                continue;
+            }
+            size_t equals = setting.find('=');
+            std::string key = setting.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : setting.substr(equals + 1);
+            double number = 0;
+            bool ok = true;
+            if (key == "file") {
+                spec.file = value;
+                ok = !value.empty();
+            }
+            else if (key == "latency") {
+                ok = parseSeconds(value, spec.latencySeconds);
+            }
+            else if (!parseBytes(value, number)) {
+                ok = false;
+            }
+            else if (key == "size") {
+                spec.size = static_cast<unsigned long long>(number);
+            }
+            else if (key == "sector") {
+                spec.sectorSize = static_cast<unsigned long>(number);
+                ok = spec.sectorSize >= 512 && (spec.sectorSize & (spec.sectorSize - 1)) == 0;
+            }
+            else if (key == "rate") {
+                spec.bytesPerSecond = number;
+            }
+            else if (key == "fail-at") {
+                spec.failAt.push_back(static_cast<unsigned long long>(number));
+            }
+            else if (key == "short-at") {
+                spec.shortAt.push_back(static_cast<unsigned long long>(number));
+            }
+            else if (key == "fail-after") {
+                spec.failAfter = static_cast<unsigned long long>(number);
+            }
+            else {
+                error = "unknown setting '" + key + "'";
+                return false;
+            }
+            if (!ok) {
+                error = "invalid value for " + key + ": '" + value + "'";
+                return false;
+            }
+        }
+        if (spec.size == 0 || spec.size % spec.sectorSize != 0) {
+            error = "size must be a nonzero multiple of the sector size";
+            return false;
+        }
+        return true;
+    }
+
+    std::string describe(const Spec& spec) {
+        std::ostringstream text;
+        text << utils::formatSize(spec.size) << ", " << spec.sectorSize << " B sectors, ";
+        text << (spec.bytesPerSecond > 0 ? utils::formatSize(static_cast<unsigned long long>(spec.bytesPerSecond)) + "/s" : "unlimited rate");
+        text << ", " << (spec.latencySeconds > 0 ? formatSeconds(spec.latencySeconds) : "no") << " latency";
+        size_t faults = spec.failAt.size() + spec.shortAt.size() + (spec.failAfter > 0 ? 1 : 0);
+        if (faults > 0) {
+            text << ", " << faults << (faults == 1 ? " fault" : " faults");
+        }
+        text << ", " << (spec.file.empty() ? "in memory" : "backed by " + spec.file);
+        return text.str();
+    }
+
+    bool usable(const Spec& spec, std::string& error) {
+        std::error_code ec;
+        if (spec.file.empty() || !fs::exists(spec.file, ec)) {
+            return true;
+        }
+        unsigned long long existing = fs::file_size(spec.file, ec);
+        if (ec) {
+            error = "backing file " + spec.file + ": " + ec.message();
+            return false;
+        }
+        if (existing != 0 && existing != spec.size) {
+            error = "backing file " + spec.file + " holds " + std::to_string(existing) + " bytes, not size=" + std::to_string(spec.size);
+            return false;
+        }
+        return true;
+    }
+
+#ifdef __linux__
+    int open(const std::string& target) {
+        Spec spec;
+        std::string error;
+        if (!parse(target, spec, error) || !usable(spec, error)) {
+            errno = EINVAL;
+            return -1;
+        }
+        int fd = spec.file.empty() ? memfd_create("shredder-sim", MFD_CLOEXEC) : ::open(spec.file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return -1;
+        }
+        // Sparse: nothing is allocated until written
+        if (ftruncate(fd, static_cast<off_t>(spec.size)) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        std::shared_ptr<Device> device = std::make_shared<Device>();
+        device->spec = spec;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        devices[fd] = device;
+        openDevices++;
+        return fd;
+    }
+
+    void release(int fd) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (devices.erase(fd) > 0) {
+            openDevices--;
+        }
+    }
+
+    Completion write(int fd, const void* data, size_t length, unsigned long long offset) {
+        Completion completion;
+        completion.at = Clock::now();
+        std::shared_ptr<Device> device = find(fd);
+        if (!device) {
+            completion.error = EBADF;
+            return completion;
+        }
+        const Spec& spec = device->spec;
+        unsigned long long end = offset + length;
+        if (offset % spec.sectorSize != 0 || length % spec.sectorSize != 0) {
+            completion.error = EINVAL;
+            return completion;
+        }
+        if (offset >= spec.size) {
+            completion.error = ENOSPC;
+            return completion;
+        }
+        size_t allowed = static_cast<size_t>(std::min(end, spec.size) - offset);
+        for (unsigned long long at : spec.failAt) {
+            if (at >= offset && at < end) {
+                completion.error = EIO;
+                return completion;
+            }
+        }
+        for (unsigned long long at : spec.shortAt) {
+            // Strictly inside, so the retry that starts at the offset goes through
+            if (at > offset && at < end) {
+                allowed = std::min(allowed, static_cast<size_t>(at - offset));
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(device->mutex);
+            if (spec.failAfter > 0 && device->written + allowed > spec.failAfter) {
+                completion.error = EIO;
+                return completion;
+            }
+            device->written += allowed;
+        }
+
+        const unsigned char* cursor = static_cast<const unsigned char*>(data);
+        for (size_t done = 0; done < allowed;) {
+            ssize_t result = pwrite(fd, cursor + done, allowed - done, static_cast<off_t>(offset + done));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                completion.error = result < 0 ? errno : EIO;
+                return completion;
+            }
+            done += static_cast<size_t>(result);
+        }
+        completion.written = allowed;
+
+        // The transfer queues behind the others for the bandwidth; the latency that follows it overlaps theirs
+        std::lock_guard<std::mutex> lock(device->mutex);
+        Clock::time_point start = std::max(Clock::now(), device->busyUntil);
+        device->busyUntil = spec.bytesPerSecond > 0
+            ? start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(allowed / spec.bytesPerSecond)) : start;
+        completion.at = device->busyUntil + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(spec.latencySeconds));
+        return completion;
+    }
+#else
+    int open(const std::string&) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    void release(int) {}
+
+    Completion write(int, const void*, size_t, unsigned long long) {
+        Completion completion;
+        completion.at = Clock::now();
+        completion.error = ENOSYS;
+        return completion;
+    }
+#endif
+
+    bool simulated(int fd) {
+        return find(fd) != nullptr;
+    }
+
+    unsigned long sectorSize(int fd) {
+        std::shared_ptr<Device> device = find(fd);
+        return device ? device->spec.sectorSize : 0;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// sim_device.h
+// A block device that is not one, so the partition path (write engine, queue depth, checkpoints,
+// error handling) can be benchmarked and tested repeatably without root. A target named
+//   sim:size=1G,sector=4096,rate=200M,latency=500us,fail-at=64M,short-at=96M,fail-after=300M,file=/tmp/disk.img
+// opens a sparse file (or, without file=, memory) behind volume_utils. Writes take effect at once
+// but complete on the device's clock: transfers share `rate` one after another, and each then waits
+// `latency`, which overlaps with the other requests in flight. Reads are not timed. Linux only.
+namespace sim_device {
+    struct Spec {
+        unsigned long long size = 1ULL << 30;
+        unsigned long sectorSize = 512;             // logical and physical; unaligned writes fail with EINVAL
+        double bytesPerSecond = 0;                  // 0 = unlimited
+        double latencySeconds = 0;                  // per write request
+        std::vector<unsigned long long> failAt;     // writes covering one of these offsets fail with EIO
+        std::vector<unsigned long long> shortAt;    // writes across one of these offsets stop at it
+        unsigned long long failAfter = 0;           // once this many bytes were written, every write fails; 0 = never
+        std::string file;                           // backing file, created at `size`; empty = memory
+    };
+
+    // When a write is done on the device's clock, and what came of it
+    struct Completion {
+        std::chrono::steady_clock::time_point at;
+        size_t written = 0;
+        int error = 0;                              // errno value; 0 with written < length is a short write
+    };
+
+    bool isSimulated(const std::string& target);
+    // False with the reason for a malformed description
+    bool parse(const std::string& target, Spec& spec, std::string& error);
+    std::string describe(const Spec& spec);
+    // False with the reason when an existing backing file is not `size` bytes; an empty file counts as new.
+    // A disk of another size is another disk, and resizing it would destroy or invent data.
+    bool usable(const Spec& spec, std::string& error);
+
+    // A descriptor registered as a simulated device, or -1 with errno set (EINVAL when not usable)
+    int open(const std::string& target);
+    // Unregisters the descriptor; the caller closes it.
+    void release(int fd);
+
+    bool simulated(int fd);
+    unsigned long sectorSize(int fd);
+    // Performs the write now and returns when the device would have finished it.
+    Completion write(int fd, const void* data, size_t length, unsigned long long offset);
+}
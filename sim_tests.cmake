@@ -0,0 +1,79 @@
+# sim_tests.cmake
+# Runs the partition path against simulated devices (sim_device) and checks exit codes and output.
+# Invoked by ctest as: cmake -DSHREDDER=<binary> -DWORK=<scratch dir> -DCASE=<name> -P sim_tests.cmake
+
+set(ENV{SHREDDER_PROGRESS} off)
+set(ENV{SHREDDER_METRICS} off)
+file(REMOVE_RECURSE "${WORK}/${CASE}")
+file(MAKE_DIRECTORY "${WORK}/${CASE}")
+set(dir "${WORK}/${CASE}")
+
+# Runs the shredder in the case's directory (journals and logs land there) and checks its exit code
+# and that its output contains every expected string.
+function(shred expected_exit)
+    cmake_parse_arguments(RUN "" "" "ARGS;EXPECT" ${ARGN})
+    execute_process(COMMAND "${SHREDDER}" ${RUN_ARGS} --yes
+        WORKING_DIRECTORY "${dir}"
+        RESULT_VARIABLE code
+        OUTPUT_VARIABLE out
+        ERROR_VARIABLE out)
+    if(NOT code EQUAL expected_exit)
+        message(FATAL_ERROR "${RUN_ARGS}: exit ${code}, expected ${expected_exit}\n${out}")
+    endif()
+    foreach(text IN LISTS RUN_EXPECT)
+        string(FIND "${out}" "${text}" found)
+        if(found EQUAL -1)
+            message(FATAL_ERROR "${RUN_ARGS}: output lacks '${text}'\n${out}")
+        endif()
+    endforeach()
+endfunction()
+
+if(CASE STREQUAL "fail-at")
+    # The chunk covering the faulty offset fails the job
+    shred(1 ARGS partition "sim:size=32M,fail-at=20M" --passes 1
+        EXPECT "Write failed at offset" "Input/output error")
+elseif(CASE STREQUAL "short-at")
+    # Writes cut short at 20M are finished by a retry, which full verification confirms
+    shred(0 ARGS partition "sim:size=32M,sector=4096,short-at=20M,short-at=28M" --passes 2 --verify every-pass
+        EXPECT "Verification of pass 3" "OK" "shredded successfully")
+elseif(CASE STREQUAL "resume")
+    # Stopped by fail-after in pass 2, then resumed on the same backing file without the fault
+    set(disk "sim:size=32M,file=${dir}/disk.img")
+    shred(1 ARGS partition "${disk},fail-after=48M" --checkpoint --passes 3
+        EXPECT "Input/output error")
+    shred(0 ARGS partition "${disk},latency=100us" --resume --passes 3 --verify full
+        EXPECT "Resuming interrupted run at pass 2" "Verification of pass 4" "shredded successfully")
+elseif(CASE STREQUAL "size-mismatch")
+    # An existing backing file of another size is refused, not truncated
+    file(WRITE "${dir}/disk.img" "not a disk")
+    shred(2 ARGS partition "sim:size=32M,file=${dir}/disk.img"
+        EXPECT "invalid simulated device")
+    file(SIZE "${dir}/disk.img" size)
+    if(NOT size EQUAL 10)
+        message(FATAL_ERROR "backing file was resized to ${size} bytes")
+    endif()
+elseif(CASE STREQUAL "bad-spec")
+    # Non-finite and oversized values in a device spec are refused
+    shred(2 ARGS partition "sim:size=nan"
+        EXPECT "invalid value for size")
+    shred(2 ARGS partition "sim:size=1e30T"
+        EXPECT "invalid value for size")
+    shred(2 ARGS partition "sim:size=32M,latency=inf"
+        EXPECT "invalid value for latency")
+elseif(CASE STREQUAL "negative")
+    # Signed and padded numbers are refused rather than wrapped around
+    shred(2 ARGS partition "sim:size=32M" --passes -1 --dry-run
+        EXPECT "passes must be a number")
+    shred(2 ARGS partition "sim:size=32M" --passes " 2" --dry-run
+        EXPECT "passes must be a number")
+    shred(2 ARGS partition "sim:size=32M" --rate -1 --dry-run
+        EXPECT "rate must be a number")
+    shred(2 ARGS partition "sim:size=32M" --parallel -1 --dry-run
+        EXPECT "--parallel needs a number")
+    shred(2 ARGS free-space "${dir}" --reserve nan --dry-run
+        EXPECT "reserve must be a size")
+    shred(2 ARGS free-space "${dir}" --reserve inf% --dry-run
+        EXPECT "reserve must be a size")
+else()
+    message(FATAL_ERROR "unknown case '${CASE}'")
+endif()
@@ -0,0 +1,256 @@
+#include "small_file_shredder.h"
+#include "buffer_pool.h"
+#include "file_shredder.h"
+#include "io_queue.h"
+#include "io_qos.h"
+#include "logger.h"
+#include "metrics.h"
+#include "progress.h"
+#include "random_engine.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace small_file_shredder {
+#ifdef __linux__
+    namespace {
+        struct Entry {
+            size_t index;
+            int fd;
+            size_t size;
+            bool failed;
+            size_t passesWritten;
+        };
+
+        std::string errnoText(int error) {
+            return std::string(std::strerror(error));
+        }
+
+        void fail(Entry& entry, std::vector<Outcome>& outcomes, const std::string& what, int error) {
+            entry.failed = true;
+            outcomes[entry.index].error = what + ": " + errnoText(error);
+        }
+
+        bool writeAndSync(int fd, const unsigned char* data, size_t length, size_t offset) {
+            io_qos::Write admitted(length);
+            {
+                metrics::Scoped timed(metrics::Timer::Write, length);
+                while (length > 0) {
+                    ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+                    if (written < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (written <= 0) {
+                        return false;
+                    }
+                    data += written;
+                    length -= static_cast<size_t>(written);
+                    offset += static_cast<size_t>(written);
+                }
+            }
+            metrics::Scoped flushed(metrics::Timer::Flush);
+            return fdatasync(fd) == 0;
+        }
+
+        // One pass over the batch: a write linked to an fdatasync per file, all submitted together.
+        void writePassUring(io_queue::Ring& ring, std::vector<Entry>& entries, const unsigned char* block,
+            std::vector<Outcome>& outcomes) {
+            std::vector<iovec> iovs(entries.size());
+            std::vector<size_t> shortWrites(entries.size(), 0);
+            unsigned queued = 0;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (entries[i].failed || entries[i].size == 0) {
+                    continue;
+                }
+                io_qos::admit(entries[i].size);
+                iovs[i].iov_base = const_cast<unsigned char*>(block);
+                iovs[i].iov_len = entries[i].size;
+                ring.queueWrite(entries[i].fd, &iovs[i], 0, i * 2, true);
+                ring.queueDataSync(entries[i].fd, i * 2 + 1);
+                queued += 2;
+            }
+            auto submitted = std::chrono::steady_clock::now();
+            ring.submit();
+
+            for (unsigned completed = 0; completed < queued; ++completed) {
+                uint64_t userData = 0;
+                int result = 0;
+                ring.waitCompletion(userData, result);
+                Entry& entry = entries[static_cast<size_t>(userData / 2)];
+                bool isWrite = userData % 2 == 0;
+                if (isWrite && result >= 0 && static_cast<size_t>(result) < entry.size) {
+                    // The linked sync is cancelled after a short write; finish both synchronously below.
+                    shortWrites[static_cast<size_t>(userData / 2)] = static_cast<size_t>(result) + 1;
+                }
+                else if (result < 0 && !(result == -ECANCELED && shortWrites[static_cast<size_t>(userData / 2)] != 0) && !entry.failed) {
+                    fail(entry, outcomes, isWrite ? "write failed" : "fdatasync failed", -result);
+                }
+            }
+            if (queued > 0) {
+                // The files were written side by side; each one's share of the batch stands in for its latency
+                std::chrono::nanoseconds share = (std::chrono::steady_clock::now() - submitted) / (queued / 2);
+                io_qos::observe(std::chrono::duration<double>(share).count());
+                for (const Entry& entry : entries) {
+                    if (!entry.failed && entry.size > 0) {
+                        metrics::record(metrics::Timer::Write, share, entry.size);
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (shortWrites[i] != 0 && !entries[i].failed) {
+                    size_t done = shortWrites[i] - 1;
+                    if (!writeAndSync(entries[i].fd, block + done, entries[i].size - done, done)) {
+                        fail(entries[i], outcomes, "write failed", errno);
+                    }
+                }
+            }
+        }
+
+        void writePassSync(std::vector<Entry>& entries, const unsigned char* block, std::vector<Outcome>& outcomes) {
+            for (auto& entry : entries) {
+                if (!entry.failed && entry.size > 0 && !writeAndSync(entry.fd, block, entry.size, 0)) {
+                    fail(entry, outcomes, "write failed", errno);
+                }
+            }
+        }
+    }
+#endif
+
+    std::vector<Outcome> shredBatch(const std::string& directory, const std::vector<std::string>& names, size_t passes,
+        const std::vector<unsigned char>& customPattern, unsigned long long threshold, std::optional<schemes::Id> scheme, int directoryFd) {
+        std::vector<Outcome> outcomes(names.size());
+        // Callers count batched files in the progress totals when they queue them
+        file_shredder::ShredOptions quiet;
+        quiet.quiet = true;
+        quiet.announced = true;
+        quiet.scheme = scheme;
+
+#ifndef __linux__
+        for (size_t i = 0; i < names.size(); ++i) {
+            std::string path = directory + "/" + names[i];
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(path, ec);
+            outcomes[i].bytes = ec ? 0 : size;
+            outcomes[i].shredded = file_shredder::securelyDelete(path, passes, customPattern, quiet);
+        }
+        (void)threshold;
+        (void)directoryFd;
+        return outcomes;
+#else
+        int dirFd = directoryFd >= 0 ? directoryFd : open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            for (auto& outcome : outcomes) {
+                outcome.error = "cannot open directory: " + errnoText(errno);
+            }
+            return outcomes;
+        }
+
+        std::vector<Entry> entries;
+        entries.reserve(names.size());
+        size_t largest = 0;
+        for (size_t i = 0; i < names.size(); ++i) {
+            int fd = openat(dirFd, names[i].c_str(), O_WRONLY | O_CLOEXEC | O_NOFOLLOW);
+            struct stat info;
+            if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+                outcomes[i].error = fd < 0 ? "open failed: " + errnoText(errno) : "not a regular file";
+                if (fd >= 0) {
+                    close(fd);
+                }
+                continue;
+            }
+            if (static_cast<unsigned long long>(info.st_size) > threshold) {
+                close(fd);
+                outcomes[i].bytes = static_cast<unsigned long long>(info.st_size);
+                outcomes[i].shredded = file_shredder::securelyDelete(directory + "/" + names[i], passes, customPattern, quiet);
+                continue;
+            }
+            entries.push_back(Entry{ i, fd, static_cast<size_t>(info.st_size), false, 0 });
+            largest = std::max(largest, static_cast<size_t>(info.st_size));
+        }
+
+        // Pattern blocks shared with every other batch and file; only the random block is per batch
+        const std::vector<schemes::Pass> sequence = schemes::expand(schemes::resolve(scheme, schemes::Id::Classic), passes, !customPattern.empty());
+        const size_t total = sequence.size();
+        size_t blockSize = std::max<size_t>(largest, 1);
+        std::vector<std::shared_ptr<const unsigned char>> blocks(total);
+        buffer_pool::Lease randomBlock;
+        for (size_t pass = 0; pass < total; ++pass) {
+            if (sequence[pass].kind != schemes::PassKind::Random) {
+                blocks[pass] = buffer_pool::patternBlock(sequence[pass].kind == schemes::PassKind::Custom ? customPattern : sequence[pass].pattern(), blockSize);
+            }
+            else if (!randomBlock.get()) {
+                randomBlock = buffer_pool::acquire(blockSize);
+                random_engine::fill(random_engine::newKeystream(), randomBlock.get(), blockSize, 0, 1);
+            }
+        }
+
+        progress::Device* tracker = progress::device(utils::getDeviceId(directory));
+
+        // One ring per worker thread, reused across batches
+        thread_local std::unique_ptr<io_queue::Ring> ring = io_queue::Ring::create(static_cast<unsigned>(2 * kDefaultBatchSize));
+
+        for (size_t pass = 1; pass <= total; ++pass) {
+            const unsigned char* block = blocks[pass - 1] ? blocks[pass - 1].get() : randomBlock.get();
+            for (size_t begin = 0; begin < entries.size(); begin += kDefaultBatchSize) {
+                std::vector<Entry> slice(entries.begin() + begin, entries.begin() + std::min(entries.size(), begin + kDefaultBatchSize));
+                if (ring) {
+                    writePassUring(*ring, slice, block, outcomes);
+                }
+                else {
+                    writePassSync(slice, block, outcomes);
+                }
+                std::copy(slice.begin(), slice.end(), entries.begin() + begin);
+            }
+            for (auto& entry : entries) {
+                if (!entry.failed) {
+                    entry.passesWritten++;
+                    progress::addBytes(tracker, entry.size);
+                }
+            }
+        }
+
+        for (auto& entry : entries) {
+            const std::string& name = names[entry.index];
+            if (entry.failed) {
+                progress::removeExpected(tracker, static_cast<unsigned long long>(entry.size) * (total - entry.passesWritten));
+                close(entry.fd);
+                logger::error("Failed to securely delete file: " + outcomes[entry.index].error, { directory + "/" + name });
+                continue;
+            }
+            std::string newName = name + "." + utils::generateRandomString(10);
+            if (ftruncate(entry.fd, 0) != 0) {
+                fail(entry, outcomes, "truncate failed", errno);
+            }
+            else if (renameat(dirFd, name.c_str(), dirFd, newName.c_str()) != 0) {
+                fail(entry, outcomes, "rename failed", errno);
+            }
+            else if (unlinkat(dirFd, newName.c_str(), 0) != 0) {
+                fail(entry, outcomes, "unlink failed", errno);
+            }
+            close(entry.fd);
+            if (entry.failed) {
+                logger::error("Failed to securely delete file: " + outcomes[entry.index].error, { directory + "/" + name });
+            }
+            else {
+                outcomes[entry.index].shredded = true;
+                outcomes[entry.index].bytes = entry.size;
+            }
+        }
+        if (dirFd != directoryFd) {
+            close(dirFd);
+        }
+        return outcomes;
+#endif
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "schemes.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// small_file_shredder.h
+// Fast path for files below a size threshold, where per-file overhead dominates the data writes.
+// A batch of files from one directory shares one set of pattern blocks; every pass is a positional
+// write on the file's single descriptor followed by fdatasync, issued for the whole batch at once
+// through io_uring on Linux. Opens, renames and unlinks are relative to the directory's fd.
+namespace small_file_shredder {
+    const unsigned long long kDefaultThreshold = 64 * 1024;
+    const size_t kDefaultBatchSize = 64;
+
+    struct Outcome {
+        bool shredded = false;
+        unsigned long long bytes = 0;
+        std::string error;
+    };
+
+    // All names must live in `directory`. Files that grew past the threshold are still shredded,
+    // one descriptor at a time, through the regular file_shredder path. `directoryFd` is an open
+    // descriptor of `directory` to work relative to (Linux only); -1 opens the directory by path.
+    std::vector<Outcome> shredBatch(const std::string& directory, const std::vector<std::string>& names, size_t passes,
+        const std::vector<unsigned char>& customPattern, unsigned long long threshold = kDefaultThreshold,
+        std::optional<schemes::Id> scheme = {}, int directoryFd = -1);
+}
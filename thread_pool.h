@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// thread_pool.h
+// Work-stealing thread pool. Each worker owns a deque: tasks submitted from a worker go to the
+// back of its own deque and are popped LIFO; idle workers steal FIFO from the front of others.
+// Tasks must not throw.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(std::function<void()> task);
+    void waitIdle();
+    size_t size() const { return threads_.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool tryPop(size_t index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::atomic<size_t> queued_{ 0 };
+    std::atomic<size_t> pending_{ 0 };
+    std::atomic<size_t> nextQueue_{ 0 };
+    bool stopping_ = false;
+};
@@ -1,17 +1,26 @@
-#pragma once
-#include <string>
-#include <vector>
-#include <windows.h>
-#include <sstream> 
-#include <iomanip> 
-
-namespace utils {
-    std::string generateRandomString(size_t length);
-    size_t determineBufferSize();
-    std::vector<unsigned char> generateRandomBuffer(size_t bufferSize);
-    bool isAdmin();
-    std::wstring stringToWString(const std::string& str);
-    std::string formatSize(ULONGLONG size);
-    void displayProgressBar(ULONGLONG current, ULONGLONG total, double elapsed, double eta);
-    void logMessage(const std::string& message);
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <sstream> 
+#include <iomanip> 
+
+namespace utils {
+    std::string generateRandomString(size_t length);
+    std::vector<unsigned char> generateRandomBuffer(size_t bufferSize);
+    bool isAdmin();
+    std::wstring stringToWString(const std::string& str);
+    std::string formatSize(unsigned long long size);
+    unsigned long long getDeviceId(const std::string& path);
+
+    // Buffers suitable for unbuffered / O_DIRECT I/O
+    struct AlignedDeleter {
+        void operator()(unsigned char* ptr) const;
+    };
+    using AlignedBuffer = std::unique_ptr<unsigned char[], AlignedDeleter>;
+    const size_t kIoAlignment = 4096;
+    AlignedBuffer allocateAligned(size_t size, size_t alignment = kIoAlignment);
 }
\ No newline at end of file
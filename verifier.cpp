@@ -0,0 +1,416 @@
+#include "verifier.h"
+#include "buffer_pool.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <random>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHRED_X86_KERNELS 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHRED_TARGET_SSE2
+#define SHRED_TARGET_AVX2
+#else
+#define SHRED_TARGET_SSE2 __attribute__((target("sse2")))
+#define SHRED_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace verifier {
+    namespace {
+        const size_t kReadChunk = 4 * 1024 * 1024;
+        const size_t kRangeGranularity = 4096;      // differing bytes closer than this are reported as one range
+        const size_t kKeystreamPiece = 64 * 1024;   // regenerated keystream stays in L2 while it is compared
+
+        // Index of the first byte where data differs from expected (or from value), length when none does.
+        using DiffFn = size_t (*)(const unsigned char* data, const unsigned char* expected, size_t length);
+        using DiffValueFn = size_t (*)(const unsigned char* data, unsigned char value, size_t length);
+
+        size_t diffScalar(const unsigned char* data, const unsigned char* expected, size_t length) {
+            for (size_t i = 0; i < length; ++i) {
+                if (data[i] != expected[i]) {
+                    return i;
+                }
+            }
+            return length;
+        }
+
+        size_t diffValueScalar(const unsigned char* data, unsigned char value, size_t length) {
+            for (size_t i = 0; i < length; ++i) {
+                if (data[i] != value) {
+                    return i;
+                }
+            }
+            return length;
+        }
+
+#ifdef SHRED_X86_KERNELS
+        inline unsigned firstClearBit(unsigned mask) {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, ~mask);
+            return index;
+#else
+            return static_cast<unsigned>(__builtin_ctz(~mask));
+#endif
+        }
+
+        SHRED_TARGET_SSE2 size_t diffSSE2(const unsigned char* data, const unsigned char* expected, size_t length) {
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(expected + i));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+                if (mask != 0xFFFF) {
+                    return i + firstClearBit(mask);
+                }
+            }
+            return i + diffScalar(data + i, expected + i, length - i);
+        }
+
+        SHRED_TARGET_SSE2 size_t diffValueSSE2(const unsigned char* data, unsigned char value, size_t length) {
+            const __m128i b = _mm_set1_epi8(static_cast<char>(value));
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+                if (mask != 0xFFFF) {
+                    return i + firstClearBit(mask);
+                }
+            }
+            return i + diffValueScalar(data + i, value, length - i);
+        }
+
+        // 128 bytes per iteration: four compares folded into one mask test; the exact byte is located
+        // by the 32-byte loop only once a block is known to differ.
+        SHRED_TARGET_AVX2 size_t diffAVX2(const unsigned char* data, const unsigned char* expected, size_t length) {
+            size_t i = 0;
+            for (; i + 128 <= length; i += 128) {
+                __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(expected + i)));
+                for (size_t lane = 32; lane < 128; lane += 32) {
+                    eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + lane)),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(expected + i + lane))));
+                }
+                if (static_cast<unsigned>(_mm256_movemask_epi8(eq)) != 0xFFFFFFFFu) {
+                    break;
+                }
+            }
+            for (; i + 32 <= length; i += 32) {
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(expected + i)))));
+                if (mask != 0xFFFFFFFFu) {
+                    return i + firstClearBit(mask);
+                }
+            }
+            return i + diffScalar(data + i, expected + i, length - i);
+        }
+
+        SHRED_TARGET_AVX2 size_t diffValueAVX2(const unsigned char* data, unsigned char value, size_t length) {
+            const __m256i b = _mm256_set1_epi8(static_cast<char>(value));
+            size_t i = 0;
+            for (; i + 128 <= length; i += 128) {
+                __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), b);
+                for (size_t lane = 32; lane < 128; lane += 32) {
+                    eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + lane)), b));
+                }
+                if (static_cast<unsigned>(_mm256_movemask_epi8(eq)) != 0xFFFFFFFFu) {
+                    break;
+                }
+            }
+            for (; i + 32 <= length; i += 32) {
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), b)));
+                if (mask != 0xFFFFFFFFu) {
+                    return i + firstClearBit(mask);
+                }
+            }
+            return i + diffValueScalar(data + i, value, length - i);
+        }
+#endif
+
+        struct Kernels {
+            DiffFn diff;
+            DiffValueFn diffValue;
+        };
+
+        const Kernels& kernels() {
+            static const Kernels selected = [] {
+#ifdef SHRED_X86_KERNELS
+                if (random_engine::kernelSupported(random_engine::Kernel::AVX2)) {
+                    return Kernels{ diffAVX2, diffValueAVX2 };
+                }
+                if (random_engine::kernelSupported(random_engine::Kernel::SSE2)) {
+                    return Kernels{ diffSSE2, diffValueSSE2 };
+                }
+#endif
+                return Kernels{ diffScalar, diffValueScalar };
+            }();
+            return selected;
+        }
+
+        // Compares chunks in offset order and folds the differences into the result.
+        class Checker {
+        public:
+            Checker(const Expected& expected, Result& result) : expected_(expected), result_(result) {
+                if (expected_.kind == Expected::Kind::Keystream) {
+                    // Not leased from the pool: verify() already holds its read buffers there
+                    scratch_ = utils::allocateAligned(kKeystreamPiece);
+                }
+            }
+
+            void check(const unsigned char* data, size_t length, unsigned long long offset) {
+                result_.bytesChecked += length;
+                while (length > 0) {
+                    size_t piece = length;
+                    const unsigned char* expected = nullptr;
+                    if (expected_.kind == Expected::Kind::Repeating) {
+                        size_t phase = static_cast<size_t>(offset % expected_.period);
+                        piece = std::min(length, expected_.period - phase);
+                        expected = expected_.block.get() + phase;
+                    }
+                    else if (expected_.kind == Expected::Kind::Keystream) {
+                        piece = std::min(length, kKeystreamPiece);
+                        random_engine::fill(expected_.stream, scratch_.get(), piece, offset, 1);
+                        expected = scratch_.get();
+                    }
+                    scan(data, expected, piece, offset);
+                    data += piece;
+                    offset += piece;
+                    length -= piece;
+                }
+            }
+
+        private:
+            size_t firstDiff(const unsigned char* data, const unsigned char* expected, size_t length) const {
+                return expected != nullptr ? kernels().diff(data, expected, length) : kernels().diffValue(data, expected_.value, length);
+            }
+
+            bool differs(const unsigned char* data, const unsigned char* expected, size_t i) const {
+                return data[i] != (expected != nullptr ? expected[i] : expected_.value);
+            }
+
+            void scan(const unsigned char* data, const unsigned char* expected, size_t length, unsigned long long offset) {
+                size_t pos = firstDiff(data, expected, length);
+                while (pos < length) {
+                    // Count exactly inside the granule that differs, then resume the fast scan after it.
+                    size_t end = static_cast<size_t>(std::min<unsigned long long>(length,
+                        ((offset + pos) / kRangeGranularity + 1) * kRangeGranularity - offset));
+                    size_t last = pos;
+                    unsigned long long count = 0;
+                    for (size_t i = pos; i < end; ++i) {
+                        if (differs(data, expected, i)) {
+                            count++;
+                            last = i;
+                        }
+                    }
+                    record(offset + pos, offset + last + 1, count);
+                    pos = end + firstDiff(data + end, expected != nullptr ? expected + end : nullptr, length - end);
+                }
+            }
+
+            void record(unsigned long long begin, unsigned long long end, unsigned long long count) {
+                result_.bytesMismatched += count;
+                std::vector<Mismatch>& ranges = result_.mismatches;
+                if (!ranges.empty() && begin - (ranges.back().offset + ranges.back().length) < kRangeGranularity) {
+                    ranges.back().length = end - ranges.back().offset;
+                }
+                else if (ranges.size() < kMaxReportedMismatches) {
+                    ranges.push_back({ begin, end - begin });
+                }
+            }
+
+            const Expected& expected_;
+            Result& result_;
+            utils::AlignedBuffer scratch_;
+        };
+
+        // Byte ranges to read back, ascending. Sampled mode picks blocks across the extents laid end to end
+        // and always includes the first and last block.
+        std::vector<std::pair<unsigned long long, unsigned long long>> planRanges(std::vector<extent_map::Extent> extents, const Options& options) {
+            std::sort(extents.begin(), extents.end(), [](const extent_map::Extent& a, const extent_map::Extent& b) { return a.offset < b.offset; });
+            std::vector<std::pair<unsigned long long, unsigned long long>> ranges;
+            unsigned long long size = 0;
+            for (const extent_map::Extent& extent : extents) {
+                size += extent.length;
+            }
+            if (size == 0) {
+                return ranges;
+            }
+            const unsigned long long sample = (std::max<size_t>(options.sampleSize, 1) + utils::kIoAlignment - 1) / utils::kIoAlignment * utils::kIoAlignment;
+            const unsigned long long blocks = (size + sample - 1) / sample;
+            unsigned long long wanted = static_cast<unsigned long long>(size * std::min(std::max(options.sampleFraction, 0.0), 1.0) / sample + 0.999999);
+            wanted = std::max<unsigned long long>(wanted, 2);
+            if (options.mode == Mode::Full || wanted >= blocks) {
+                for (const extent_map::Extent& extent : extents) {
+                    ranges.emplace_back(extent.offset, extent.length);
+                }
+                return ranges;
+            }
+
+            // Floyd's algorithm: `wanted` distinct block indices without materialising all of them
+            std::set<unsigned long long> chosen{ 0, blocks - 1 };
+            std::mt19937_64 rng(std::random_device{}());
+            for (unsigned long long j = blocks - (wanted - 2); j < blocks && chosen.size() < wanted; ++j) {
+                unsigned long long pick = std::uniform_int_distribution<unsigned long long>(1, j - 1)(rng);
+                chosen.insert(chosen.count(pick) ? j - 1 : pick);
+            }
+
+            // Map each chosen block of the concatenated extents back onto file offsets
+            size_t current = 0;
+            unsigned long long base = 0;    // concatenated position where extents[current] starts
+            for (unsigned long long index : chosen) {
+                unsigned long long begin = index * sample;
+                unsigned long long end = std::min(begin + sample, size);
+                while (begin < end) {
+                    while (base + extents[current].length <= begin) {
+                        base += extents[current++].length;
+                    }
+                    unsigned long long offset = extents[current].offset + (begin - base);
+                    unsigned long long length = std::min(end, base + extents[current].length) - begin;
+                    if (!ranges.empty() && ranges.back().first + ranges.back().second == offset) {
+                        ranges.back().second += length;
+                    }
+                    else {
+                        ranges.emplace_back(offset, length);
+                    }
+                    begin += length;
+                }
+            }
+            return ranges;
+        }
+    }
+
+    Expected Expected::constant(unsigned char value) {
+        Expected expected;
+        expected.kind = Kind::Constant;
+        expected.value = value;
+        return expected;
+    }
+
+    Expected Expected::repeating(std::shared_ptr<const unsigned char> block, size_t period) {
+        Expected expected;
+        expected.kind = Kind::Repeating;
+        expected.block = std::move(block);
+        expected.period = std::max<size_t>(period, 1);
+        return expected;
+    }
+
+    Expected Expected::keystream(const random_engine::Keystream& stream) {
+        Expected expected;
+        expected.kind = Kind::Keystream;
+        expected.stream = stream;
+        return expected;
+    }
+
+    Result verify(volume_utils::VolumeHandle handle, unsigned long long size, const Expected& expected, const Options& options) {
+        return verify(handle, std::vector<extent_map::Extent>{ { 0, size, 0 } }, expected, options);
+    }
+
+    Result verify(volume_utils::VolumeHandle handle, const std::vector<extent_map::Extent>& extents, const Expected& expected, const Options& options) {
+        Result result;
+        if (options.mode == Mode::Off) {
+            return result;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!volume_utils::dropCache(handle)) {
+            result.error = "cannot flush and evict cached data (" + volume_utils::lastErrorMessage() + ")";
+            return result;
+        }
+
+        std::vector<buffer_pool::Lease> buffers = buffer_pool::acquire(2, kReadChunk);
+        Checker checker(expected, result);
+        std::future<void> comparing;
+        size_t turn = 0;
+
+        // Chunk i is read into one buffer while chunk i - 1 is compared from the other.
+        for (const auto& range : planRanges(extents, options)) {
+            const unsigned long long rangeEnd = range.first + range.second;
+            for (unsigned long long offset = range.first; offset < rangeEnd && result.error.empty(); offset += kReadChunk) {
+                size_t wanted = static_cast<size_t>(std::min<unsigned long long>(kReadChunk, rangeEnd - offset));
+                size_t request = (wanted + utils::kIoAlignment - 1) / utils::kIoAlignment * utils::kIoAlignment;
+                unsigned char* buffer = buffers[turn++ % 2].get();
+                size_t got = 0;
+                bool ok = volume_utils::readAt(handle, buffer, request, offset, got);
+                if (comparing.valid()) {
+                    comparing.get();
+                }
+                if (!ok) {
+                    result.error = "read failed at offset " + std::to_string(offset) + " (" + volume_utils::lastErrorMessage() + ")";
+                    break;
+                }
+                got = std::min(got, wanted);
+                if (got < wanted) {
+                    result.error = "target ends at " + std::to_string(offset + got) + ", expected data up to " + std::to_string(rangeEnd);
+                }
+                comparing = std::async(std::launch::async, [&checker, buffer, got, offset]() { checker.check(buffer, got, offset); });
+            }
+            if (!result.error.empty()) {
+                break;
+            }
+        }
+        if (comparing.valid()) {
+            comparing.get();
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        return result;
+    }
+
+    Result verifyFile(const std::string& path, unsigned long long size, const Expected& expected, const Options& options) {
+        return verifyFile(path, std::vector<extent_map::Extent>{ { 0, size, 0 } }, expected, options);
+    }
+
+    Result verifyFile(const std::string& path, const std::vector<extent_map::Extent>& extents, const Expected& expected, const Options& options) {
+        if (options.mode == Mode::Off) {
+            return Result{};
+        }
+        volume_utils::VolumeHandle handle = volume_utils::openForReadback(path);
+        if (handle == volume_utils::kInvalidVolume) {
+            Result result;
+            result.error = "cannot open for read-back (" + volume_utils::lastErrorMessage() + ")";
+            return result;
+        }
+        Result result = verify(handle, extents, expected, options);
+        volume_utils::closeVolume(handle);
+        return result;
+    }
+
+    std::string describe(const Result& result) {
+        std::ostringstream out;
+        double rate = result.seconds > 0 ? result.bytesChecked / result.seconds : 0.0;
+        out << "checked " << utils::formatSize(result.bytesChecked) << " in " << std::fixed;
+        out.precision(2);
+        out << result.seconds << "s (" << utils::formatSize(static_cast<unsigned long long>(rate)) << "/s)";
+        if (!result.error.empty()) {
+            out << ", error: " << result.error;
+        }
+        if (result.bytesMismatched > 0) {
+            out << ", " << result.bytesMismatched << " bytes differ";
+            for (size_t i = 0; i < result.mismatches.size() && i < 4; ++i) {
+                out << (i == 0 ? " at offset " : ", ") << result.mismatches[i].offset << "+" << result.mismatches[i].length;
+            }
+            if (result.mismatches.size() > 4) {
+                out << ", ...";
+            }
+        }
+        else if (result.error.empty()) {
+            out << ", OK";
+        }
+        return out.str();
+    }
+
+    std::string modeName(Mode mode) {
+        switch (mode) {
+        case Mode::Sampled: return "sampled";
+        case Mode::Full: return "full";
+        default: return "off";
+        }
+    }
+}
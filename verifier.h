@@ -0,0 +1,68 @@
+#pragma once
+#include "extent_map.h"
+#include "random_engine.h"
+#include "volume_utils.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// verifier.h
+// Read-back check that a pass actually reached the media. Data is read without the page cache
+// (O_DIRECT / FILE_FLAG_NO_BUFFERING, or after flushing and evicting it) and compared with SIMD
+// kernels against what the pass wrote: a constant byte, a repeated pattern block, or the pass's
+// keystream regenerated at each offset. Reading and comparing overlap, so a full check runs at
+// close to read bandwidth; the sampled mode reads a random subset of fixed-size blocks.
+namespace verifier {
+    enum class Mode { Off, Sampled, Full };
+
+    struct Options {
+        Mode mode = Mode::Off;
+        bool everyPass = false;             // check each pass, not only the final zero pass
+        double sampleFraction = 0.01;       // Sampled: share of the target read back
+        size_t sampleSize = 1024 * 1024;    // Sampled: bytes per sample, a multiple of 4096
+    };
+
+    // Content a pass left on the target
+    struct Expected {
+        enum class Kind { Constant, Repeating, Keystream };
+
+        static Expected constant(unsigned char value);
+        // block[offset % period]: pattern passes restart the block at every chunk boundary
+        static Expected repeating(std::shared_ptr<const unsigned char> block, size_t period);
+        static Expected keystream(const random_engine::Keystream& stream);
+
+        Kind kind = Kind::Constant;
+        unsigned char value = 0;
+        std::shared_ptr<const unsigned char> block;
+        size_t period = 0;
+        random_engine::Keystream stream{};
+    };
+
+    struct Mismatch {
+        unsigned long long offset;
+        unsigned long long length;  // from the first to the last differing byte of the range
+    };
+
+    const size_t kMaxReportedMismatches = 32;
+
+    struct Result {
+        unsigned long long bytesChecked = 0;
+        unsigned long long bytesMismatched = 0;
+        std::vector<Mismatch> mismatches;   // first kMaxReportedMismatches ranges, by offset
+        double seconds = 0.0;
+        std::string error;                  // set when the target could not be read back
+
+        bool passed() const { return error.empty() && bytesMismatched == 0; }
+    };
+
+    // handle must be readable; it is synced and evicted from the cache before reading.
+    Result verify(volume_utils::VolumeHandle handle, unsigned long long size, const Expected& expected, const Options& options);
+    Result verifyFile(const std::string& path, unsigned long long size, const Expected& expected, const Options& options);
+    // Only the given ranges, e.g. the allocated extents of a sparse file
+    Result verify(volume_utils::VolumeHandle handle, const std::vector<extent_map::Extent>& extents, const Expected& expected, const Options& options);
+    Result verifyFile(const std::string& path, const std::vector<extent_map::Extent>& extents, const Expected& expected, const Options& options);
+
+    std::string describe(const Result& result);
+    std::string modeName(Mode mode);
+}
@@ -1,51 +1,439 @@
-#include "volume_utils.h"
-#include <winioctl.h>
-
-namespace volume_utils {
-    DWORD getSectorSize(HANDLE hVolume) {
-        DISK_GEOMETRY diskGeometry;
-        DWORD bytesReturned;
-        if (DeviceIoControl(hVolume, IOCTL_DISK_GET_DRIVE_GEOMETRY, nullptr, 0, &diskGeometry, sizeof(diskGeometry), &bytesReturned, nullptr)) {
-            return diskGeometry.BytesPerSector;
-        }
-        return 4096;
-    }
-
-    HANDLE lockVolume(const std::wstring& volumePath) {
-        HANDLE hVolume = CreateFileW(
-            volumePath.c_str(),
-            GENERIC_READ | GENERIC_WRITE,
-            FILE_SHARE_READ | FILE_SHARE_WRITE,
-            nullptr,
-            OPEN_EXISTING,
-            FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH,
-            nullptr
-        );
-
-        if (hVolume == INVALID_HANDLE_VALUE) {
-            return INVALID_HANDLE_VALUE;
-        }
-
-        DWORD bytesReturned;
-        if (!DeviceIoControl(hVolume, FSCTL_LOCK_VOLUME, nullptr, 0, nullptr, 0, &bytesReturned, nullptr)) {
-            CloseHandle(hVolume);
-            return INVALID_HANDLE_VALUE;
-        }
-
-        return hVolume;
-    }
-
-    bool dismountVolume(HANDLE hVolume) {
-        DWORD bytesReturned;
-        return DeviceIoControl(hVolume, FSCTL_DISMOUNT_VOLUME, nullptr, 0, nullptr, 0, &bytesReturned, nullptr);
-    }
-
-    ULONGLONG getVolumeSize(HANDLE hVolume) {
-        PARTITION_INFORMATION_EX partInfo;
-        DWORD bytesReturned;
-        if (DeviceIoControl(hVolume, IOCTL_DISK_GET_PARTITION_INFO_EX, nullptr, 0, &partInfo, sizeof(partInfo), &bytesReturned, nullptr)) {
-            return partInfo.PartitionLength.QuadPart;
-        }
-        return 0;
-    }
-}
\ No newline at end of file
+#include "volume_utils.h"
+#include "metrics.h"
+#include "sim_device.h"
+#include "utils.h"
+
+#ifdef _WIN32
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+namespace volume_utils {
+#ifdef _WIN32
+    unsigned long getSectorSize(VolumeHandle hVolume) {
+        DISK_GEOMETRY diskGeometry;
+        DWORD bytesReturned;
+        if (DeviceIoControl(hVolume, IOCTL_DISK_GET_DRIVE_GEOMETRY, nullptr, 0, &diskGeometry, sizeof(diskGeometry), &bytesReturned, nullptr)) {
+            return diskGeometry.BytesPerSector;
+        }
+        return 4096;
+    }
+
+    unsigned long getPhysicalSectorSize(VolumeHandle hVolume) {
+        STORAGE_PROPERTY_QUERY query = {};
+        query.PropertyId = StorageAccessAlignmentProperty;
+        query.QueryType = PropertyStandardQuery;
+        STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment = {};
+        DWORD bytesReturned;
+        if (DeviceIoControl(hVolume, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &alignment, sizeof(alignment), &bytesReturned, nullptr)) {
+            return alignment.BytesPerPhysicalSector;
+        }
+        return getSectorSize(hVolume);
+    }
+
+    VolumeHandle lockVolume(const std::string& volumePath) {
+        std::wstring widePath = utils::stringToWString(volumePath);
+        HANDLE hVolume = CreateFileW(
+            widePath.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH,
+            nullptr
+        );
+
+        if (hVolume == INVALID_HANDLE_VALUE) {
+            return INVALID_HANDLE_VALUE;
+        }
+
+        DWORD bytesReturned;
+        if (!DeviceIoControl(hVolume, FSCTL_LOCK_VOLUME, nullptr, 0, nullptr, 0, &bytesReturned, nullptr)) {
+            CloseHandle(hVolume);
+            return INVALID_HANDLE_VALUE;
+        }
+
+        return hVolume;
+    }
+
+    bool dismountVolume(VolumeHandle hVolume) {
+        DWORD bytesReturned;
+        return DeviceIoControl(hVolume, FSCTL_DISMOUNT_VOLUME, nullptr, 0, nullptr, 0, &bytesReturned, nullptr);
+    }
+
+    unsigned long long getVolumeSize(VolumeHandle hVolume) {
+        PARTITION_INFORMATION_EX partInfo;
+        DWORD bytesReturned;
+        if (DeviceIoControl(hVolume, IOCTL_DISK_GET_PARTITION_INFO_EX, nullptr, 0, &partInfo, sizeof(partInfo), &bytesReturned, nullptr)) {
+            return partInfo.PartitionLength.QuadPart;
+        }
+        return 0;
+    }
+
+    bool writeAt(VolumeHandle hVolume, const void* data, size_t length, unsigned long long offset) {
+        const unsigned char* cursor = static_cast<const unsigned char*>(data);
+        while (length > 0) {
+            // A synchronous handle still honours the offset carried in OVERLAPPED
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD bytesWritten = 0;
+            if (!WriteFile(hVolume, cursor, static_cast<DWORD>(length), &bytesWritten, &overlapped) || bytesWritten == 0) {
+                return false;
+            }
+            cursor += bytesWritten;
+            length -= bytesWritten;
+            offset += bytesWritten;
+        }
+        return true;
+    }
+
+    bool flushVolume(VolumeHandle hVolume) {
+        metrics::Scoped timed(metrics::Timer::Flush);
+        return FlushFileBuffers(hVolume) != 0;
+    }
+
+    bool readAt(VolumeHandle hVolume, void* data, size_t length, unsigned long long offset, size_t& bytesRead) {
+        unsigned char* cursor = static_cast<unsigned char*>(data);
+        bytesRead = 0;
+        while (length > 0) {
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD chunk = 0;
+            if (!ReadFile(hVolume, cursor, static_cast<DWORD>(length), &chunk, &overlapped)) {
+                return GetLastError() == ERROR_HANDLE_EOF;
+            }
+            if (chunk == 0) {
+                return true;
+            }
+            cursor += chunk;
+            length -= chunk;
+            offset += chunk;
+            bytesRead += chunk;
+        }
+        return true;
+    }
+
+    bool dropCache(VolumeHandle hVolume) {
+        // Handles opened with FILE_FLAG_NO_BUFFERING never read through the cache; flushing is enough.
+        metrics::Scoped timed(metrics::Timer::Flush);
+        return FlushFileBuffers(hVolume) != 0 || GetLastError() == ERROR_ACCESS_DENIED;
+    }
+
+    VolumeHandle openForReadback(const std::string& path) {
+        std::wstring widePath = utils::stringToWString(path);
+        // Flush through a writable handle first; the unbuffered read handle cannot flush.
+        HANDLE writer = CreateFileW(widePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (writer != INVALID_HANDLE_VALUE) {
+            FlushFileBuffers(writer);
+            CloseHandle(writer);
+        }
+        return CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+    }
+
+    unsigned long long sizeOf(const std::string& path) {
+        HANDLE handle = CreateFileW(utils::stringToWString(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return 0;
+        }
+        unsigned long long size = getVolumeSize(handle);
+        LARGE_INTEGER fileSize;
+        if (size == 0 && GetFileSizeEx(handle, &fileSize)) {
+            size = static_cast<unsigned long long>(fileSize.QuadPart);
+        }
+        CloseHandle(handle);
+        return size;
+    }
+
+    VolumeHandle openForOverwrite(const std::string& path, bool unbuffered) {
+        return CreateFileW(utils::stringToWString(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, unbuffered ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+
+    bool syncFile(const std::string& path) {
+        HANDLE file = CreateFileW(utils::stringToWString(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        bool ok = false;
+        {
+            metrics::Scoped timed(metrics::Timer::Flush);
+            ok = FlushFileBuffers(file) != 0;
+        }
+        CloseHandle(file);
+        return ok;
+    }
+
+    bool unalignedForHandle(VolumeHandle, const void*, size_t, unsigned long long) {
+        return false;
+    }
+
+    void closeVolume(VolumeHandle hVolume) {
+        CloseHandle(hVolume);
+    }
+
+    std::string lastErrorMessage() {
+        return "Error code: " + std::to_string(GetLastError());
+    }
+#else
+    namespace {
+        bool isBlockDevice(int fd) {
+            struct stat info;
+            return fstat(fd, &info) == 0 && S_ISBLK(info.st_mode);
+        }
+
+        // A buffered descriptor on the same file or device. Flags set with F_SETFL belong to the open
+        // file description, so clearing O_DIRECT on the handle itself would turn every later write
+        // (and every io_uring write in flight) buffered; a second open leaves the handle alone. The
+        // O_EXCL claim and the image flock belong to the handle and do not stop this open.
+        int openBufferedTwin(int fd, int access) {
+            std::string path = "/proc/self/fd/" + std::to_string(fd);
+            return open(path.c_str(), access | O_CLOEXEC);
+        }
+    }
+
+    unsigned long getSectorSize(VolumeHandle hVolume) {
+        if (unsigned long simulated = sim_device::sectorSize(hVolume)) {
+            return simulated;
+        }
+        int logical = 0;
+        if (isBlockDevice(hVolume) && ioctl(hVolume, BLKSSZGET, &logical) == 0 && logical > 0) {
+            return static_cast<unsigned long>(logical);
+        }
+        return 4096;
+    }
+
+    unsigned long getPhysicalSectorSize(VolumeHandle hVolume) {
+        unsigned int physical = 0;
+        if (isBlockDevice(hVolume) && ioctl(hVolume, BLKPBSZGET, &physical) == 0 && physical > 0) {
+            return physical;
+        }
+        return getSectorSize(hVolume);
+    }
+
+    // Block devices are opened O_EXCL, which the kernel refuses while the device is mounted or
+    // otherwise claimed. Image files get an exclusive flock instead.
+    VolumeHandle lockVolume(const std::string& volumePath) {
+        if (sim_device::isSimulated(volumePath)) {
+            return sim_device::open(volumePath);
+        }
+        int fd = open(volumePath.c_str(), O_RDWR | O_DIRECT | O_EXCL | O_CLOEXEC);
+        if (fd < 0) {
+            return kInvalidVolume;
+        }
+        if (!isBlockDevice(fd) && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return kInvalidVolume;
+        }
+        return fd;
+    }
+
+    bool dismountVolume(VolumeHandle) {
+        // Nothing to do: the exclusive open in lockVolume already guarantees no filesystem is mounted.
+        return true;
+    }
+
+    unsigned long long getVolumeSize(VolumeHandle hVolume) {
+        if (isBlockDevice(hVolume)) {
+            unsigned long long size = 0;
+            if (ioctl(hVolume, BLKGETSIZE64, &size) == 0) {
+                return size;
+            }
+            return 0;
+        }
+        struct stat info;
+        if (fstat(hVolume, &info) == 0) {
+            return static_cast<unsigned long long>(info.st_size);
+        }
+        return 0;
+    }
+
+    bool writeAt(VolumeHandle hVolume, const void* data, size_t length, unsigned long long offset) {
+        const unsigned char* cursor = static_cast<const unsigned char*>(data);
+        if (sim_device::simulated(hVolume)) {
+            while (length > 0) {
+                sim_device::Completion completion = sim_device::write(hVolume, cursor, length, offset);
+                std::this_thread::sleep_until(completion.at);
+                if (completion.error != 0 || completion.written == 0) {
+                    errno = completion.error != 0 ? completion.error : ENOSPC;
+                    return false;
+                }
+                cursor += completion.written;
+                length -= completion.written;
+                offset += completion.written;
+            }
+            return true;
+        }
+        while (length > 0) {
+            ssize_t written = pwrite(hVolume, cursor, length, static_cast<off_t>(offset));
+            if (written < 0) {
+                int error = errno;
+                if (error == EINTR) {
+                    continue;
+                }
+                if (error == EINVAL && unalignedForHandle(hVolume, cursor, length, offset)) {
+                    int buffered = openBufferedTwin(hVolume, O_WRONLY);
+                    if (buffered < 0) {
+                        return false;
+                    }
+                    bool ok = writeAt(buffered, cursor, length, offset);
+                    error = errno;
+                    close(buffered);
+                    errno = error;
+                    return ok;
+                }
+                errno = error;
+                return false;
+            }
+            if (written == 0) {
+                errno = ENOSPC;
+                return false;
+            }
+            cursor += written;
+            length -= static_cast<size_t>(written);
+            offset += static_cast<unsigned long long>(written);
+        }
+        return true;
+    }
+
+    bool unalignedForHandle(VolumeHandle hVolume, const void* data, size_t length, unsigned long long offset) {
+        int flags = fcntl(hVolume, F_GETFL);
+        if (flags < 0 || (flags & O_DIRECT) == 0) {
+            return false;
+        }
+        const unsigned long sector = getSectorSize(hVolume);
+        return offset % sector != 0 || length % sector != 0 || reinterpret_cast<uintptr_t>(data) % sector != 0;
+    }
+
+    bool flushVolume(VolumeHandle hVolume) {
+        metrics::Scoped timed(metrics::Timer::Flush);
+        return fsync(hVolume) == 0;
+    }
+
+    bool readAt(VolumeHandle hVolume, void* data, size_t length, unsigned long long offset, size_t& bytesRead) {
+        unsigned char* cursor = static_cast<unsigned char*>(data);
+        bytesRead = 0;
+        while (length > 0) {
+            ssize_t chunk = pread(hVolume, cursor, length, static_cast<off_t>(offset));
+            if (chunk < 0) {
+                int error = errno;
+                if (error == EINTR) {
+                    continue;
+                }
+                // Same unaligned-tail fallback as writeAt; dropping the clean pages first still reads the media.
+                if (error == EINVAL && unalignedForHandle(hVolume, cursor, length, offset)) {
+                    int buffered = openBufferedTwin(hVolume, O_RDONLY);
+                    if (buffered < 0) {
+                        return false;
+                    }
+                    posix_fadvise(buffered, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+                    size_t tail = 0;
+                    bool ok = readAt(buffered, cursor, length, offset, tail);
+                    error = errno;
+                    close(buffered);
+                    bytesRead += tail;
+                    errno = error;
+                    return ok;
+                }
+                errno = error;
+                return false;
+            }
+            if (chunk == 0) {
+                return true;
+            }
+            cursor += chunk;
+            length -= static_cast<size_t>(chunk);
+            offset += static_cast<unsigned long long>(chunk);
+            bytesRead += static_cast<size_t>(chunk);
+        }
+        return true;
+    }
+
+    bool dropCache(VolumeHandle hVolume) {
+        // fdatasync works on a read-only descriptor too; DONTNEED only evicts clean pages, hence the sync first.
+        metrics::Scoped timed(metrics::Timer::Flush);
+        if (fdatasync(hVolume) != 0 && errno != EINVAL) {
+            return false;
+        }
+        return posix_fadvise(hVolume, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    }
+
+    VolumeHandle openForReadback(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+        if (fd < 0 && errno == EINVAL) {
+            // Filesystems without O_DIRECT (tmpfs, some FUSE mounts): read through a dropped cache instead.
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd >= 0 && !dropCache(fd)) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return kInvalidVolume;
+        }
+        return fd;
+    }
+
+    unsigned long long sizeOf(const std::string& path) {
+        sim_device::Spec spec;
+        std::string error;
+        if (sim_device::parse(path, spec, error)) {
+            return spec.size;
+        }
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return 0;
+        }
+        unsigned long long size = getVolumeSize(fd);
+        close(fd);
+        return size;
+    }
+
+    VolumeHandle openForOverwrite(const std::string& path, bool unbuffered) {
+        return open(path.c_str(), O_WRONLY | O_CLOEXEC | (unbuffered ? O_DIRECT : 0));
+    }
+
+    bool syncFile(const std::string& path) {
+        // fsync through any descriptor flushes every dirty page of the file
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = false;
+        {
+            metrics::Scoped timed(metrics::Timer::Flush);
+            ok = fsync(fd) == 0;
+        }
+        int error = errno;
+        close(fd);
+        errno = error;
+        return ok;
+    }
+
+    void closeVolume(VolumeHandle hVolume) {
+        sim_device::release(hVolume);
+        close(hVolume);
+    }
+
+    std::string lastErrorMessage() {
+        int error = errno;
+        return std::string(std::strerror(error)) + " (errno " + std::to_string(error) + ")";
+    }
+#endif
+}
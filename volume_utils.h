@@ -1,10 +1,46 @@
-#pragma once
-#include <windows.h>
-#include <string>
-
-namespace volume_utils {
-    DWORD getSectorSize(HANDLE hVolume);
-    HANDLE lockVolume(const std::wstring& volumePath);
-    bool dismountVolume(HANDLE hVolume);
-    ULONGLONG getVolumeSize(HANDLE hVolume);
-}
\ No newline at end of file
+#pragma once
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <cstddef>
+#include <string>
+
+namespace volume_utils {
+#ifdef _WIN32
+    using VolumeHandle = HANDLE;
+    const VolumeHandle kInvalidVolume = INVALID_HANDLE_VALUE;
+#else
+    using VolumeHandle = int;
+    const VolumeHandle kInvalidVolume = -1;
+#endif
+
+    unsigned long getSectorSize(VolumeHandle hVolume);
+    unsigned long getPhysicalSectorSize(VolumeHandle hVolume);
+    VolumeHandle lockVolume(const std::string& volumePath);
+    bool dismountVolume(VolumeHandle hVolume);
+    unsigned long long getVolumeSize(VolumeHandle hVolume);
+    // Size of a device, image file or simulated device from a plain read-only open, with no flush and
+    // no effect on the cache; 0 when it cannot be read.
+    unsigned long long sizeOf(const std::string& path);
+    // On an O_DIRECT handle a request off the sector grid (e.g. the tail of an odd-sized image file)
+    // goes through a second, buffered descriptor; the handle itself stays unbuffered.
+    bool writeAt(VolumeHandle hVolume, const void* data, size_t length, unsigned long long offset);
+    // True when the handle is unbuffered and the request is not sector aligned, so the kernel rejects it
+    // with EINVAL rather than because of a real error. Always false on Windows.
+    bool unalignedForHandle(VolumeHandle hVolume, const void* data, size_t length, unsigned long long offset);
+    bool flushVolume(VolumeHandle hVolume);
+    // Reads until length bytes or the end of the target; bytesRead is short only at the end. Unaligned
+    // requests on an O_DIRECT handle are read like writeAt writes them, with the cached pages dropped first.
+    bool readAt(VolumeHandle hVolume, void* data, size_t length, unsigned long long offset, size_t& bytesRead);
+    // Makes written data durable and evicts it from the page cache, so the next reads come from the media.
+    bool dropCache(VolumeHandle hVolume);
+    // Read-only handle on a file for checking what reached the media; bypasses the cache where possible.
+    VolumeHandle openForReadback(const std::string& path);
+    // Writable handle on an existing file. Unbuffered means O_DIRECT / FILE_FLAG_NO_BUFFERING: writes must then be
+    // sector multiples at sector-aligned offsets from sector-aligned memory. Fails (EINVAL) where the filesystem has no such mode.
+    VolumeHandle openForOverwrite(const std::string& path, bool unbuffered);
+    // Flushes a file's written data to the media through a handle of its own.
+    bool syncFile(const std::string& path);
+    void closeVolume(VolumeHandle hVolume);
+    std::string lastErrorMessage();
+}
@@ -0,0 +1,206 @@
+#include "write_pipeline.h"
+#include "buffer_pool.h"
+#include "numa_affinity.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace write_pipeline {
+    namespace {
+        struct Slot {
+            buffer_pool::Lease data;
+            uint64_t chunk = 0;
+            bool ready = false;
+        };
+
+        struct Ring {
+            std::mutex mutex;
+            std::condition_variable slotFreed;
+            std::condition_variable slotReady;
+            std::vector<Slot> slots;
+            uint64_t nextToFill = 0;
+            uint64_t nextToWrite = 0;        // lowest chunk whose write has not completed
+            std::set<uint64_t> completed;    // completions above nextToWrite (async sinks finish out of order)
+            bool aborted = false;
+            std::exception_ptr error;
+        };
+
+        // Adapts a blocking write callback to the sink interface with a depth of one.
+        class SyncSink : public AsyncSink {
+        public:
+            explicit SyncSink(const WriteFn& write) : write_(write) {}
+            size_t depth() const override { return 1; }
+            void submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) override {
+                write_(buffer, length, offset);
+                last_ = tag;
+            }
+            uint64_t wait() override { return last_; }
+
+        private:
+            const WriteFn& write_;
+            uint64_t last_ = 0;
+        };
+    }
+
+    void run(uint64_t totalBytes, const Config& config, const FillFn& fill, const WriteFn& write,
+        const ProgressFn& progress) {
+        SyncSink sink(write);
+        run(totalBytes, config, fill, sink, progress);
+    }
+
+    void run(uint64_t totalBytes, const Config& config, const FillFn& fill, AsyncSink& sink,
+        const ProgressFn& progress) {
+        if (totalBytes == 0) {
+            return;
+        }
+
+        const size_t chunkSize = std::max<size_t>(config.chunkSize, 1);
+        const uint64_t chunks = (totalBytes + chunkSize - 1) / chunkSize;
+        const size_t depth = std::max<size_t>(sink.depth(), 1);
+
+        // A single chunk gains nothing from the pipeline; produce and write it inline.
+        if (chunks == 1) {
+            buffer_pool::Lease buffer = buffer_pool::acquire(static_cast<size_t>(totalBytes));
+            fill(buffer.get(), static_cast<size_t>(totalBytes), 0);
+            sink.submit(buffer.get(), static_cast<size_t>(totalBytes), 0, 0);
+            sink.wait();
+            if (progress) {
+                progress(totalBytes);
+            }
+            return;
+        }
+
+        size_t generators = config.generatorThreads;
+        if (generators == 0) {
+            generators = std::min(numa_affinity::allowedCpus(), kMaxDefaultGenerators);
+        }
+        generators = static_cast<size_t>(std::min<uint64_t>(generators, chunks));
+        size_t slotCount = config.ringSlots != 0 ? config.ringSlots : generators + depth + 1;
+        slotCount = static_cast<size_t>(std::min<uint64_t>(std::max<size_t>(slotCount, 2), chunks));
+
+        Ring ring;
+        ring.slots.resize(slotCount);
+        std::vector<buffer_pool::Lease> buffers = buffer_pool::acquire(slotCount, chunkSize);
+        for (size_t i = 0; i < slotCount; ++i) {
+            ring.slots[i].data = std::move(buffers[i]);
+        }
+
+        auto chunkLength = [&](uint64_t chunk) {
+            return static_cast<size_t>(std::min<uint64_t>(chunkSize, totalBytes - chunk * chunkSize));
+        };
+
+        auto generate = [&]() {
+            while (true) {
+                uint64_t chunk;
+                {
+                    std::unique_lock<std::mutex> lock(ring.mutex);
+                    // Backpressure: a chunk may only be claimed once the chunk that last used its slot has been written.
+                    ring.slotFreed.wait(lock, [&]() {
+                        return ring.aborted || ring.nextToFill >= chunks || ring.nextToFill < ring.nextToWrite + slotCount;
+                    });
+                    if (ring.aborted || ring.nextToFill >= chunks) {
+                        return;
+                    }
+                    chunk = ring.nextToFill++;
+                }
+
+                Slot& slot = ring.slots[chunk % slotCount];
+                try {
+                    fill(slot.data.get(), chunkLength(chunk), chunk * chunkSize);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(ring.mutex);
+                    if (!ring.error) {
+                        ring.error = std::current_exception();
+                    }
+                    ring.aborted = true;
+                    ring.slotReady.notify_all();
+                    ring.slotFreed.notify_all();
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(ring.mutex);
+                slot.chunk = chunk;
+                slot.ready = true;
+                ring.slotReady.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(generators);
+        for (size_t i = 0; i < generators; ++i) {
+            workers.emplace_back(generate);
+        }
+
+        uint64_t bytesWritten = 0;
+        size_t inFlight = 0;
+        auto complete = [&](uint64_t chunk) {
+            bytesWritten += chunkLength(chunk);
+            if (progress) {
+                progress(bytesWritten);
+            }
+            std::lock_guard<std::mutex> lock(ring.mutex);
+            ring.slots[chunk % slotCount].ready = false;
+            ring.completed.insert(chunk);
+            while (!ring.completed.empty() && *ring.completed.begin() == ring.nextToWrite) {
+                ring.completed.erase(ring.completed.begin());
+                ring.nextToWrite++;
+            }
+            ring.slotFreed.notify_all();
+        };
+
+        try {
+            for (uint64_t chunk = 0; chunk < chunks; ++chunk) {
+                Slot& slot = ring.slots[chunk % slotCount];
+                {
+                    std::unique_lock<std::mutex> lock(ring.mutex);
+                    ring.slotReady.wait(lock, [&]() { return ring.aborted || (slot.ready && slot.chunk == chunk); });
+                    if (ring.aborted) {
+                        break;
+                    }
+                }
+
+                sink.submit(slot.data.get(), chunkLength(chunk), chunk * chunkSize, chunk);
+                inFlight++;
+                while (inFlight >= depth) {
+                    inFlight--;
+                    complete(sink.wait());
+                }
+            }
+            while (inFlight > 0) {
+                inFlight--;
+                complete(sink.wait());
+            }
+        }
+        catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(ring.mutex);
+                if (!ring.error) {
+                    ring.error = std::current_exception();
+                }
+                ring.aborted = true;
+                ring.slotFreed.notify_all();
+            }
+            // Slot buffers must outlive every write the sink still holds.
+            while (inFlight > 0) {
+                inFlight--;
+                try {
+                    sink.wait();
+                }
+                catch (...) {
+                }
+            }
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (ring.error) {
+            std::rethrow_exception(ring.error);
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// write_pipeline.h
+// Producer/consumer pipeline: generator threads fill a ring of chunk buffers while the
+// caller's thread writes them out in order. Generators block when the ring is full.
+namespace write_pipeline {
+    using FillFn = std::function<void(unsigned char* buffer, size_t length, uint64_t offset)>;
+    using WriteFn = std::function<void(const unsigned char* buffer, size_t length, uint64_t offset)>;
+    using ProgressFn = std::function<void(uint64_t bytesWritten)>;
+
+    const size_t kDefaultChunkSize = 8 * 1024 * 1024;
+    const size_t kMaxDefaultGenerators = 8;
+
+    struct Config {
+        size_t chunkSize = kDefaultChunkSize;
+        size_t ringSlots = 0;         // 0 = generator threads + sink depth + 1
+        size_t generatorThreads = 0;  // 0 = one per CPU the caller may run on, capped at kMaxDefaultGenerators
+    };
+
+    // Destination that can keep several writes in flight. submit() starts a write of a chunk
+    // buffer; wait() blocks until one write finishes and returns the tag it was submitted with.
+    // wait() consumes its completion even when it throws.
+    class AsyncSink {
+    public:
+        virtual ~AsyncSink() = default;
+        virtual size_t depth() const = 0;
+        virtual void submit(const unsigned char* buffer, size_t length, uint64_t offset, uint64_t tag) = 0;
+        virtual uint64_t wait() = 0;
+    };
+
+    // Fill, write and sink calls report failure by throwing; the first exception stops the pipeline
+    // and is rethrown to the caller once every generator thread has exited and no write is in flight.
+    // Chunk buffers are leased from buffer_pool as one set, so they are page-aligned.
+    void run(uint64_t totalBytes, const Config& config, const FillFn& fill, const WriteFn& write,
+        const ProgressFn& progress = nullptr);
+    void run(uint64_t totalBytes, const Config& config, const FillFn& fill, AsyncSink& sink,
+        const ProgressFn& progress = nullptr);
+}